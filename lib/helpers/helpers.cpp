@@ -10,6 +10,14 @@ bool isHexString(const String &str) {
     return true;
 }
 
+bool isHexString(const char* str) {
+    for (; *str; str++) {
+        if (!isHexadecimalDigit(*str))
+            return false;
+    }
+    return true;
+}
+
 void hexStringToByteArray(const char* hexString, uint8_t* byteArray, size_t byteArraySize) {
     for (size_t i = 0; i < byteArraySize / 2; i++) {
         sscanf(hexString + i * 2, "%2hhx", &byteArray[i]);
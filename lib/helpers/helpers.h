@@ -4,6 +4,7 @@
 #include <Arduino.h>
 
 bool isHexString(const String &str);
+bool isHexString(const char* str);
 
 void hexStringToByteArray(const char* hexString, uint8_t* byteArray, size_t byteArraySize);
 
@@ -0,0 +1,216 @@
+# Generates the JavaScript uplink decoder for the network server (The Things Stack,
+# ChirpStack) from PAYLOAD_FIELDS in src/payload.h, so that it always matches the
+# firmware. Runs before every PlatformIO build, see extra_scripts in platformio.ini,
+# and writes payload_decoder.js to the build directory; or standalone:
+#   python scripts/payload_decoder.py [output.js]
+
+import os
+import re
+import sys
+
+HEADER = os.path.join("src", "payload.h")
+
+
+def parse(path):
+    with open(path) as f:
+        text = re.sub(r"/\*.*?\*/", "", f.read(), flags=re.S)
+    consts = {name: int(value, 0) for name, value in
+              re.findall(r"#define\s+(PAYLOAD_\w+)\s+(0x[0-9A-Fa-f]+|\d+)\b", text)}
+    block = re.search(r"#define\s+PAYLOAD_FIELDS\(X\)((?:.*\\\n)*.*)", text).group(1)
+    rows = []
+    for args in re.findall(r"X\(([^)]*)\)", block):
+        field, scale, offset, bits, sign, condition, lsb, n = [a.strip() for a in args.split(",")]
+        rows.append({
+            "field": field,
+            "scale": float(scale),
+            "offset": float(offset),
+            "bits": int(bits),
+            "signed": sign == "true",
+            "condition": eval(condition, {}, consts),
+            "lsb": int(lsb),
+            "n": int(n),
+        })
+    for row in rows:
+        first = next(r for r in rows if r["field"] == row["field"])
+        for key in ("scale", "offset", "bits", "signed", "condition"):
+            assert row[key] == first[key], "the parts of %s differ in %s" % (row["field"], key)
+    return consts, rows
+
+
+def number(x):
+    return repr(int(x)) if x == int(x) else repr(x)
+
+
+def value(row):
+    raw = "raw.%s" % row["field"]
+    if row["signed"]:
+        raw = "signed(%s, %d)" % (raw, row["bits"])
+    scale = row["scale"]
+    if scale < 1 and 1 / scale == int(1 / scale):
+        expr = "%s * %s" % (raw, number(1 / scale))
+    elif scale != 1:
+        expr = "%s / %s" % (raw, number(scale))
+    else:
+        expr = raw
+    if row["offset"]:
+        expr += " + %s" % number(row["offset"])
+    return expr
+
+
+def generate(consts, rows):
+    batch = consts["PAYLOAD_BATCH"]
+    conditions = []
+    for row in rows:
+        if row["condition"] not in conditions:
+            conditions.append(row["condition"])
+    size = []
+    for c in conditions:
+        total = sum(row["n"] for row in rows if row["condition"] == c)
+        assert total % 8 == 0, "the optional parts of the payload must be whole bytes"
+        size.append(str(total // 8) if c == 0 else "((port & %d) == %d ? %d : 0)" % (c, c, total // 8))
+
+    out = [
+        "// Decoder for the uplinks of the MJLO firmware, for The Things Stack and ChirpStack.",
+        "// Generated from PAYLOAD_FIELDS in src/payload.h by scripts/payload_decoder.py; do not edit.",
+        "function decodeUplink(input) {",
+        "  var bytes = input.bytes, port = input.fPort, pos = 0;",
+        "",
+        "  // the next n bits, least significant bit first",
+        "  function take(n) {",
+        "    var value = 0;",
+        "    for (var i = 0; i < n; i++, pos++) {",
+        "      if (bytes[pos >> 3] & (1 << (pos & 7))) value += Math.pow(2, i);",
+        "    }",
+        "    return value;",
+        "  }",
+        "  // sign-magnitude, with the sign in the top bit",
+        "  function signed(value, bits) {",
+        "    var sign = Math.pow(2, bits - 1);",
+        "    return value >= sign ? sign - value : value;",
+        "  }",
+        "  function unsigned(value, bits) {",
+        "    return value < 0 ? Math.pow(2, bits - 1) - value : value;",
+        "  }",
+        "  function unzigzag(value) {",
+        "    return value % 2 ? -(value + 1) / 2 : value / 2;",
+        "  }",
+        "  // a difference in a batch: a 2-bit class, and a zigzag difference or the value itself",
+        "  function delta(bits) {",
+        "    var cls = take(2);",
+        "    return { cls: cls, value: take([0, bits / 4, bits / 2, bits][cls]) };",
+        "  }",
+        "  function field(first, bits, isSigned) {",
+        "    var d = delta(bits);",
+        "    if (d.cls == 3) return d.value;",
+        "    return isSigned ? unsigned(signed(first, bits) + unzigzag(d.value), bits) : first + unzigzag(d.value);",
+        "  }",
+        "",
+    ]
+
+    def group(lines, body, indent):
+        # rows in runs of the same condition
+        current = None
+        for row in rows:
+            line = body(row)
+            if line is None:
+                continue
+            if row["condition"] != current:
+                if current:
+                    lines.append(indent + "}")
+                current = row["condition"]
+                if current:
+                    lines.append(indent + "if ((port & %d) == %d) {" % (current, current))
+            lines.append(indent + ("  " if current else "") + line)
+        if current:
+            lines.append(indent + "}")
+
+    seen = set()
+
+    def gather(row):
+        first = row["field"] not in seen
+        seen.add(row["field"])
+        part = "take(%d)" % row["n"] if row["lsb"] == 0 else "take(%d) * %d" % (row["n"], 1 << row["lsb"])
+        return "raw.%s %s %s;" % (row["field"], "=" if first else "+=", part)
+
+    out.append("  // the quantised values of a single uplink")
+    out.append("  function frame() {")
+    out.append("    var raw = {};")
+    group(out, gather, "    ")
+    out.append("    return raw;")
+    out.append("  }")
+    out.append("  function values(raw) {")
+    out.append("    var data = {};")
+    group(out, lambda row: "data.%s = %s;" % (row["field"], value(row)) if row["lsb"] == 0 else None, "    ")
+    out.append("    return data;")
+    out.append("  }")
+    out += [
+        "",
+        "  if ((port & 1) == 0 || port > %d) {" % (2 * batch - 1),
+        "    return { errors: [\"unknown fPort \" + port] };",
+        "  }",
+        "  var motion = (port & %d) != 0, batched = (port & %d) != 0;" % (consts["PAYLOAD_MOTION"], batch),
+        "  var size = %s;" % " + ".join(size),
+        "  if (!batched) {",
+        "    if (bytes.length != size) {",
+        "      return { errors: [\"expected \" + size + \" bytes on fPort \" + port] };",
+        "    }",
+        "    var data = values(frame());",
+        "    data.motion = motion;",
+        "    return { data: data, warnings: [], errors: [] };",
+        "  }",
+        "",
+        "  // a batch, see PAYLOAD_BATCH in src/payload.h",
+        "  var count = bytes[0], spacing = bytes[1] + bytes[2] * 256;",
+        "  var age = bytes[3] + bytes[4] * 256 + bytes[5] * 65536;",
+        "  if (count < 1 || count > %d || bytes.length < %d + size) {" % (consts["PAYLOAD_BATCH_MAX"],
+                                                                        consts["PAYLOAD_BATCH_HEADER"]),
+        "    return { errors: [\"invalid batch on fPort \" + port] };",
+        "  }",
+        "  pos = %d;" % (consts["PAYLOAD_BATCH_HEADER"] * 8),
+        "  var first = frame(), records = [values(first)], offsets = [0];",
+        "  for (var r = 1; r < count; r++) {",
+        "    offsets.push(r * spacing + unzigzag(delta(16).value));",
+        "    var raw = {};",
+    ]
+
+    def difference(row):
+        if row["lsb"]:
+            return None
+        return "raw.%s = field(first.%s, %d, %s);" % (row["field"], row["field"], row["bits"],
+                                                      "true" if row["signed"] else "false")
+
+    group(out, difference, "    ")
+    out += [
+        "    records.push(values(raw));",
+        "  }",
+        "  if (pos > bytes.length * 8 || bytes.length * 8 - pos >= 8) {",
+        "    return { errors: [\"invalid batch on fPort \" + port] };",
+        "  }",
+        "  for (r = 0; r < count; r++) {",
+        "    records[r].age = age + Math.max(offsets[count - 1] - offsets[r], 0);",
+        "  }",
+        "  return { data: { motion: motion, records: records }, warnings: [], errors: [] };",
+        "}",
+    ]
+    return "\n".join(out) + "\n"
+
+
+def write(root, path):
+    consts, rows = parse(os.path.join(root, HEADER))
+    with open(path, "w") as f:
+        f.write(generate(consts, rows))
+
+
+if __name__ == "__main__":
+    root = os.path.join(os.path.dirname(os.path.abspath(sys.argv[0])), "..")
+    if len(sys.argv) > 1:
+        write(root, sys.argv[1])
+    else:
+        sys.stdout.write(generate(*parse(os.path.join(root, HEADER))))
+else:
+    Import("env")  # noqa: F821 (PlatformIO)
+    build = env.subst("$BUILD_DIR")  # noqa: F821
+    os.makedirs(build, exist_ok=True)
+    out = os.path.join(build, "payload_decoder.js")
+    write(env.subst("$PROJECT_DIR"), out)  # noqa: F821
+    print("Payload decoder: %s" % out)
@@ -0,0 +1,25 @@
+// Host stand-in for the AS7331 UV sensor
+#ifndef _SIM_ADAFRUIT_AS7331_H
+#define _SIM_ADAFRUIT_AS7331_H
+
+#include "Wire.h"
+
+typedef enum { AS7331_GAIN_2048X, AS7331_GAIN_1024X, AS7331_GAIN_512X, AS7331_GAIN_256X, AS7331_GAIN_128X,
+               AS7331_GAIN_64X, AS7331_GAIN_32X, AS7331_GAIN_16X, AS7331_GAIN_8X, AS7331_GAIN_4X,
+               AS7331_GAIN_2X, AS7331_GAIN_1X } as7331_gain_t;
+typedef enum { AS7331_TIME_1MS, AS7331_TIME_2MS, AS7331_TIME_4MS, AS7331_TIME_8MS, AS7331_TIME_16MS,
+               AS7331_TIME_32MS, AS7331_TIME_64MS, AS7331_TIME_128MS } as7331_time_t;
+typedef enum { AS7331_MODE_CONT, AS7331_MODE_CMD, AS7331_MODE_SYNS, AS7331_MODE_SYND } as7331_mode_t;
+
+class Adafruit_AS7331 {
+public:
+  bool begin(TwoWire* wire = &Wire, uint8_t addr = 0x74) { (void)wire, (void)addr; return(true); }
+  bool powerDown(bool down) { (void)down; return(true); }
+  bool setGain(as7331_gain_t gain) { (void)gain; return(true); }
+  bool setIntegrationTime(as7331_time_t time) { (void)time; return(true); }
+  bool setMeasurementMode(as7331_mode_t mode) { (void)mode; return(true); }
+  bool startMeasurement() { return(true); }
+  bool readAllUV_uWcm2(float* uva, float* uvb, float* uvc);
+};
+
+#endif
@@ -0,0 +1,19 @@
+// Host stand-in for the BME280 temperature, humidity and pressure sensor
+#ifndef _SIM_ADAFRUIT_BME280_H
+#define _SIM_ADAFRUIT_BME280_H
+
+#include "Wire.h"
+
+class Adafruit_BME280 {
+public:
+  enum sensor_mode { MODE_SLEEP = 0, MODE_FORCED = 1, MODE_NORMAL = 3 };
+
+  bool begin(uint8_t addr = 0x77, TwoWire* wire = &Wire) { (void)addr, (void)wire; return(true); }
+  void setSampling(sensor_mode mode = MODE_NORMAL) { (void)mode; }
+  bool takeForcedMeasurement() { delay(10); return(true); }
+  float readTemperature();
+  float readHumidity();
+  float readPressure();
+};
+
+#endif
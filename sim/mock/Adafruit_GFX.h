@@ -0,0 +1,47 @@
+// Host stand-in for the Adafruit GFX canvas: drawing calls are accepted and discarded
+#ifndef _SIM_ADAFRUIT_GFX_H
+#define _SIM_ADAFRUIT_GFX_H
+
+#include "Arduino.h"
+
+struct GFXfont;
+
+class Adafruit_GFX : public Print {
+public:
+  Adafruit_GFX(int16_t w, int16_t h) : _width(w), _height(h) {}
+
+  size_t write(uint8_t c) override { (void)c; return(1); }
+  using Print::write;
+
+  void setCursor(int16_t x, int16_t y) { (void)x, (void)y; }
+  void setTextColor(uint16_t c) { (void)c; }
+  void setTextColor(uint16_t c, uint16_t bg) { (void)c, (void)bg; }
+  void setTextSize(uint8_t s) { (void)s; }
+  void setTextWrap(bool w) { (void)w; }
+  void setFont(const GFXfont* f = NULL) { (void)f; }
+  void setFont(int f) { (void)f; }
+  void setRotation(uint8_t r) { (void)r; }
+  int16_t width() const { return(_width); }
+  int16_t height() const { return(_height); }
+
+  void fillScreen(uint16_t color) { (void)color; }
+  void drawPixel(int16_t x, int16_t y, uint16_t color) { (void)x, (void)y, (void)color; }
+  void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) { (void)x0, (void)y0, (void)x1, (void)y1, (void)color; }
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) { (void)x, (void)y, (void)w, (void)color; }
+  void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) { (void)x, (void)y, (void)h, (void)color; }
+  void drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) { (void)x, (void)y, (void)w, (void)h, (void)color; }
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) { (void)x, (void)y, (void)w, (void)h, (void)color; }
+  void drawRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color) { (void)x, (void)y, (void)w, (void)h, (void)r, (void)color; }
+  void fillRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color) { (void)x, (void)y, (void)w, (void)h, (void)r, (void)color; }
+  void fillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) {
+    (void)x0, (void)y0, (void)x1, (void)y1, (void)x2, (void)y2, (void)color;
+  }
+  void drawBitmap(int16_t x, int16_t y, const uint8_t* bitmap, int16_t w, int16_t h, uint16_t color) {
+    (void)x, (void)y, (void)bitmap, (void)w, (void)h, (void)color;
+  }
+
+protected:
+  int16_t _width, _height;
+};
+
+#endif
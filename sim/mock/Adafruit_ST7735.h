@@ -0,0 +1,22 @@
+// Host stand-in for the ST7735 TFT display
+#ifndef _SIM_ADAFRUIT_ST7735_H
+#define _SIM_ADAFRUIT_ST7735_H
+
+#include "Adafruit_GFX.h"
+#include "SPI.h"
+
+#define INITR_MINI160x80_PLUGIN 0x05
+
+#define ST7735_BLACK   0x0000
+#define ST7735_WHITE   0xFFFF
+#define ST7735_RED     0xF800
+#define ST7735_GREEN   0x07E0
+#define ST7735_BLUE    0x001F
+
+class Adafruit_ST7735 : public Adafruit_GFX {
+public:
+  Adafruit_ST7735(SPIClass* spi, int8_t cs, int8_t dc, int8_t rst) : Adafruit_GFX(80, 160) { (void)spi, (void)cs, (void)dc, (void)rst; }
+  void initR(uint8_t options) { (void)options; delay(150); }
+};
+
+#endif
@@ -0,0 +1,4 @@
+// Intentionally empty: the unified sensor interface is not used by the simulation
+#ifndef _SIM_ADAFRUIT_SENSOR_H
+#define _SIM_ADAFRUIT_SENSOR_H
+#endif
@@ -0,0 +1,16 @@
+// Host stand-in for the TSL2591 light sensor
+#ifndef _SIM_ADAFRUIT_TSL2591_H
+#define _SIM_ADAFRUIT_TSL2591_H
+
+#include "Wire.h"
+
+class Adafruit_TSL2591 {
+public:
+  bool begin(TwoWire* wire = &Wire, uint8_t addr = 0x29) { (void)wire, (void)addr; return(true); }
+  void enable() {}
+  void disable() {}
+  uint32_t getFullLuminosity();
+  float calculateLux(uint16_t ch0, uint16_t ch1) { return(ch0 - 1.7f * ch1); }
+};
+
+#endif
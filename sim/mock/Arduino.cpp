@@ -0,0 +1,402 @@
+#include <pthread.h>
+#include <unistd.h>
+#include "Arduino.h"
+#include "sim.h"
+#include "pins.h"
+
+HWCDC Serial;
+HardwareSerial Serial1;
+EspClass ESP;
+
+// ============= Timing =============
+
+static uint64_t bootUs() {
+  static uint64_t boot = simNow();
+  return(boot);
+}
+
+unsigned long millis() {
+  return((simNow() - bootUs()) / 1000);
+}
+
+unsigned long micros() {
+  return(simNow() - bootUs());
+}
+
+static void (*isrs[GPIO_NUM_MAX])(void) = { nullptr };
+static int isrModes[GPIO_NUM_MAX] = { 0 };
+
+static void advance(uint64_t us) {
+  if(!simIsMainThread()) {
+    simWaitUntil(simNow() + us);
+    return;
+  }
+
+  // deliver accelerometer pulses that occur during this delay
+  uint64_t from = simNow();
+  uint64_t motion = simNextMotion(from);
+  if(motion <= from + us && isrs[ACC_INT] && isrModes[ACC_INT] != FALLING) {
+    simAdvance(motion - from);
+    isrs[ACC_INT]();
+    simAdvance(from + us - motion);
+  } else {
+    simAdvance(us);
+  }
+}
+
+void delay(uint32_t ms) {
+  advance(ms * 1000ULL);
+}
+
+void delayMicroseconds(uint32_t us) {
+  advance(us);
+}
+
+void yield() {
+  advance(100);
+}
+
+void vTaskDelay(TickType_t ticks) {
+  delay(ticks * portTICK_PERIOD_MS);
+}
+
+// system time is kept in the RTC domain and survives deep sleep
+extern "C" {
+time_t __wrap_time(time_t* t) {
+  time_t now = (simNow() + sim->clockOffsetUs) / SIM_US_PER_S;
+  if(t) {
+    *t = now;
+  }
+  return(now);
+}
+
+int __wrap_gettimeofday(struct timeval* tv, void* tz) {
+  (void)tz;
+  int64_t now = simNow() + sim->clockOffsetUs;
+  tv->tv_sec = now / SIM_US_PER_S;
+  tv->tv_usec = now % SIM_US_PER_S;
+  return(0);
+}
+
+int __wrap_settimeofday(const struct timeval* tv, const void* tz) {
+  (void)tz;
+  sim->clockOffsetUs = (int64_t)tv->tv_sec * SIM_US_PER_S + tv->tv_usec - simNow();
+  return(0);
+}
+}
+
+// ============= GPIO =============
+
+static uint8_t outputs[GPIO_NUM_MAX] = { 0 };
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if(pin < GPIO_NUM_MAX) {
+    outputs[pin] = val;
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  if(pin == V_EXT || pin == V5_CTRL || pin == LED_B) {
+    return(outputs[pin]);
+  }
+  return(simPinLevel(pin));
+}
+
+void analogWrite(uint8_t pin, int value) {
+  (void)pin;
+  (void)value;
+}
+
+uint16_t analogRead(uint8_t pin) {
+  return(simAdcCounts(analogReadMilliVolts(pin)));
+}
+
+uint32_t analogReadMilliVolts(uint8_t pin) {
+  if(pin == BAT_ADC) {
+    return(simBatteryMillivolts() / 4.9f);
+  }
+  return(0);
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) {
+  if(pin < GPIO_NUM_MAX) {
+    isrs[pin] = isr;
+    isrModes[pin] = mode;
+  }
+}
+
+void detachInterrupt(uint8_t pin) {
+  if(pin < GPIO_NUM_MAX) {
+    isrs[pin] = nullptr;
+  }
+}
+
+bool usb_serial_jtag_is_connected() {
+  return(false);
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return((x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min);
+}
+
+long random(long max) {
+  return(max > 0 ? rand() % max : 0);
+}
+
+long random(long min, long max) {
+  return(min + random(max - min));
+}
+
+static uint32_t cpuFreq = 80;
+
+bool setCpuFrequencyMhz(uint32_t mhz) {
+  cpuFreq = mhz;
+  return(true);
+}
+
+uint32_t getCpuFrequencyMhz() {
+  return(cpuFreq);
+}
+
+bool isHexadecimalDigit(char c) {
+  return(isxdigit((unsigned char)c));
+}
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t len = strlen(src);
+  if(size) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return(len);
+}
+#endif
+
+// ============= Print & Stream =============
+
+size_t Print::printf(const char* format, ...) {
+  char buf[512];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if(len < 0) {
+    return(0);
+  }
+  return(write((const uint8_t*)buf, min((size_t)len, sizeof(buf) - 1)));
+}
+
+String Stream::readString() {
+  String ret;
+  int c;
+  while((c = read()) >= 0) {
+    ret += (char)c;
+  }
+  return(ret);
+}
+
+String Stream::readStringUntil(char terminator) {
+  String ret;
+  int c;
+  while((c = read()) >= 0 && c != terminator) {
+    ret += (char)c;
+  }
+  return(ret);
+}
+
+size_t Stream::readBytes(uint8_t* buf, size_t len) {
+  size_t n = 0;
+  int c;
+  while(n < len && (c = read()) >= 0) {
+    buf[n++] = c;
+  }
+  return(n);
+}
+
+size_t HWCDC::write(uint8_t c) {
+  return(write(&c, 1));
+}
+
+size_t HWCDC::write(const uint8_t* buf, size_t size) {
+  if(simVerbose) {
+    fwrite(buf, 1, size, stdout);
+  }
+  return(size);
+}
+
+// the GNSS receiver outputs a burst of NMEA data once per second
+static uint64_t gnssLastBurst = 0;
+static int gnssPending = 0;
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin) {
+  (void)baud, (void)config, (void)rxPin, (void)txPin;
+  simGnssPower(true);
+  gnssLastBurst = simNow();
+}
+
+void HardwareSerial::end() {
+  simGnssPower(false);
+}
+
+int HardwareSerial::available() {
+  if(digitalRead(V_EXT) == LOW) {
+    return(0);
+  }
+  if(simNow() - gnssLastBurst >= SIM_US_PER_S) {
+    gnssLastBurst = simNow();
+    gnssPending = 1;
+  }
+  return(gnssPending);
+}
+
+int HardwareSerial::read() {
+  if(!available()) {
+    return(-1);
+  }
+  gnssPending--;
+  return('\n');
+}
+
+int HardwareSerial::peek() {
+  return(available() ? '\n' : -1);
+}
+
+// ============= ESP =============
+
+void EspClass::restart() {
+  simExit(SIM_EXIT_RESTART);
+}
+
+// ============= Deep sleep =============
+
+int esp_sleep_enable_timer_wakeup(uint64_t time_in_us) {
+  sim->timerUs = time_in_us;
+  return(ESP_OK);
+}
+
+int esp_sleep_enable_ext0_wakeup(gpio_num_t gpio_num, int level) {
+  sim->ext0Pin = gpio_num;
+  sim->ext0Level = level;
+  return(ESP_OK);
+}
+
+int esp_sleep_enable_ext1_wakeup(uint64_t io_mask, esp_sleep_ext1_wakeup_mode_t level_mode) {
+  sim->ext1Mask = io_mask;
+  sim->ext1Mode = level_mode;
+  return(ESP_OK);
+}
+
+bool perimanClearPinBus(uint8_t pin) {
+  (void)pin;
+  return(true);
+}
+
+int esp_sleep_enable_ulp_wakeup() {
+  sim->ulpWake = true;
+  return(ESP_OK);
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+  return((esp_sleep_wakeup_cause_t)sim->wakeCause);
+}
+
+uint64_t esp_sleep_get_ext1_wakeup_status() {
+  return(sim->ext1Status);
+}
+
+void esp_deep_sleep_start() {
+  simExit(SIM_EXIT_SLEEP);
+}
+
+// ============= FreeRTOS =============
+
+struct TaskStart {
+  TaskFunction_t fn;
+  void* params;
+};
+
+static void* taskEntry(void* arg) {
+  TaskStart start = *(TaskStart*)arg;
+  delete (TaskStart*)arg;
+  start.fn(start.params);
+  simThreadStopped();
+  return(nullptr);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth,
+                                   void* params, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+  (void)name, (void)stackDepth, (void)priority, (void)core;
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  simThreadStarted();
+  int ret = pthread_create(&thread, &attr, taskEntry, new TaskStart{ fn, params });
+  pthread_attr_destroy(&attr);
+  if(handle) {
+    *handle = (TaskHandle_t)thread;
+  }
+  return(ret == 0 ? pdPASS : pdFALSE);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stackDepth,
+                       void* params, UBaseType_t priority, TaskHandle_t* handle) {
+  return(xTaskCreatePinnedToCore(fn, name, stackDepth, params, priority, handle, 0));
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+  if(handle == NULL) {
+    simThreadStopped();
+    pthread_exit(nullptr);
+  }
+  pthread_cancel((pthread_t)handle);
+  simThreadStopped();
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  pthread_mutex_t* m = new pthread_mutex_t;
+  pthread_mutex_init(m, nullptr);
+  return(m);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_t* m = new pthread_mutex_t;
+  pthread_mutex_init(m, &attr);
+  pthread_mutexattr_destroy(&attr);
+  return(m);
+}
+
+// waiting for a semaphore is done in virtual time, so that a blocked thread never stalls the clock
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+  for(TickType_t waited = 0; ; waited++) {
+    if(pthread_mutex_trylock((pthread_mutex_t*)sem) == 0) {
+      return(pdTRUE);
+    }
+    if(waited >= ticks) {
+      return(pdFALSE);
+    }
+    delay(1);
+  }
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  return(pthread_mutex_unlock((pthread_mutex_t*)sem) == 0 ? pdTRUE : pdFALSE);
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks) {
+  return(xSemaphoreTake(sem, ticks));
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem) {
+  return(xSemaphoreGive(sem));
+}
@@ -0,0 +1,171 @@
+// Host implementation of the subset of the Arduino-ESP32 core used by the firmware
+#ifndef _SIM_ARDUINO_H
+#define _SIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <cmath>
+#include <algorithm>
+
+#include "WString.h"
+#include "esp_sleep.h"
+#include "freertos/FreeRTOS.h"
+
+using std::min;
+using std::max;
+using std::abs;
+
+#define RTC_DATA_ATTR   __attribute__((section("rtc_data")))
+#define RTC_NOINIT_ATTR __attribute__((section("rtc_data")))
+#define IRAM_ATTR
+#define PROGMEM
+#define F(s) (s)
+#define BIT(n) (1UL << (n))
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT          0x01
+#define OUTPUT         0x03
+#define INPUT_PULLUP   0x05
+#define INPUT_PULLDOWN 0x09
+
+#define RISING  0x01
+#define FALLING 0x02
+#define CHANGE  0x03
+
+#define DEC 10
+#define HEX 16
+
+#define ESP_OK   0
+#define ESP_FAIL -1
+typedef int esp_err_t;
+#define ESP_ERROR_CHECK(x) do { (void)(x); } while (0)
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// ============= Timing =============
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+// ============= GPIO =============
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+uint16_t analogRead(uint8_t pin);
+uint32_t analogReadMilliVolts(uint8_t pin);
+bool perimanClearPinBus(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t pin);
+bool usb_serial_jtag_is_connected();
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+long random(long max);
+long random(long min, long max);
+
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+
+bool isHexadecimalDigit(char c);
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+extern "C" size_t strlcpy(char* dst, const char* src, size_t size);
+#endif
+
+// ============= Print & Stream =============
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buf++);
+    return n;
+  }
+  size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t write(const char* buf, size_t size) { return write((const uint8_t*)buf, size); }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+  size_t print(const String& s) { return write(s.c_str()); }
+  size_t print(const char* s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int base = DEC) { return print(String((long)v, base)); }
+  size_t print(unsigned int v, int base = DEC) { return print(String((unsigned long)v, base)); }
+  size_t print(long v, int base = DEC) { return print(String(v, base)); }
+  size_t print(unsigned long v, int base = DEC) { return print(String(v, base)); }
+  size_t print(double v, int digits = 2) { return print(String(v, digits)); }
+  size_t println() { return write("\r\n"); }
+  template<typename T> size_t println(const T& v) { size_t n = print(v); return n + println(); }
+  template<typename T> size_t println(const T& v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+  virtual void flush() {}
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  void setTimeout(unsigned long timeout) { (void)timeout; }
+  String readString();
+  String readStringUntil(char terminator);
+  size_t readBytes(uint8_t* buf, size_t len);
+};
+
+// Host console, optionally printed to stdout
+class HWCDC : public Stream {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  void end() {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void setDebugOutput(bool) {}
+  operator bool() const { return true; }
+  using Print::write;
+};
+
+#define SERIAL_8N1 0x800001c
+
+// GNSS UART: produces a line of NMEA-like characters once per second when powered
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1);
+  void end();
+  size_t write(uint8_t c) override { (void)c; return 1; }
+  int available() override;
+  int read() override;
+  int peek() override;
+  using Print::write;
+};
+
+extern HWCDC Serial;
+extern HardwareSerial Serial1;
+
+// ============= ESP =============
+class EspClass {
+public:
+  void restart();
+  uint64_t getEfuseMac() { return 0x0000AABBCCDDEEFFULL; }
+  uint32_t getFreeHeap() { return 200000; }
+  uint32_t getHeapSize() { return 320000; }
+  uint32_t getMaxAllocHeap() { return 110000; }
+  uint32_t getMinFreeHeap() { return 180000; }
+};
+extern EspClass ESP;
+
+#endif
@@ -0,0 +1,9 @@
+// Host stand-in for the BLE stack: the configurator is not part of the simulation build
+#ifndef _SIM_BLEDEVICE_H
+#define _SIM_BLEDEVICE_H
+
+class BLEServer;
+class BLEService;
+class BLECharacteristic;
+
+#endif
@@ -0,0 +1,9 @@
+// Host stand-in for the async web server: the file browser is not part of the simulation build
+#ifndef _SIM_ESPASYNCWEBSERVER_H
+#define _SIM_ESPASYNCWEBSERVER_H
+
+#include "Arduino.h"
+
+class AsyncWebServerRequest;
+
+#endif
@@ -0,0 +1,4 @@
+// Intentionally empty: the simulation build does not include the networking code
+#ifndef _SIM_ESPMDNS_H
+#define _SIM_ESPMDNS_H
+#endif
@@ -0,0 +1,4 @@
+// Intentionally empty: the simulation build does not include the networking code
+#ifndef _SIM_ELEGANTOTA_H
+#define _SIM_ELEGANTOTA_H
+#endif
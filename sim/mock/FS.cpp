@@ -0,0 +1,301 @@
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include "FS.h"
+#include "LittleFS.h"
+#include "SD.h"
+#include "sim.h"
+
+LittleFSFS LittleFS;
+SDFS SD;
+
+namespace fs {
+
+struct FileImpl {
+  std::string host;     // path on the host
+  std::string path;     // path within the file system
+  FILE* file = nullptr;
+  DIR* dir = nullptr;
+  bool countWrites = false;
+  bool written = false;
+  uint32_t busHz = 0;
+  size_t block = SIZE_MAX;  // last block transferred
+
+  // an SD card in SPI mode moves 8 bits per clock, plus a command and busy wait per block;
+  // like the VFS, consecutive accesses within a block are buffered
+  void transfer(size_t pos, size_t bytes) {
+    if(!busHz || !bytes) {
+      return;
+    }
+    size_t first = pos / 512, last = (pos + bytes - 1) / 512;
+    size_t blocks = last - first + (first != block);
+    block = last;
+    delayMicroseconds(bytes * 8000000ULL / busHz + blocks * 100);
+  }
+
+  // like LittleFS, written data is committed to flash when the file is closed
+  ~FileImpl() {
+    if(written && countWrites) simStats.flashWrites++;
+    if(file) fclose(file);
+    if(dir) closedir(dir);
+  }
+};
+
+String FS::hostPath(const char* path) {
+  String host = simPath(root);
+  if(path[0] != '/') {
+    host += "/";
+  }
+  host += path;
+  return(host);
+}
+
+File FS::open(const char* path, const char* mode, bool create) {
+  (void)create;
+  std::string host = hostPath(path).c_str();
+  auto impl = std::make_shared<FileImpl>();
+  impl->host = host;
+  impl->path = path[0] == '/' ? path : std::string("/") + path;
+  impl->countWrites = countWrites;
+  impl->busHz = busHz;
+
+  struct stat st;
+  if(stat(host.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+    impl->dir = opendir(host.c_str());
+    return(impl->dir ? File(impl) : File());
+  }
+
+  const char* hostMode = !strcmp(mode, "w") ? "w+b" : !strcmp(mode, "a") ? "a+b" : "rb";
+  impl->file = fopen(host.c_str(), hostMode);
+  return(impl->file ? File(impl) : File());
+}
+
+bool FS::exists(const char* path) {
+  struct stat st;
+  return(stat(hostPath(path).c_str(), &st) == 0);
+}
+
+bool FS::remove(const char* path) {
+  return(unlink(hostPath(path).c_str()) == 0);
+}
+
+bool FS::rename(const char* from, const char* to) {
+  return(::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0);
+}
+
+bool FS::mkdir(const char* path) {
+  return(::mkdir(hostPath(path).c_str(), 0755) == 0);
+}
+
+bool FS::rmdir(const char* path) {
+  return(::rmdir(hostPath(path).c_str()) == 0);
+}
+
+size_t File::write(const uint8_t* buf, size_t size) {
+  if(!impl || !impl->file) {
+    return(0);
+  }
+  size_t pos = ftell(impl->file);
+  size_t n = fwrite(buf, 1, size, impl->file);
+  impl->written = true;
+  impl->transfer(pos, n);
+  if(impl->countWrites) {
+    simStats.flashBytes += n;
+  }
+  return(n);
+}
+
+int File::available() {
+  if(!impl || !impl->file) {
+    return(0);
+  }
+  return(size() - position());
+}
+
+int File::read() {
+  uint8_t c;
+  return(read(&c, 1) == 1 ? c : -1);
+}
+
+int File::peek() {
+  if(!impl || !impl->file) {
+    return(-1);
+  }
+  int c = fgetc(impl->file);
+  if(c != EOF) {
+    ungetc(c, impl->file);
+  }
+  return(c == EOF ? -1 : c);
+}
+
+size_t File::read(uint8_t* buf, size_t size) {
+  if(!impl || !impl->file) {
+    return(0);
+  }
+  size_t pos = ftell(impl->file);
+  size_t n = fread(buf, 1, size, impl->file);
+  impl->transfer(pos, n);
+  return(n);
+}
+
+void File::flush() {
+  if(impl && impl->file) {
+    fflush(impl->file);
+  }
+}
+
+bool File::seek(uint32_t pos) {
+  return(impl && impl->file && fseek(impl->file, pos, SEEK_SET) == 0);
+}
+
+size_t File::position() const {
+  return(impl && impl->file ? ftell(impl->file) : 0);
+}
+
+size_t File::size() const {
+  struct stat st;
+  if(!impl || stat(impl->host.c_str(), &st) != 0) {
+    return(0);
+  }
+  if(impl->file) {
+    fflush(impl->file);
+    fstat(fileno(impl->file), &st);
+  }
+  return(S_ISDIR(st.st_mode) ? 0 : st.st_size);
+}
+
+void File::close() {
+  impl.reset();
+}
+
+File::operator bool() const {
+  return(impl != nullptr);
+}
+
+time_t File::getLastWrite() {
+  struct stat st;
+  if(!impl || stat(impl->host.c_str(), &st) != 0) {
+    return(0);
+  }
+  return(st.st_mtime);
+}
+
+const char* File::path() const {
+  return(impl ? impl->path.c_str() : nullptr);
+}
+
+const char* File::name() const {
+  if(!impl) {
+    return(nullptr);
+  }
+  const char* slash = strrchr(impl->path.c_str(), '/');
+  return(slash ? slash + 1 : impl->path.c_str());
+}
+
+bool File::isDirectory() {
+  return(impl && impl->dir);
+}
+
+File File::openNextFile(const char* mode) {
+  (void)mode;
+  if(!impl || !impl->dir) {
+    return(File());
+  }
+  struct dirent* entry;
+  while((entry = readdir(impl->dir)) != nullptr) {
+    if(strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) {
+      break;
+    }
+  }
+  if(!entry) {
+    return(File());
+  }
+
+  std::string path = impl->path == "/" ? "/" : impl->path + "/";
+  path += entry->d_name;
+  auto next = std::make_shared<FileImpl>();
+  next->host = impl->host + "/" + entry->d_name;
+  next->path = path;
+  next->countWrites = impl->countWrites;
+  next->busHz = impl->busHz;
+  struct stat st;
+  if(stat(next->host.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+    next->dir = opendir(next->host.c_str());
+  } else {
+    next->file = fopen(next->host.c_str(), "rb");
+  }
+  return(File(next));
+}
+
+void File::rewindDirectory() {
+  if(impl && impl->dir) {
+    rewinddir(impl->dir);
+  }
+}
+
+}
+
+bool LittleFSFS::begin(bool formatOnFail, const char* basePath, uint8_t maxOpenFiles, const char* partitionLabel) {
+  (void)formatOnFail, (void)basePath, (void)maxOpenFiles, (void)partitionLabel;
+  ::mkdir(simPath(root), 0755);
+  return(true);
+}
+
+bool LittleFSFS::format() {
+  String cmd = String("rm -rf '") + simPath(root) + "' && mkdir -p '" + simPath(root) + "'";
+  return(system(cmd.c_str()) == 0);
+}
+
+// files are truncated through the VFS, at the mount point of LittleFS
+extern "C" {
+int __real_truncate(const char* path, off_t len);
+
+int __wrap_truncate(const char* path, off_t len) {
+  if(strncmp(path, "/littlefs/", 10) != 0) {
+    return(__real_truncate(path, len));
+  }
+  simStats.flashWrites++;
+  return(__real_truncate(LittleFS.hostPath(path + 9).c_str(), len));
+}
+}
+
+static size_t usedBlocks(const std::string &dir) {
+  size_t blocks = 1;
+  DIR* d = opendir(dir.c_str());
+  if(!d) {
+    return(0);
+  }
+  struct dirent* entry;
+  while((entry = readdir(d)) != nullptr) {
+    if(!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+      continue;
+    }
+    std::string path = dir + "/" + entry->d_name;
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0) {
+      continue;
+    }
+    if(S_ISDIR(st.st_mode)) {
+      blocks += usedBlocks(path);
+    } else {
+      blocks += 1 + (st.st_size + 4095) / 4096;   // metadata pair plus data blocks
+    }
+  }
+  closedir(d);
+  return(blocks);
+}
+
+size_t LittleFSFS::usedBytes() {
+  return(usedBlocks(simPath(root)) * 4096);
+}
+
+bool SDFS::begin(uint8_t ssPin, SPIClass& spi, uint32_t frequency, const char* mountpoint, uint8_t maxFiles, bool formatIfEmpty) {
+  (void)ssPin, (void)spi, (void)mountpoint, (void)maxFiles, (void)formatIfEmpty;
+  if(!scenario.sdCard) {
+    return(false);
+  }
+  busHz = frequency;
+  ::mkdir(simPath(root), 0755);
+  return(true);
+}
@@ -0,0 +1,75 @@
+// Host implementation of the Arduino-ESP32 file system API, backed by a directory per file system
+#ifndef _SIM_FS_H
+#define _SIM_FS_H
+
+#include <memory>
+#include "Arduino.h"
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+struct FileImpl;
+
+class File : public Stream {
+public:
+  File() {}
+  File(std::shared_ptr<FileImpl> impl) : impl(impl) {}
+
+  size_t write(uint8_t c) override { return(write(&c, 1)); }
+  size_t write(const uint8_t* buf, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t* buf, size_t size);
+  void flush() override;
+  bool seek(uint32_t pos);
+  size_t position() const;
+  size_t size() const;
+  void close();
+  operator bool() const;
+  time_t getLastWrite();
+  const char* path() const;
+  const char* name() const;
+  bool isDirectory();
+  File openNextFile(const char* mode = FILE_READ);
+  void rewindDirectory();
+
+private:
+  std::shared_ptr<FileImpl> impl;
+};
+
+class FS {
+public:
+  FS(const char* root, bool countWrites) : root(root), countWrites(countWrites) {}
+
+  File open(const char* path, const char* mode = FILE_READ, bool create = false);
+  File open(const String& path, const char* mode = FILE_READ, bool create = false) { return(open(path.c_str(), mode, create)); }
+  bool exists(const char* path);
+  bool exists(const String& path) { return(exists(path.c_str())); }
+  bool remove(const char* path);
+  bool remove(const String& path) { return(remove(path.c_str())); }
+  bool rename(const char* from, const char* to);
+  bool rename(const String& from, const String& to) { return(rename(from.c_str(), to.c_str())); }
+  bool mkdir(const char* path);
+  bool mkdir(const String& path) { return(mkdir(path.c_str())); }
+  bool rmdir(const char* path);
+  bool rmdir(const String& path) { return(rmdir(path.c_str())); }
+
+  String hostPath(const char* path);
+
+protected:
+  const char* root;
+  bool countWrites;
+  uint32_t busHz = 0;   // transfers take time on a card behind an SPI bus
+};
+
+}
+
+using fs::FS;
+using fs::File;
+
+#endif
@@ -0,0 +1,38 @@
+// Host stand-in for the GxEPD2 e-paper driver; a refresh takes the time of a partial update
+#ifndef _SIM_GXEPD2_BW_H
+#define _SIM_GXEPD2_BW_H
+
+#include "Adafruit_GFX.h"
+#include "SPI.h"
+
+#define GxEPD_BLACK 0x0000
+#define GxEPD_WHITE 0xFFFF
+
+class GxEPD2_213_GDEY0213B74 {
+public:
+  static const uint16_t WIDTH = 128;
+  static const uint16_t HEIGHT = 250;
+
+  GxEPD2_213_GDEY0213B74(int16_t cs, int16_t dc, int16_t rst, int16_t busy) { (void)cs, (void)dc, (void)rst, (void)busy; }
+  void selectSPI(SPIClass& spi, SPISettings settings) { (void)spi, (void)settings; }
+};
+
+template<typename GxEPD2_Type, const uint16_t page_height>
+class GxEPD2_BW : public Adafruit_GFX {
+public:
+  GxEPD2_BW(GxEPD2_Type epd2_instance) : Adafruit_GFX(GxEPD2_Type::WIDTH, GxEPD2_Type::HEIGHT), epd2(epd2_instance) {}
+
+  void init(uint32_t serial_diag_bitrate, bool initial, uint16_t reset_duration = 10, bool pulldown_rst_mode = false) {
+    (void)serial_diag_bitrate, (void)initial, (void)reset_duration, (void)pulldown_rst_mode;
+  }
+  void setFullWindow() {}
+  void setPartialWindow(uint16_t x, uint16_t y, uint16_t w, uint16_t h) { (void)x, (void)y, (void)w, (void)h; }
+  void firstPage() {}
+  bool nextPage() { delay(300); return(false); }
+  void hibernate() {}
+  void powerOff() {}
+
+  GxEPD2_Type epd2;
+};
+
+#endif
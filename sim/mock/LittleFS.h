@@ -0,0 +1,19 @@
+// Host implementation of LittleFS on the 0x3A0000 byte data partition
+#ifndef _SIM_LITTLEFS_H
+#define _SIM_LITTLEFS_H
+
+#include "FS.h"
+
+class LittleFSFS : public fs::FS {
+public:
+  LittleFSFS() : FS("littlefs", true) {}
+  bool begin(bool formatOnFail = false, const char* basePath = "/littlefs", uint8_t maxOpenFiles = 10, const char* partitionLabel = "spiffs");
+  void end() {}
+  bool format();
+  size_t totalBytes() { return(0x3A0000); }
+  size_t usedBytes();
+};
+
+extern LittleFSFS LittleFS;
+
+#endif
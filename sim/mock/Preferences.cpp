@@ -0,0 +1,99 @@
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Preferences.h"
+#include "sim.h"
+
+bool Preferences::begin(const char* name, bool readOnly, const char* partition) {
+  (void)partition;
+  ns = String(name);
+  this->readOnly = readOnly;
+  opened = true;
+  String dir = String(simPath("nvs/")) + ns;
+  mkdir(simPath("nvs"), 0755);
+  mkdir(dir.c_str(), 0755);
+  return(true);
+}
+
+void Preferences::end() {
+  opened = false;
+}
+
+String Preferences::path(const char* key) {
+  return(String(simPath("nvs/")) + ns + "/" + key);
+}
+
+bool Preferences::clear() {
+  if(!opened || readOnly) {
+    return(false);
+  }
+  String cmd = String("rm -f ") + simPath("nvs/") + ns + "/*";
+  return(system(cmd.c_str()) == 0);
+}
+
+bool Preferences::remove(const char* key) {
+  if(!opened || readOnly) {
+    return(false);
+  }
+  return(unlink(path(key).c_str()) == 0);
+}
+
+bool Preferences::isKey(const char* key) {
+  struct stat st;
+  return(opened && stat(path(key).c_str(), &st) == 0);
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+  if(!opened || readOnly) {
+    return(0);
+  }
+  FILE* f = fopen(path(key).c_str(), "wb");
+  if(!f) {
+    return(0);
+  }
+  size_t n = fwrite(value, 1, len, f);
+  fclose(f);
+  simStats.nvsWrites++;
+  return(n);
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  struct stat st;
+  if(!opened || stat(path(key).c_str(), &st) != 0) {
+    return(0);
+  }
+  return(st.st_size);
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  size_t len = getBytesLength(key);
+  if(len == 0 || len > maxLen) {
+    return(0);
+  }
+  FILE* f = fopen(path(key).c_str(), "rb");
+  if(!f) {
+    return(0);
+  }
+  size_t n = fread(buf, 1, len, f);
+  fclose(f);
+  return(n);
+}
+
+size_t Preferences::putString(const char* key, const char* value) {
+  return(putBytes(key, value, strlen(value) + 1));
+}
+
+size_t Preferences::getString(const char* key, char* value, size_t maxLen) {
+  return(getBytes(key, value, maxLen));
+}
+
+String Preferences::getString(const char* key, String defaultValue) {
+  size_t len = getBytesLength(key);
+  if(len == 0) {
+    return(defaultValue);
+  }
+  char* buf = (char*)calloc(1, len + 1);
+  getBytes(key, buf, len);
+  String ret(buf);
+  free(buf);
+  return(ret);
+}
@@ -0,0 +1,39 @@
+// Host implementation of the ESP32 Preferences (NVS) API, stored as files in the simulation directory
+#ifndef _SIM_PREFERENCES_H
+#define _SIM_PREFERENCES_H
+
+#include "Arduino.h"
+
+class Preferences {
+public:
+  bool begin(const char* name, bool readOnly = false, const char* partition = NULL);
+  void end();
+
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+
+  size_t putBytes(const char* key, const void* value, size_t len);
+  size_t getBytesLength(const char* key);
+  size_t getBytes(const char* key, void* buf, size_t maxLen);
+
+  size_t putString(const char* key, const char* value);
+  size_t putString(const char* key, const String& value) { return putString(key, value.c_str()); }
+  size_t getString(const char* key, char* value, size_t maxLen);
+  String getString(const char* key, String defaultValue = String());
+
+  size_t putUInt(const char* key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0) {
+    uint32_t value = defaultValue;
+    getBytes(key, &value, sizeof(value));
+    return value;
+  }
+
+private:
+  String path(const char* key);
+  String ns;
+  bool opened = false;
+  bool readOnly = false;
+};
+
+#endif
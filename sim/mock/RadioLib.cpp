@@ -0,0 +1,250 @@
+#include <math.h>
+#include "RadioLib.h"
+#include "sim.h"
+#include "payload.h"
+
+#define SIM_NONCES_MAGIC    0x4E4F4E43
+#define SIM_SESSION_MAGIC   0x53455353
+
+const LoRaWANBand_t EU868 = { "EU868", { 51, 51, 51, 115, 222, 222, 222, 222 } };
+
+#define SIM_READING_LAG     120   // seconds that a measurement may be taken before its time
+
+// whether the SCD41 gave temp (as decoded, to within one step) shortly before utc
+static bool simReadingAt(time_t utc, float temp) {
+  for(uint32_t i = 0; i < min(sim->numReadings, (uint32_t)SIM_MAX_READINGS); i++) {
+    const SimReading &r = sim->readings[i];
+    if(fabsf(r.temp - temp) <= 0.011f && r.utc <= utc + 1 && r.utc + SIM_READING_LAG >= utc) {
+      return(true);
+    }
+  }
+  return(false);
+}
+
+// LoRa time-on-air for a PHY payload of len bytes, explicit header, CR 4/5, CRC on
+RadioLibTime_t LoRaWANNode::timeOnAir(size_t len, uint8_t dr) {
+  int sf = dr >= 6 ? 7 : 12 - dr;
+  double bw = dr == 6 ? 250e3 : 125e3;
+  int de = (sf >= 11 && bw == 125e3) ? 1 : 0;
+  double tSym = (double)(1 << sf) / bw;
+  double tPreamble = (8 + 4.25) * tSym;
+  double num = 8.0 * len - 4.0 * sf + 28 + 16;
+  double nPayload = 8 + max(ceil(num / (4.0 * (sf - 2 * de))) * 5, 0.0);
+  return((RadioLibTime_t)((tPreamble + nPayload * tSym) * 1000.0 + 0.5));
+}
+
+int16_t LoRaWANNode::beginOTAA(uint64_t joinEUI, uint64_t devEUI, const uint8_t* nwkKey, const uint8_t* appKey) {
+  (void)nwkKey, (void)appKey;
+  if(nonces.joinEUI != joinEUI || nonces.devEUI != devEUI) {
+    nonces = {};
+  }
+  nonces.joinEUI = joinEUI;
+  nonces.devEUI = devEUI;
+  isOTAA = true;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANNode::beginABP(uint32_t addr, const uint8_t* fNwkSIntKey, const uint8_t* sNwkSIntKey,
+                              const uint8_t* nwkSEncKey, const uint8_t* appSKey) {
+  (void)fNwkSIntKey, (void)sNwkSIntKey, (void)nwkSEncKey, (void)appSKey;
+  session.devAddr = addr;
+  isOTAA = false;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANNode::setBufferNonces(const uint8_t* buffer) {
+  Nonces stored;
+  memcpy(&stored, buffer, sizeof(Nonces));
+  if(stored.magic != SIM_NONCES_MAGIC || stored.joinEUI != nonces.joinEUI || stored.devEUI != nonces.devEUI) {
+    return(RADIOLIB_ERR_NONCES_DISCARDED);
+  }
+  nonces = stored;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANNode::setBufferSession(const uint8_t* buffer) {
+  Session stored;
+  memcpy(&stored, buffer, sizeof(Session));
+  if(nonces.magic != SIM_NONCES_MAGIC || stored.magic != SIM_SESSION_MAGIC || !stored.joined) {
+    return(RADIOLIB_ERR_SESSION_DISCARDED);
+  }
+  session = stored;
+  dr = session.dr;
+  restored = true;
+  return(RADIOLIB_ERR_NONE);
+}
+
+void LoRaWANNode::clearSession() {
+  memset(&session, 0, sizeof(Session));
+  active = false;
+  restored = false;
+}
+
+int16_t LoRaWANNode::setDatarate(uint8_t drUp) {
+  if(drUp > 6) {
+    return(RADIOLIB_ERR_UNKNOWN);
+  }
+  dr = drUp;
+  session.dr = drUp;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANNode::activate(uint8_t initialDr) {
+  if(initialDr != RADIOLIB_LORAWAN_DATA_RATE_UNUSED) {
+    setDatarate(initialDr);
+  }
+
+  if(restored) {
+    active = true;
+    return(RADIOLIB_LORAWAN_SESSION_RESTORED);
+  }
+
+  if(isOTAA) {
+    // JoinRequest, then listen in RX1 (5 s) and RX2 (6 s)
+    nonces.magic = SIM_NONCES_MAGIC;
+    nonces.devNonce++;
+    lastToA = timeOnAir(23, dr);
+    simStats.airtimeUs += lastToA * 1000ULL;
+    radio->command();
+    delay(lastToA);
+    if(++simStats.joinRequests <= scenario.joinFailures) {
+      delay(5000);
+      radio->command();
+      delay(1000);
+      radio->command();
+      delay(timeOnAir(0, 0));
+      return(RADIOLIB_ERR_NO_JOIN_ACCEPT);
+    }
+    delay(5000);
+    radio->command();
+    delay(timeOnAir(33, dr));
+    simStats.joinAccepts++;
+    session.devAddr = 0x26000000 | (uint32_t)(nonces.devEUI & 0xFFFFFF);
+  }
+
+  session.magic = SIM_SESSION_MAGIC;
+  session.joined = true;
+  session.fCntUp = 0;
+  session.dr = dr;
+  active = true;
+  return(RADIOLIB_LORAWAN_NEW_SESSION);
+}
+
+int16_t LoRaWANNode::activateOTAA(uint8_t initialDr, LoRaWANEvent_t* joinEvent) {
+  (void)joinEvent;
+  if(!isOTAA) {
+    return(RADIOLIB_ERR_UNKNOWN);
+  }
+  return(activate(initialDr));
+}
+
+int16_t LoRaWANNode::activateABP(uint8_t initialDr) {
+  if(isOTAA) {
+    return(RADIOLIB_ERR_UNKNOWN);
+  }
+  return(activate(initialDr));
+}
+
+int16_t LoRaWANNode::sendReceive(const uint8_t* dataUp, size_t lenUp, uint8_t fPort, uint8_t* dataDown, size_t* lenDown,
+                                 bool isConfirmed, LoRaWANEvent_t* eventUp, LoRaWANEvent_t* eventDown) {
+  (void)dataDown;
+  if(!active) {
+    return(RADIOLIB_ERR_NETWORK_NOT_JOINED);
+  }
+  if(lenUp > band->maxPayload[dr]) {
+    return(RADIOLIB_ERR_UNKNOWN);
+  }
+
+  // a measurement uplink must decode to values that encode to the same bytes again,
+  // and a batch to measurements that batch to the same bytes again, each an SCD41
+  // reading of shortly before the time that it decodes to
+  if(fPort < 32) {
+    uint8_t frames[PAYLOAD_BATCH_MAX][PAYLOAD_MAX_SIZE];
+    uint32_t ages[PAYLOAD_BATCH_MAX] = { 0 }, times[PAYLOAD_BATCH_MAX];
+    uint8_t again[256];
+    uint8_t port = fPort & ~PAYLOAD_BATCH;
+    uint8_t count = 1, used;
+    PayloadValues v = {};
+    v.flags = port;
+    size_t size = payloadEncode(v, again);
+    bool ok;
+    if(fPort & PAYLOAD_BATCH) {
+      count = payloadUnbatch(fPort, dataUp, lenUp, frames, ages);
+      for(uint8_t i = 0; i < count; i++) {
+        times[i] = ages[0] - ages[i];
+      }
+      ok = count > 0 && payloadBatch(port, frames, times, count, ages[0], again, lenUp, used) == lenUp &&
+           used == count && !memcmp(again, dataUp, lenUp);
+    } else {
+      ok = lenUp == size;
+      memcpy(frames[0], dataUp, min(lenUp, (size_t)PAYLOAD_MAX_SIZE));
+    }
+    for(uint8_t i = 0; i < count && ok; i++) {
+      ok = payloadDecode(port, frames[i], size, v) && payloadEncode(v, again) == size && !memcmp(again, frames[i], size);
+      if(ok && (fPort & PAYLOAD_BATCH) && !simReadingAt(simUtc() - ages[i], v.temp)) {
+        fprintf(stderr, "%s: measurement %u of uplink %u decodes to the wrong time\n", scenario.name, i, (unsigned)session.fCntUp);
+        simStats.timeErrors++;
+      }
+    }
+    if(!ok) {
+      fprintf(stderr, "%s: uplink %u on fPort %u does not decode\n", scenario.name, (unsigned)session.fCntUp, fPort);
+      simStats.payloadErrors++;
+    }
+    simStats.records += ok ? count : 0;
+  }
+
+  // uplink: MHDR + FHDR + FPort + payload + MIC
+  lastToA = timeOnAir(13 + lenUp, dr);
+  simStats.uplinks++;
+  simStats.airtimeUs += lastToA * 1000ULL;
+  radio->command();
+  delay(lastToA);
+
+  if(eventUp) {
+    *eventUp = {};
+    eventUp->confirmed = isConfirmed;
+    eventUp->datarate = dr;
+    eventUp->fCnt = session.fCntUp;
+    eventUp->fPort = fPort;
+  }
+  if(lenDown) {
+    *lenDown = 0;
+  }
+
+  // a confirmed uplink is acknowledged in RX1 unless it is lost
+  bool acked = isConfirmed && (session.fCntUp * 37) % 100 >= scenario.uplinkLossPct;
+  session.fCntUp++;
+
+  // with ADR enabled, the network moves a static device to the fastest datarate
+  if(session.adr) {
+    dr = 5;
+    session.dr = dr;
+  }
+
+  if(acked) {
+    delay(1000);
+    radio->command();
+    delay(timeOnAir(13, dr));
+    if(eventDown) {
+      *eventDown = {};
+      eventDown->confirming = true;
+      eventDown->datarate = dr;
+    }
+    return(1);
+  }
+
+  // no downlink: RX1 after 1 s, RX2 after 2 s, each closed after a preamble timeout
+  delay(1000);
+  radio->command();
+  delay(1000 + timeOnAir(0, dr) / 10);
+  radio->command();
+  delay(timeOnAir(0, dr) / 10);
+  return(0);
+}
+
+int16_t LoRaWANNode::sendReceive(const uint8_t* dataUp, size_t lenUp, uint8_t fPort, bool isConfirmed,
+                                 LoRaWANEvent_t* eventUp, LoRaWANEvent_t* eventDown) {
+  size_t lenDown = 0;
+  uint8_t dataDown[256];
+  return(sendReceive(dataUp, lenUp, fPort, dataDown, &lenDown, isConfirmed, eventUp, eventDown));
+}
@@ -0,0 +1,164 @@
+// Host stand-in for the RadioLib SX1262 driver and LoRaWAN node.
+// Uplinks and joins take their real time-on-air plus the receive windows, and
+// the session is kept in the same persistent buffers as the real library.
+#ifndef _SIM_RADIOLIB_H
+#define _SIM_RADIOLIB_H
+
+#include "Arduino.h"
+#include "SPI.h"
+
+#define RADIOLIB_ERR_NONE                     (0)
+#define RADIOLIB_ERR_UNKNOWN                  (-1)
+#define RADIOLIB_ERR_NETWORK_NOT_JOINED       (-1101)
+#define RADIOLIB_ERR_NO_JOIN_ACCEPT           (-1116)
+#define RADIOLIB_LORAWAN_SESSION_RESTORED     (-1117)
+#define RADIOLIB_LORAWAN_NEW_SESSION          (-1118)
+#define RADIOLIB_ERR_NONCES_DISCARDED         (-1119)
+#define RADIOLIB_ERR_SESSION_DISCARDED        (-1120)
+
+#define RADIOLIB_LORAWAN_NONCES_BUF_SIZE      (32)
+#define RADIOLIB_LORAWAN_SESSION_BUF_SIZE     (256)
+#define RADIOLIB_LORAWAN_NODER_BUF_SIZE       (64)
+#define RADIOLIB_LORAWAN_DATA_RATE_UNUSED     (0xFF)
+
+#define RADIOLIB_DEFAULT_SPI_SETTINGS         SPISettings(2000000, MSBFIRST, SPI_MODE0)
+
+#define RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(...)  do { } while(0)
+
+typedef unsigned long RadioLibTime_t;
+
+struct LoRaWANBand_t {
+  const char* name;
+  uint8_t maxPayload[8];    // maximum application payload per datarate
+};
+
+extern const LoRaWANBand_t EU868;
+
+struct LoRaWANEvent_t {
+  uint8_t dir;
+  bool confirmed;
+  bool confirming;
+  uint8_t datarate;
+  float freq;
+  int16_t power;
+  uint32_t fCnt;
+  uint8_t fPort;
+  uint8_t multicast;
+};
+
+class RadioLibHal {
+public:
+  virtual ~RadioLibHal() {}
+  virtual void spiBeginTransaction() {}
+  virtual void spiEndTransaction() {}
+};
+
+class ArduinoHal : public RadioLibHal {
+public:
+  ArduinoHal(SPIClass& spi, SPISettings spiSettings = RADIOLIB_DEFAULT_SPI_SETTINGS) : spi(spi), settings(spiSettings) {}
+  void spiBeginTransaction() override { spi.beginTransaction(settings); }
+  void spiEndTransaction() override { spi.endTransaction(); }
+
+private:
+  SPIClass& spi;
+  SPISettings settings;
+};
+
+// each radio command is one SPI transaction
+class Module {
+public:
+  Module(RadioLibHal* hal, uint32_t cs, uint32_t irq, uint32_t rst, uint32_t gpio = 0) : hal(hal) {
+    (void)cs, (void)irq, (void)rst, (void)gpio;
+  }
+  void command() {
+    hal->spiBeginTransaction();
+    hal->spiEndTransaction();
+  }
+
+private:
+  RadioLibHal* hal;
+};
+
+class SX1262 {
+public:
+  SX1262(Module* mod) : mod(mod) {}
+  int16_t begin() { mod->command(); delay(10); return(RADIOLIB_ERR_NONE); }
+  int16_t standby() { mod->command(); return(RADIOLIB_ERR_NONE); }
+  int16_t sleep() { mod->command(); return(RADIOLIB_ERR_NONE); }
+  void command() { mod->command(); }
+  float getRSSI() { return(-97.0f); }
+  float getSNR() { return(6.5f); }
+
+private:
+  Module* mod;
+};
+
+class LoRaWANNode {
+public:
+  LoRaWANNode(SX1262* radio, const LoRaWANBand_t* band) : radio(radio), band(band) {}
+
+  int16_t beginOTAA(uint64_t joinEUI, uint64_t devEUI, const uint8_t* nwkKey, const uint8_t* appKey);
+  int16_t beginABP(uint32_t addr, const uint8_t* fNwkSIntKey, const uint8_t* sNwkSIntKey,
+                   const uint8_t* nwkSEncKey, const uint8_t* appSKey);
+  int16_t activateOTAA(uint8_t initialDr = RADIOLIB_LORAWAN_DATA_RATE_UNUSED, LoRaWANEvent_t* joinEvent = NULL);
+  int16_t activateABP(uint8_t initialDr = RADIOLIB_LORAWAN_DATA_RATE_UNUSED);
+  bool isActivated() { return(active); }
+  void clearSession();
+
+  uint8_t* getBufferNonces() { return((uint8_t*)&nonces); }
+  int16_t setBufferNonces(const uint8_t* buffer);
+  uint8_t* getBufferSession() { return((uint8_t*)&session); }
+  int16_t setBufferSession(const uint8_t* buffer);
+
+  int16_t sendReceive(const uint8_t* dataUp, size_t lenUp, uint8_t fPort, uint8_t* dataDown, size_t* lenDown,
+                      bool isConfirmed = false, LoRaWANEvent_t* eventUp = NULL, LoRaWANEvent_t* eventDown = NULL);
+  int16_t sendReceive(const uint8_t* dataUp, size_t lenUp, uint8_t fPort = 1, bool isConfirmed = false,
+                      LoRaWANEvent_t* eventUp = NULL, LoRaWANEvent_t* eventDown = NULL);
+
+  int16_t setDatarate(uint8_t drUp);
+  void setADR(bool enable = true) { session.adr = enable; }
+  void setDutyCycle(bool enable = true, uint32_t msPerHour = 0) { (void)enable, (void)msPerHour; }
+  RadioLibTime_t getLastToA() { return(lastToA); }
+  uint8_t getMaxPayloadLen() { return(band->maxPayload[dr]); }
+
+  uint32_t getDevAddr() { return(session.devAddr); }
+  uint32_t getFCntUp() { return(session.fCntUp); }
+  uint32_t getNFCntDown() { return(0); }
+  uint32_t getAFCntDown() { return(0); }
+
+private:
+  struct Nonces {
+    uint32_t magic;
+    uint16_t devNonce;
+    uint16_t pad;
+    uint64_t joinEUI;
+    uint64_t devEUI;
+    uint8_t reserved[8];
+  } nonces = {};
+  static_assert(sizeof(Nonces) == RADIOLIB_LORAWAN_NONCES_BUF_SIZE, "nonces buffer size mismatch");
+
+  struct Session {
+    uint32_t magic;
+    bool joined;
+    bool adr;
+    uint8_t dr;
+    uint8_t pad0;
+    uint32_t devAddr;
+    uint32_t fCntUp;
+    uint8_t pad[RADIOLIB_LORAWAN_SESSION_BUF_SIZE - 16];
+  } session = {};
+  static_assert(sizeof(Session) == RADIOLIB_LORAWAN_SESSION_BUF_SIZE, "session buffer size mismatch");
+
+  SX1262* radio;
+  const LoRaWANBand_t* band;
+  uint8_t dr = 5;
+  bool isOTAA = true;
+  bool active = false;
+  bool restored = false;
+  RadioLibTime_t lastToA = 0;
+
+  int16_t activate(uint8_t initialDr);
+  RadioLibTime_t timeOnAir(size_t len, uint8_t dr);
+};
+
+#endif
@@ -0,0 +1,21 @@
+// Host implementation of the SD card; present only when the scenario inserts one
+#ifndef _SIM_SD_H
+#define _SIM_SD_H
+
+#include "FS.h"
+#include "SPI.h"
+
+class SDFS : public fs::FS {
+public:
+  SDFS() : FS("sd", false) {}
+  bool begin(uint8_t ssPin = 5, SPIClass& spi = SPI, uint32_t frequency = 4000000, const char* mountpoint = "/sd",
+             uint8_t maxFiles = 5, bool formatIfEmpty = false);
+  void end() {}
+  uint64_t cardSize() { return(8ULL * 1024 * 1024 * 1024); }
+  uint64_t totalBytes() { return(cardSize()); }
+  uint64_t usedBytes() { return(0); }
+};
+
+extern SDFS SD;
+
+#endif
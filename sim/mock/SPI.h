@@ -0,0 +1,38 @@
+// Host stand-in for the Arduino SPI bus
+#ifndef _SIM_SPI_H
+#define _SIM_SPI_H
+
+#include "Arduino.h"
+
+#define FSPI 0
+#define HSPI 1
+#define MSBFIRST 1
+#define SPI_MODE0 0
+
+class SPISettings {
+public:
+  SPISettings(uint32_t clock = 1000000, uint8_t bitOrder = MSBFIRST, uint8_t dataMode = SPI_MODE0)
+    : clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+  uint32_t clock;
+  uint8_t bitOrder;
+  uint8_t dataMode;
+};
+
+class SPIClass {
+public:
+  SPIClass(uint8_t bus = FSPI) : bus(bus) {}
+  void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) { (void)sck, (void)miso, (void)mosi, (void)ss; }
+  void end() {}
+  void beginTransaction(SPISettings settings) { (void)settings; }
+  void endTransaction() {}
+  uint8_t transfer(uint8_t data) { return(data); }
+  void transferBytes(const uint8_t* out, uint8_t* in, uint32_t size) { if(in && out) memcpy(in, out, size); }
+  void writeBytes(const uint8_t* data, uint32_t size) { (void)data, (void)size; }
+
+private:
+  uint8_t bus;
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,17 @@
+// Host stand-in for the SEN5x particulate matter sensor
+#ifndef _SIM_SENSIRIONI2CSEN5X_H
+#define _SIM_SENSIRIONI2CSEN5X_H
+
+#include "Wire.h"
+
+class SensirionI2CSen5x {
+public:
+  void begin(TwoWire& wire) { (void)wire; }
+  uint16_t deviceReset() { delay(200); return(0); }
+  uint16_t startMeasurement() { delay(50); return(0); }
+  uint16_t stopMeasurement() { delay(200); return(0); }
+  uint16_t readMeasuredValues(float& pm1p0, float& pm2p5, float& pm4p0, float& pm10p0, float& humidity,
+                              float& temperature, float& vocIndex, float& noxIndex);
+};
+
+#endif
@@ -0,0 +1,39 @@
+// Host stand-in for the SCD4x CO2 sensor and the raw Sensirion I2C frame API used for single shots
+#ifndef _SIM_SENSIRIONI2CSCD4X_H
+#define _SIM_SENSIRIONI2CSCD4X_H
+
+#include "Wire.h"
+
+class SensirionI2CTxFrame {
+public:
+  static SensirionI2CTxFrame createWithUInt16Command(uint16_t command, uint8_t* buffer, size_t bufferSize) {
+    (void)buffer, (void)bufferSize;
+    SensirionI2CTxFrame frame;
+    frame.command = command;
+    return(frame);
+  }
+  uint16_t command = 0;
+};
+
+class SensirionI2CCommunication {
+public:
+  static int16_t sendFrame(uint8_t address, SensirionI2CTxFrame& frame, TwoWire& wire);
+};
+
+class SensirionI2cScd4x {
+public:
+  void begin(TwoWire& wire, uint8_t address) { (void)wire, (void)address; }
+  int16_t setAmbientPressure(uint32_t pressure) { (void)pressure; return(0); }
+  int16_t getDataReadyStatus(bool& ready);
+  int16_t readMeasurement(uint16_t& co2, float& temperature, float& humidity);
+  int16_t stopPeriodicMeasurement() { delay(500); return(0); }
+  int16_t performForcedRecalibration(uint16_t target, uint16_t& correction) { delay(400); correction = target; return(0); }
+  int16_t setAutomaticSelfCalibrationEnabled(uint16_t enabled) { (void)enabled; return(0); }
+  int16_t setAutomaticSelfCalibrationTarget(uint16_t target) { (void)target; return(0); }
+  int16_t setAutomaticSelfCalibrationStandardPeriod(uint16_t period) { (void)period; return(0); }
+  int16_t persistSettings() { delay(800); return(0); }
+  int16_t wakeUp() { delay(30); return(0); }
+  int16_t powerDown() { return(0); }
+};
+
+#endif
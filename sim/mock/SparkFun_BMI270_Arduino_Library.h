@@ -0,0 +1,55 @@
+// Host stand-in for the BMI270 accelerometer; motion is injected on ACC_INT by the scenario
+#ifndef _SIM_SPARKFUN_BMI270_H
+#define _SIM_SPARKFUN_BMI270_H
+
+#include "Wire.h"
+
+#define BMI2_ANY_MOTION           4
+#define BMI2_ANY_MOTION_INT       4
+#define BMI2_GYRO                 1
+#define BMI2_INT1                 1
+#define BMI2_ENABLE               1
+#define BMI2_INT_NON_LATCH        0
+#define BMI2_INT_ACTIVE_HIGH      1
+#define BMI2_INT_PUSH_PULL        0
+#define BMI2_INT_OUTPUT_ENABLE    1
+#define BMI2_INT_INPUT_DISABLE    0
+#define BMI2_POWER_OPT_MODE       0
+#define BMI2_ACC_ODR_12_5HZ       5
+
+struct bmi2_any_motion_config {
+  uint16_t duration, threshold;
+  uint8_t select_x, select_y, select_z;
+};
+
+struct bmi2_sens_config {
+  uint8_t type;
+  union {
+    bmi2_any_motion_config any_motion;
+  } cfg;
+};
+
+struct bmi2_int_pin_cfg {
+  uint8_t lvl, od, output_en, input_en;
+};
+
+struct bmi2_int_pin_config {
+  uint8_t pin_type;
+  uint8_t int_latch;
+  bmi2_int_pin_cfg pin_cfg[2];
+};
+
+class BMI270 {
+public:
+  int8_t beginI2C(uint8_t address = 0x68, TwoWire& wire = Wire) { (void)address, (void)wire; return(0); }
+  int8_t enableFeature(uint8_t feature) { (void)feature; return(0); }
+  int8_t disableFeature(uint8_t feature) { (void)feature; return(0); }
+  int8_t mapInterruptToPin(uint8_t interrupt, uint8_t pin) { (void)interrupt, (void)pin; return(0); }
+  int8_t setConfig(bmi2_sens_config config) { (void)config; return(0); }
+  int8_t setInterruptPinConfig(bmi2_int_pin_config config) { (void)config; return(0); }
+  int8_t setAccelPowerMode(uint8_t mode) { (void)mode; return(0); }
+  int8_t enableAdvancedPowerSave(bool enable = true) { (void)enable; return(0); }
+  int8_t setAccelODR(uint8_t odr) { (void)odr; return(0); }
+};
+
+#endif
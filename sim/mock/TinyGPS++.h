@@ -0,0 +1 @@
+#include "TinyGPSPlus.h"
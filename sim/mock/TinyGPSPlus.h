@@ -0,0 +1,81 @@
+// Host stand-in for TinyGPSPlus: instead of parsing NMEA, every encoded character samples
+// the simulated receiver. The object stays trivially copyable so it can be kept in RTC memory.
+#ifndef _SIM_TINYGPSPLUS_H
+#define _SIM_TINYGPSPLUS_H
+
+#include "Arduino.h"
+
+struct TinyGPSLocation {
+  bool isValid() const { return(valid); }
+  uint32_t age() const { return(valid ? millis() - updated : 0xFFFFFFFF); }
+  double lat() const { return(latitude); }
+  double lng() const { return(longitude); }
+
+  bool valid;
+  uint32_t updated;
+  double latitude;
+  double longitude;
+};
+
+struct TinyGPSDate {
+  bool isValid() const { return(valid); }
+  uint32_t value() const { return(d * 10000 + m * 100 + (y % 100)); }
+  uint16_t year() const { return(y); }
+  uint8_t month() const { return(m); }
+  uint8_t day() const { return(d); }
+
+  bool valid;
+  uint16_t y;
+  uint8_t m, d;
+};
+
+struct TinyGPSTime {
+  bool isValid() const { return(valid); }
+  uint32_t value() const { return(hh * 1000000 + mm * 10000 + ss * 100); }
+  uint8_t hour() const { return(hh); }
+  uint8_t minute() const { return(mm); }
+  uint8_t second() const { return(ss); }
+  uint8_t centisecond() const { return(0); }
+
+  bool valid;
+  uint8_t hh, mm, ss;
+};
+
+struct TinyGPSInteger {
+  bool isValid() const { return(valid); }
+  uint32_t value() const { return(val); }
+
+  bool valid;
+  uint32_t val;
+};
+
+struct TinyGPSHDOP {
+  bool isValid() const { return(valid); }
+  int32_t value() const { return(val); }
+  double hdop() const { return(val / 100.0); }
+
+  bool valid;
+  int32_t val;
+};
+
+struct TinyGPSAltitude {
+  bool isValid() const { return(valid); }
+  double meters() const { return(val); }
+
+  bool valid;
+  double val;
+};
+
+class TinyGPSPlus {
+public:
+  bool encode(char c);
+
+  TinyGPSLocation location = {};
+  TinyGPSDate date = {};
+  TinyGPSTime time = {};
+  TinyGPSInteger satellites = {};
+  TinyGPSHDOP hdop = {};
+  TinyGPSAltitude altitude = {};
+};
+
+#endif
@@ -0,0 +1,127 @@
+// Host implementation of the subset of the Arduino String class used by the firmware
+#ifndef _SIM_WSTRING_H
+#define _SIM_WSTRING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+class String {
+public:
+  String() {}
+  String(const char* s) : str(s ? s : "") {}
+  String(const std::string& s) : str(s) {}
+  String(char c) : str(1, c) {}
+  String(int v, unsigned char base = 10) { fromLong(v, base); }
+  String(unsigned int v, unsigned char base = 10) { fromULong(v, base); }
+  String(long v, unsigned char base = 10) { fromLong(v, base); }
+  String(unsigned long v, unsigned char base = 10) { fromULong(v, base); }
+  String(long long v) { str = std::to_string(v); }
+  String(unsigned long long v) { str = std::to_string(v); }
+  String(float v, unsigned int decimals = 2) { fromDouble(v, decimals); }
+  String(double v, unsigned int decimals = 2) { fromDouble(v, decimals); }
+
+  const char* c_str() const { return str.c_str(); }
+  unsigned int length() const { return str.length(); }
+  bool isEmpty() const { return str.empty(); }
+  void reserve(unsigned int size) { str.reserve(size); }
+  char* begin() { return &str[0]; }
+  char* end() { return &str[0] + str.length(); }
+  const char* begin() const { return str.c_str(); }
+  const char* end() const { return str.c_str() + str.length(); }
+
+  char charAt(unsigned int idx) const { return idx < str.length() ? str[idx] : 0; }
+  char operator[](unsigned int idx) const { return charAt(idx); }
+  char& operator[](unsigned int idx) { return str[idx]; }
+
+  String& operator+=(const String& rhs) { str += rhs.str; return *this; }
+  String& operator+=(const char* rhs) { str += rhs; return *this; }
+  String& operator+=(char rhs) { str += rhs; return *this; }
+  String& operator+=(int rhs) { str += String(rhs).str; return *this; }
+  String& operator+=(unsigned int rhs) { str += String(rhs).str; return *this; }
+  String& operator+=(long rhs) { str += String(rhs).str; return *this; }
+  String& operator+=(unsigned long rhs) { str += String(rhs).str; return *this; }
+  bool concat(const String& rhs) { str += rhs.str; return true; }
+  bool concat(const char* rhs) { str += rhs; return true; }
+  bool concat(char rhs) { str += rhs; return true; }
+
+  friend String operator+(const String& a, const String& b) { return String(a.str + b.str); }
+  friend String operator+(const String& a, const char* b) { return String(a.str + b); }
+  friend String operator+(const char* a, const String& b) { return String(a + b.str); }
+  friend String operator+(const String& a, char b) { return String(a.str + b); }
+
+  bool operator==(const String& rhs) const { return str == rhs.str; }
+  bool operator==(const char* rhs) const { return str == (rhs ? rhs : ""); }
+  bool operator!=(const String& rhs) const { return str != rhs.str; }
+  bool operator!=(const char* rhs) const { return str != (rhs ? rhs : ""); }
+  bool operator<(const String& rhs) const { return str < rhs.str; }
+  bool equals(const String& rhs) const { return str == rhs.str; }
+  bool equalsIgnoreCase(const String& rhs) const { return strcasecmp(c_str(), rhs.c_str()) == 0; }
+
+  int indexOf(char c, unsigned int from = 0) const { return pos(str.find(c, from)); }
+  int indexOf(const String& s, unsigned int from = 0) const { return pos(str.find(s.str, from)); }
+  int indexOf(const char* s, unsigned int from = 0) const { return pos(str.find(s, from)); }
+  int lastIndexOf(char c) const { return pos(str.rfind(c)); }
+  int lastIndexOf(const String& s) const { return pos(str.rfind(s.str)); }
+  bool startsWith(const String& s) const { return str.compare(0, s.str.length(), s.str) == 0; }
+  bool endsWith(const String& s) const {
+    return str.length() >= s.str.length() && str.compare(str.length() - s.str.length(), s.str.length(), s.str) == 0;
+  }
+
+  String substring(unsigned int from) const { return from >= str.length() ? String() : String(str.substr(from)); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) std::swap(from, to);
+    if (from >= str.length()) return String();
+    return String(str.substr(from, to - from));
+  }
+
+  void remove(unsigned int idx) { if (idx < str.length()) str.erase(idx); }
+  void remove(unsigned int idx, unsigned int count) { if (idx < str.length()) str.erase(idx, count); }
+  void replace(const String& from, const String& to) {
+    if (from.str.empty()) return;
+    size_t p = 0;
+    while ((p = str.find(from.str, p)) != std::string::npos) {
+      str.replace(p, from.str.length(), to.str);
+      p += to.str.length();
+    }
+  }
+  void toLowerCase() { for (auto& c : str) c = tolower(c); }
+  void toUpperCase() { for (auto& c : str) c = toupper(c); }
+  void trim() {
+    size_t a = str.find_first_not_of(" \t\r\n");
+    size_t b = str.find_last_not_of(" \t\r\n");
+    str = (a == std::string::npos) ? "" : str.substr(a, b - a + 1);
+  }
+  long toInt() const { return atol(str.c_str()); }
+  float toFloat() const { return atof(str.c_str()); }
+  void toCharArray(char* buf, unsigned int size, unsigned int index = 0) const {
+    if (!size) return;
+    strncpy(buf, index < str.length() ? str.c_str() + index : "", size - 1);
+    buf[size - 1] = 0;
+  }
+  void getBytes(unsigned char* buf, unsigned int size) const { toCharArray((char*)buf, size); }
+
+private:
+  std::string str;
+
+  static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+  void fromLong(long v, unsigned char base) {
+    if (base == 10) { str = std::to_string(v); return; }
+    fromULong((unsigned long)v, base);
+  }
+  void fromULong(unsigned long v, unsigned char base) {
+    char buf[65];
+    int i = 64;
+    buf[i] = 0;
+    do { int d = v % base; buf[--i] = d < 10 ? '0' + d : 'a' + d - 10; v /= base; } while (v);
+    str = &buf[i];
+  }
+  void fromDouble(double v, unsigned int decimals) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+    str = buf;
+  }
+};
+
+#endif
@@ -0,0 +1,71 @@
+// Host stand-in for the ESP32 WiFi stack: no networks are in range, unless the scenario
+// has "wifi", in which case WiFiClient connects through the sockets of the host
+#ifndef _SIM_WIFI_H
+#define _SIM_WIFI_H
+
+#include "Arduino.h"
+
+typedef enum { WIFI_MODE_NULL, WIFI_MODE_STA, WIFI_MODE_AP, WIFI_MODE_APSTA } wifi_mode_t;
+#define WIFI_OFF WIFI_MODE_NULL
+#define WIFI_STA WIFI_MODE_STA
+#define WIFI_AP  WIFI_MODE_AP
+
+typedef enum { WIFI_AUTH_OPEN, WIFI_AUTH_WEP, WIFI_AUTH_WPA_PSK, WIFI_AUTH_WPA2_PSK, WIFI_AUTH_WPA_WPA2_PSK,
+               WIFI_AUTH_WPA2_ENTERPRISE, WIFI_AUTH_WPA3_PSK } wifi_auth_mode_t;
+
+class IPAddress {
+public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{ a, b, c, d } {}
+  uint8_t operator[](int idx) const { return(bytes[idx]); }
+  uint8_t& operator[](int idx) { return(bytes[idx]); }
+  operator uint32_t() const { uint32_t v; memcpy(&v, bytes, 4); return(v); }
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+    return(String(buf));
+  }
+  operator String() const { return(toString()); }
+
+private:
+  uint8_t bytes[4] = { 0, 0, 0, 0 };
+};
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t m) { (void)m; return(true); }
+  bool disconnect(bool wifiOff = false) { (void)wifiOff; return(true); }
+  bool isConnected() { return(connected); }
+  int16_t scanNetworks() { delay(2000); return(0); }
+  String SSID(uint8_t i = 0) { (void)i; return(String()); }
+  int32_t RSSI(uint8_t i = 0) { (void)i; return(0); }
+  wifi_auth_mode_t encryptionType(uint8_t i) { (void)i; return(WIFI_AUTH_OPEN); }
+  IPAddress localIP() { return(connected ? IPAddress(127, 0, 0, 1) : IPAddress()); }
+
+  bool connected = false;
+};
+
+class WiFiClient {
+public:
+  ~WiFiClient() { stop(); }
+
+  int connect(const char *host, uint16_t port, int32_t timeout = 3000);
+  size_t write(const uint8_t *buf, size_t len);
+  int available();
+  int read();
+  uint8_t connected();
+  void stop();
+  int setNoDelay(bool nodelay) { (void)nodelay; return(0); }
+  operator bool() { return(connected()); }
+
+private:
+  int fd = -1;
+  uint8_t buf[512];
+  size_t bufLen = 0;
+  size_t bufPos = 0;
+  bool eof = false;
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,16 @@
+// Host stand-in for the Arduino I2C bus; the sensors are modelled by their own mocks
+#ifndef _SIM_WIRE_H
+#define _SIM_WIRE_H
+
+#include "Arduino.h"
+
+class TwoWire {
+public:
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) { (void)sda, (void)scl, (void)frequency; return(true); }
+  bool end() { return(true); }
+  void setClock(uint32_t frequency) { (void)frequency; }
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,111 @@
+#include <math.h>
+#include "Arduino.h"
+#include "Wire.h"
+#include "SPI.h"
+#include "WiFi.h"
+#include "TinyGPSPlus.h"
+#include "Adafruit_BME280.h"
+#include "Adafruit_TSL2591.h"
+#include "Adafruit_AS7331.h"
+#include "SensirionI2cScd4x.h"
+#include "SensirionI2CSen5x.h"
+#include "sim.h"
+
+TwoWire Wire;
+SPIClass SPI(FSPI);
+WiFiClass WiFi;
+
+// slow daily cycle used to give the environmental readings some movement
+static float daily(float mean, float amplitude) {
+  double day = (double)simUtc() / 86400.0;
+  return(mean + amplitude * sin(2 * M_PI * (day - 0.375)));
+}
+
+// ============= GNSS =============
+
+bool TinyGPSPlus::encode(char c) {
+  (void)c;
+  if(!simGnssHasFix()) {
+    satellites = { true, 2 };
+    hdop = { true, 9990 };
+    location.valid = false;
+    return(false);
+  }
+
+  time_t utc = simUtc();
+  struct tm t;
+  gmtime_r(&utc, &t);
+  location = { true, (uint32_t)millis(), 52.0907, 5.1214 };
+  altitude = { true, 4.2 };
+  satellites = { true, 11 };
+  hdop = { true, 110 };
+  date = { true, (uint16_t)(t.tm_year + 1900), (uint8_t)(t.tm_mon + 1), (uint8_t)t.tm_mday };
+  time = { true, (uint8_t)t.tm_hour, (uint8_t)t.tm_min, (uint8_t)t.tm_sec };
+  return(true);
+}
+
+// ============= Environmental sensors =============
+
+float Adafruit_BME280::readTemperature() {
+  return(daily(15.0f, 5.0f) + 2.5f);   // self-heating in the enclosure
+}
+
+float Adafruit_BME280::readHumidity() {
+  return(daily(70.0f, -15.0f));
+}
+
+float Adafruit_BME280::readPressure() {
+  return(101325.0f);
+}
+
+uint32_t Adafruit_TSL2591::getFullLuminosity() {
+  delay(120);
+  uint16_t full = max(0.0f, daily(0.0f, 20000.0f));
+  return(((uint32_t)(full / 10) << 16) | full);
+}
+
+bool Adafruit_AS7331::readAllUV_uWcm2(float* uva, float* uvb, float* uvc) {
+  *uva = max(0.0f, daily(0.0f, 300.0f));
+  *uvb = *uva / 10;
+  *uvc = 0;
+  return(true);
+}
+
+static uint64_t scdStarted = 0;
+
+int16_t SensirionI2CCommunication::sendFrame(uint8_t address, SensirionI2CTxFrame& frame, TwoWire& wire) {
+  (void)address, (void)wire;
+  if(frame.command == 0x219d) {   // measure_single_shot
+    scdStarted = simNow();
+  }
+  return(0);
+}
+
+int16_t SensirionI2cScd4x::getDataReadyStatus(bool& ready) {
+  delay(1);
+  ready = simNow() - scdStarted >= 4500 * 1000ULL;
+  return(0);
+}
+
+int16_t SensirionI2cScd4x::readMeasurement(uint16_t& co2, float& temperature, float& humidity) {
+  delay(1);
+  co2 = (uint16_t)daily(520.0f, 60.0f);
+  temperature = daily(15.0f, 5.0f);
+  humidity = daily(78.0f, -15.0f);
+  sim->readings[sim->numReadings++ % SIM_MAX_READINGS] = { simUtc(), temperature };
+  return(0);
+}
+
+uint16_t SensirionI2CSen5x::readMeasuredValues(float& pm1p0, float& pm2p5, float& pm4p0, float& pm10p0, float& humidity,
+                                               float& temperature, float& vocIndex, float& noxIndex) {
+  delay(20);
+  pm1p0 = daily(6.0f, 2.0f);
+  pm2p5 = pm1p0 * 1.4f;
+  pm4p0 = pm1p0 * 1.7f;
+  pm10p0 = pm1p0 * 2.0f;
+  humidity = daily(70.0f, -15.0f);
+  temperature = daily(15.0f, 5.0f) + 1.0f;
+  vocIndex = 100.0f;
+  noxIndex = 1.0f;
+  return(0);
+}
@@ -0,0 +1,7 @@
+// Host stand-in for the ESP-IDF GPIO driver
+#ifndef _SIM_DRIVER_GPIO_H
+#define _SIM_DRIVER_GPIO_H
+
+#include "esp_sleep.h"
+
+#endif
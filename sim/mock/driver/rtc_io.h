@@ -0,0 +1,20 @@
+// Host stand-in for the ESP-IDF RTC GPIO driver
+#ifndef _SIM_DRIVER_RTC_IO_H
+#define _SIM_DRIVER_RTC_IO_H
+
+#include "Arduino.h"
+#include "esp_sleep.h"
+
+typedef enum {
+  RTC_GPIO_MODE_INPUT_ONLY,
+  RTC_GPIO_MODE_OUTPUT_ONLY,
+  RTC_GPIO_MODE_INPUT_OUTPUT,
+  RTC_GPIO_MODE_DISABLED,
+} rtc_gpio_mode_t;
+
+inline esp_err_t rtc_gpio_init(gpio_num_t gpio) { (void)gpio; return(ESP_OK); }
+inline esp_err_t rtc_gpio_set_direction(gpio_num_t gpio, rtc_gpio_mode_t mode) { (void)gpio, (void)mode; return(ESP_OK); }
+inline esp_err_t rtc_gpio_pullup_en(gpio_num_t gpio) { (void)gpio; return(ESP_OK); }
+inline esp_err_t rtc_gpio_pullup_dis(gpio_num_t gpio) { (void)gpio; return(ESP_OK); }
+
+#endif
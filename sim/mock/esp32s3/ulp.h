@@ -0,0 +1,72 @@
+// Host stand-in for the ULP FSM coprocessor macros.
+// Programs are assembled into a simplified encoding that the simulator executes
+// on every ULP timer period while the device is in deep sleep.
+#ifndef _SIM_ULP_H
+#define _SIM_ULP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "Arduino.h"
+
+#define R0 0
+#define R1 1
+#define R2 2
+#define R3 3
+
+enum {
+  SIM_ULP_ADC,
+  SIM_ULP_MOVI,
+  SIM_ULP_LD,
+  SIM_ULP_ST,
+  SIM_ULP_ADDR,
+  SIM_ULP_SUBR,
+  SIM_ULP_ADDI,
+  SIM_ULP_BX,
+  SIM_ULP_BXF,
+  SIM_ULP_HALT,
+  SIM_ULP_WAKE,
+  SIM_ULP_END,
+  SIM_ULP_WR_REG,
+  SIM_ULP_DELAY,
+  SIM_ULP_LABEL,      // pseudo-instructions, resolved while loading
+  SIM_ULP_BRANCH,
+};
+
+typedef struct {
+  uint8_t op;
+  uint8_t rd;
+  uint8_t rs;
+  uint8_t rt;
+  int32_t imm;
+} ulp_insn_t;
+
+#define I_ADC(reg_dest, adc_idx, pad_idx)   { SIM_ULP_ADC, reg_dest, adc_idx, pad_idx, 0 }
+#define I_MOVI(reg_dest, imm_)              { SIM_ULP_MOVI, reg_dest, 0, 0, imm_ }
+#define I_LD(reg_dest, reg_addr, offset_)   { SIM_ULP_LD, reg_dest, reg_addr, 0, offset_ }
+#define I_ST(reg_val, reg_addr, offset_)    { SIM_ULP_ST, reg_val, reg_addr, 0, offset_ }
+#define I_ADDR(reg_dest, reg_a, reg_b)      { SIM_ULP_ADDR, reg_dest, reg_a, reg_b, 0 }
+#define I_SUBR(reg_dest, reg_a, reg_b)      { SIM_ULP_SUBR, reg_dest, reg_a, reg_b, 0 }
+#define I_ADDI(reg_dest, reg_src, imm_)     { SIM_ULP_ADDI, reg_dest, reg_src, 0, imm_ }
+#define I_BXI(imm_)                         { SIM_ULP_BX, 0, 0, 0, imm_ }
+#define I_BXFI(imm_)                        { SIM_ULP_BXF, 0, 0, 0, imm_ }
+#define I_HALT()                            { SIM_ULP_HALT, 0, 0, 0, 0 }
+#define I_WAKE()                            { SIM_ULP_WAKE, 0, 0, 0, 0 }
+#define I_END()                             { SIM_ULP_END, 0, 0, 0, 0 }
+#define I_DELAY(cycles_)                    { SIM_ULP_DELAY, 0, 0, 0, cycles_ }
+// the only register the firmware writes is the BAT_CTRL pullup, which enables the battery divider
+#define I_WR_REG(reg, low_bit, high_bit, val) { SIM_ULP_WR_REG, 0, 0, 0, (val) }
+
+#define M_LABEL(label_num)                  { SIM_ULP_LABEL, 0, 0, 0, label_num }
+#define M_BRANCH(label_num)                 { SIM_ULP_BRANCH, 0, 0, 0, label_num }
+#define M_BX(label_num)                     M_BRANCH(label_num), I_BXI(0)
+#define M_BXF(label_num)                    M_BRANCH(label_num), I_BXFI(0)
+
+uint32_t* simUlpMemory();
+#define RTC_SLOW_MEM (simUlpMemory())
+
+esp_err_t ulp_process_macros_and_load(uint32_t load_addr, const ulp_insn_t* program, size_t* psize);
+esp_err_t ulp_run(uint32_t entry_point);
+esp_err_t ulp_set_wakeup_period(size_t period_index, uint32_t period_us);
+void ulp_timer_stop();
+
+#endif
@@ -0,0 +1,4 @@
+// Intentionally empty: the simulation build does not include the networking code
+#ifndef _SIM_ESP_CHIP_INFO_H
+#define _SIM_ESP_CHIP_INFO_H
+#endif
@@ -0,0 +1,29 @@
+// Host implementation of the ROM CRC routines
+#ifndef _SIM_ESP_ROM_CRC_H
+#define _SIM_ESP_ROM_CRC_H
+
+#include <stdint.h>
+
+inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+  crc = ~crc;
+  while(len--) {
+    crc ^= *buf++;
+    for(int i = 0; i < 8; i++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return(~crc);
+}
+
+inline uint16_t esp_rom_crc16_le(uint16_t crc, const uint8_t* buf, uint32_t len) {
+  crc = ~crc;
+  while(len--) {
+    crc ^= *buf++;
+    for(int i = 0; i < 8; i++) {
+      crc = (crc >> 1) ^ (0x8408 & (0 - (crc & 1)));
+    }
+  }
+  return(~crc);
+}
+
+#endif
@@ -0,0 +1,127 @@
+// The file browser (fs_browser.cpp) and BLE configurator (ble.cpp) are left out of the
+// simulation build; these stand-ins behave like a device that never finds a network,
+// unless the scenario has "wifi". Then the network is the host, such that the
+// publisher can be tried against a local HTTP server or MQTT broker.
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "fs_browser.h"
+#include "ble.h"
+#include "sim.h"
+
+wifi_mode_t wifiMode = WIFI_MODE_NULL;
+IPAddress IP;
+
+bool connectWiFi() {
+  if(!scenario.wifi) {
+    delay(10000);   // connection timeout
+    return(false);
+  }
+  delay(300);       // association with a known access point
+  wifiMode = WIFI_MODE_STA;
+  WiFi.connected = true;
+  IP = WiFi.localIP();
+  return(true);
+}
+
+void disconnectWiFi() {
+  wifiMode = WIFI_MODE_NULL;
+  WiFi.connected = false;
+}
+
+int WiFiClient::connect(const char *host, uint16_t port, int32_t timeout) {
+  (void)timeout;
+  stop();
+  if(!WiFi.connected) {
+    return(0);
+  }
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  struct addrinfo hints = {}, *res;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if(getaddrinfo(host, service, &hints, &res) != 0) {
+    return(0);
+  }
+  for(struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if(fd >= 0 && ::connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(res);
+  if(fd < 0) {
+    return(0);
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  delay(20);        // a round trip over WiFi
+  return(1);
+}
+
+size_t WiFiClient::write(const uint8_t *data, size_t len) {
+  size_t n = 0;
+  while(fd >= 0 && n < len) {
+    ssize_t r = send(fd, &data[n], len - n, MSG_NOSIGNAL);
+    if(r <= 0) {
+      return(n);
+    }
+    n += r;
+  }
+  return(n);
+}
+
+// waits a moment in real time, as the other end runs outside of the virtual clock
+int WiFiClient::available() {
+  if(bufPos == bufLen && fd >= 0 && !eof) {
+    struct pollfd p = { fd, POLLIN, 0 };
+    if(poll(&p, 1, 1) > 0) {
+      ssize_t r = recv(fd, buf, sizeof(buf), 0);
+      eof = r <= 0;
+      bufLen = r > 0 ? r : 0;
+      bufPos = 0;
+    }
+  }
+  return(bufLen - bufPos);
+}
+
+int WiFiClient::read() {
+  return(available() ? buf[bufPos++] : -1);
+}
+
+uint8_t WiFiClient::connected() {
+  return(fd >= 0 && (!eof || available()));
+}
+
+void WiFiClient::stop() {
+  if(fd >= 0) {
+    close(fd);
+  }
+  fd = -1;
+  bufLen = bufPos = 0;
+  eof = false;
+}
+
+void start_file_browser() {}
+
+void end_file_browser() {}
+
+BLEConfigurator ble = BLEConfigurator();
+
+BLEConfigurator::BLEConfigurator() {
+  state = BLE_INACTIVE;
+}
+
+void BLEConfigurator::start(String bleName) {
+  (void)bleName;
+}
+
+void BLEConfigurator::stop() {}
+
+void BLEConfigurator::update(int errorCode) {
+  (void)errorCode;
+}
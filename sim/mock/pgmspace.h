@@ -0,0 +1,7 @@
+// Host stand-in for the ESP32 program memory helpers
+#ifndef _SIM_PGMSPACE_H
+#define _SIM_PGMSPACE_H
+
+#include "Arduino.h"
+
+#endif
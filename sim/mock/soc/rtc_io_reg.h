@@ -0,0 +1,9 @@
+// Host stand-in for the ESP32-S3 RTC IO registers, as written by the ULP
+#ifndef _SIM_SOC_RTC_IO_REG_H
+#define _SIM_SOC_RTC_IO_REG_H
+
+#define DR_REG_RTCIO_BASE         0x60008400
+#define RTC_IO_TOUCH_PAD2_REG     (DR_REG_RTCIO_BASE + 0x8C)
+#define RTC_IO_TOUCH_PAD2_RUE_S   27
+
+#endif
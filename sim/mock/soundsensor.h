@@ -0,0 +1,29 @@
+// Host stand-in for the I2S microphone: every block takes as long as on the device
+// and returns a constant background level in each octave band
+#ifndef __SOUND_SENSOR_H_
+#define __SOUND_SENSOR_H_
+
+#include "Arduino.h"
+
+#define SAMPLES 2048
+#define SAMPLE_FREQ 22627
+#define OCTAVES 9
+
+class SoundSensor {
+  public:
+    void begin(int bclk, int lrclk, int din) { (void)bclk, (void)lrclk, (void)din; }
+    void disable() {}
+    float* readSamples() {
+      delay(SAMPLES * 1000 / SAMPLE_FREQ);
+      for(int i = 0; i < OCTAVES; i++) {
+        _energy[i] = 1e4f;
+      }
+      return(_energy);
+    }
+    void offset(float dB) { (void)dB; }
+
+  private:
+    float _energy[OCTAVES];
+};
+
+#endif // __SOUND_SENSOR_H_
@@ -0,0 +1,102 @@
+#include "esp32s3/ulp.h"
+#include "sim.h"
+
+// instruction word: op (4 bits), rd (2), rs (2), rt (4), imm (16)
+static uint32_t encode(const ulp_insn_t &insn, int32_t imm) {
+  return(((uint32_t)insn.op << 28) | ((uint32_t)(insn.rd & 3) << 26) | ((uint32_t)(insn.rs & 3) << 24) |
+         ((uint32_t)(insn.rt & 0xF) << 20) | (uint16_t)imm);
+}
+
+uint32_t* simUlpMemory() {
+  return(sim->ulpMem);
+}
+
+esp_err_t ulp_process_macros_and_load(uint32_t load_addr, const ulp_insn_t* program, size_t* psize) {
+  // first pass: label addresses
+  int32_t labels[16];
+  for(int i = 0; i < 16; i++) {
+    labels[i] = -1;
+  }
+  uint32_t addr = load_addr;
+  for(size_t i = 0; i < *psize; i++) {
+    if(program[i].op == SIM_ULP_LABEL) {
+      labels[program[i].imm & 15] = addr;
+    } else if(program[i].op != SIM_ULP_BRANCH) {
+      addr++;
+    }
+  }
+  if(addr > SIM_ULP_WORDS) {
+    return(ESP_FAIL);
+  }
+
+  // second pass: emit instructions, a branch takes the address of its label
+  addr = load_addr;
+  int32_t target = -1;
+  for(size_t i = 0; i < *psize; i++) {
+    const ulp_insn_t &insn = program[i];
+    if(insn.op == SIM_ULP_LABEL) {
+      continue;
+    }
+    if(insn.op == SIM_ULP_BRANCH) {
+      target = labels[insn.imm & 15];
+      if(target < 0) {
+        return(ESP_FAIL);
+      }
+      continue;
+    }
+    bool isBranch = (insn.op == SIM_ULP_BX || insn.op == SIM_ULP_BXF);
+    sim->ulpMem[addr++] = encode(insn, isBranch && target >= 0 ? target : insn.imm);
+    target = -1;
+  }
+  *psize = addr - load_addr;
+  return(ESP_OK);
+}
+
+esp_err_t ulp_run(uint32_t entry_point) {
+  sim->ulpEntry = entry_point;
+  sim->ulpDivider = false;
+  sim->ulpRunning = true;
+  return(ESP_OK);
+}
+
+esp_err_t ulp_set_wakeup_period(size_t period_index, uint32_t period_us) {
+  (void)period_index;
+  sim->ulpPeriodUs = period_us;
+  return(ESP_OK);
+}
+
+void ulp_timer_stop() {
+  sim->ulpRunning = false;
+}
+
+// runs the program once at time t, returns true if it woke the main cores
+bool simUlpRun(uint64_t t) {
+  uint16_t r[4] = { 0 };
+  bool overflow = false;
+  bool wake = false;
+  uint32_t pc = sim->ulpEntry;
+  for(int steps = 0; steps < 1024 && pc < SIM_ULP_WORDS; steps++) {
+    uint32_t w = sim->ulpMem[pc++];
+    int op = w >> 28, rd = (w >> 26) & 3, rs = (w >> 24) & 3, rt = (w >> 20) & 0xF;
+    int16_t imm = (int16_t)(w & 0xFFFF);
+    int32_t res;
+    switch(op) {
+      case SIM_ULP_ADC:   r[rd] = sim->ulpDivider ? simAdcCounts(simBatteryMillivoltsAt(t) / 4.9f) : 0; (void)rt; break;
+      case SIM_ULP_MOVI:  r[rd] = imm; break;
+      case SIM_ULP_LD:    r[rd] = sim->ulpMem[(r[rs] + imm) % SIM_ULP_WORDS] & 0xFFFF; break;
+      case SIM_ULP_ST:    sim->ulpMem[(r[rs] + imm) % SIM_ULP_WORDS] = (pc - 1) << 21 | r[rd]; break;
+      case SIM_ULP_ADDR:  res = r[rs] + r[rt & 3]; overflow = res > 0xFFFF; r[rd] = res; break;
+      case SIM_ULP_SUBR:  res = r[rs] - r[rt & 3]; overflow = res < 0;      r[rd] = res; break;
+      case SIM_ULP_ADDI:  res = r[rs] + imm;       overflow = res > 0xFFFF; r[rd] = res; break;
+      case SIM_ULP_BX:    pc = (uint16_t)imm; break;
+      case SIM_ULP_BXF:   if(overflow) pc = (uint16_t)imm; break;
+      case SIM_ULP_WAKE:  wake = true; break;
+      case SIM_ULP_END:   sim->ulpRunning = false; break;
+      case SIM_ULP_WR_REG: sim->ulpDivider = imm; break;
+      case SIM_ULP_DELAY: break;
+      case SIM_ULP_HALT:  return(wake);
+      default:            return(wake);
+    }
+  }
+  return(wake);
+}
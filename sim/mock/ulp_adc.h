@@ -0,0 +1,24 @@
+// Host stand-in for the ESP-IDF ULP ADC configuration
+#ifndef _SIM_ULP_ADC_H
+#define _SIM_ULP_ADC_H
+
+#include "Arduino.h"
+
+typedef enum { ADC_UNIT_1, ADC_UNIT_2 } adc_unit_t;
+typedef enum { ADC_CHANNEL_0, ADC_CHANNEL_1, ADC_CHANNEL_2, ADC_CHANNEL_3, ADC_CHANNEL_4,
+               ADC_CHANNEL_5, ADC_CHANNEL_6, ADC_CHANNEL_7, ADC_CHANNEL_8, ADC_CHANNEL_9 } adc_channel_t;
+typedef enum { ADC_ATTEN_DB_0, ADC_ATTEN_DB_2_5, ADC_ATTEN_DB_6, ADC_ATTEN_DB_12 } adc_atten_t;
+typedef enum { ADC_BITWIDTH_DEFAULT = 0, ADC_BITWIDTH_12 = 12 } adc_bitwidth_t;
+typedef enum { ADC_ULP_MODE_DISABLE, ADC_ULP_MODE_FSM, ADC_ULP_MODE_RISCV } adc_ulp_mode_t;
+
+typedef struct {
+  adc_unit_t adc_n;
+  adc_channel_t channel;
+  adc_atten_t atten;
+  adc_bitwidth_t width;
+  adc_ulp_mode_t ulp_mode;
+} ulp_adc_cfg_t;
+
+inline esp_err_t ulp_adc_init(const ulp_adc_cfg_t* cfg) { (void)cfg; return(ESP_OK); }
+
+#endif
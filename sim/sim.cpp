@@ -0,0 +1,598 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <time.h>
+#include <string>
+
+#include "Arduino.h"
+#include "sim.h"
+#include "config.h"
+#include "pins.h"
+#include "payload.h"
+
+// bounds of all RTC_DATA_ATTR variables, provided by the linker
+extern uint8_t __start_rtc_data[];
+extern uint8_t __stop_rtc_data[];
+
+void setup();
+void loop();
+
+SimScenario scenario;
+SimShared* sim = nullptr;
+bool simVerbose = false;
+
+static std::string dataDir;
+static pthread_t mainThread;
+static pthread_mutex_t clockMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t clockCond = PTHREAD_COND_INITIALIZER;
+static uint64_t wakeStart = 0;
+static uint64_t gnssOnSince = 0;
+static bool gnssOn = false;
+
+// ============= Virtual time =============
+// Other threads (such as the microphone task) run in lockstep with the main thread:
+// before the clock moves on, every thread that is due has to run until it blocks again.
+
+#define SIM_MAX_WAITERS 8
+
+static struct {
+  bool active;
+  bool released;
+  uint64_t target;
+} waiters[SIM_MAX_WAITERS];
+static int busyThreads = 0;
+static pthread_cond_t idleCond = PTHREAD_COND_INITIALIZER;
+
+uint64_t simNow() {
+  return(__atomic_load_n(&sim->nowUs, __ATOMIC_ACQUIRE));
+}
+
+bool simIsMainThread() {
+  return(pthread_equal(pthread_self(), mainThread));
+}
+
+void simThreadStarted() {
+  pthread_mutex_lock(&clockMutex);
+  busyThreads++;
+  pthread_mutex_unlock(&clockMutex);
+}
+
+void simThreadStopped() {
+  pthread_mutex_lock(&clockMutex);
+  busyThreads--;
+  pthread_cond_broadcast(&idleCond);
+  pthread_mutex_unlock(&clockMutex);
+}
+
+void simAdvance(uint64_t us) {
+  pthread_mutex_lock(&clockMutex);
+  while(busyThreads > 0) {
+    pthread_cond_wait(&idleCond, &clockMutex);
+  }
+  // stop at each deadline of a waiting thread on the way, so that threads interleave
+  uint64_t target = sim->nowUs + us;
+  do {
+    uint64_t next = target;
+    for(int i = 0; i < SIM_MAX_WAITERS; i++) {
+      if(waiters[i].active && !waiters[i].released && waiters[i].target < next) {
+        next = waiters[i].target;
+      }
+    }
+    __atomic_store_n(&sim->nowUs, next > sim->nowUs ? next : sim->nowUs, __ATOMIC_RELEASE);
+    for(int i = 0; i < SIM_MAX_WAITERS; i++) {
+      if(waiters[i].active && !waiters[i].released && waiters[i].target <= sim->nowUs) {
+        waiters[i].released = true;
+        busyThreads++;
+      }
+    }
+    pthread_cond_broadcast(&clockCond);
+    while(busyThreads > 0) {
+      pthread_cond_wait(&idleCond, &clockMutex);
+    }
+  } while(sim->nowUs < target);
+  pthread_mutex_unlock(&clockMutex);
+
+  // an awake device that never sleeps still has to stop at the end of the scenario
+  if(sim->nowUs >= scenario.duration) {
+    simExit(SIM_EXIT_TIMEOUT);
+  }
+}
+
+void simWaitUntil(uint64_t us) {
+  pthread_mutex_lock(&clockMutex);
+  int slot = 0;
+  while(waiters[slot].active) {
+    slot++;
+  }
+  waiters[slot] = { true, false, us };
+  busyThreads--;
+  pthread_cond_broadcast(&idleCond);
+  while(!waiters[slot].released) {
+    pthread_cond_wait(&clockCond, &clockMutex);
+  }
+  waiters[slot].active = false;
+  pthread_mutex_unlock(&clockMutex);
+}
+
+// ============= Hardware model =============
+
+bool simPowerSwitchOn(uint64_t t) {
+  for(int i = 0; i < scenario.numPowerOff; i++) {
+    if(t >= scenario.powerOff[i].start && t < scenario.powerOff[i].end) {
+      return(false);
+    }
+  }
+  return(true);
+}
+
+uint64_t simNextMotion(uint64_t from) {
+  uint64_t next = UINT64_MAX;
+  for(int i = 0; i < scenario.numMotion; i++) {
+    const SimWindow &w = scenario.motion[i];
+    uint64_t t;
+    if(from < w.start) {
+      t = w.start;
+    } else if(w.period == 0) {
+      continue;
+    } else {
+      t = w.start + ((from - w.start) / w.period + 1) * w.period;
+    }
+    if(t < w.end || (t == w.start && w.period == 0)) {
+      next = min(next, t);
+    }
+  }
+  return(next);
+}
+
+int simPinLevel(uint8_t pin) {
+  switch(pin) {
+    case POWER:   return(simPowerSwitchOn(simNow()) ? HIGH : LOW);
+    case DIP1:    return(scenario.dip[0] ? LOW : HIGH);   // switches pull to ground
+    case DIP2:    return(scenario.dip[1] ? LOW : HIGH);
+    case DIP3:    return(scenario.dip[2] ? LOW : HIGH);
+    case KEY:     return(HIGH);
+    default:      return(LOW);
+  }
+}
+
+uint16_t simBatteryMillivoltsAt(uint64_t t) {
+  double frac = (double)t / scenario.duration;
+  return(scenario.battStart + (int)((scenario.battEnd - scenario.battStart) * frac));
+}
+
+uint16_t simBatteryMillivolts() {
+  return(simBatteryMillivoltsAt(simNow()));
+}
+
+// raw 12-bit reading at 12 dB attenuation, taken as linear up to 3100 mV
+uint16_t simAdcCounts(uint32_t pinMillivolts) {
+  return(min(4095U, pinMillivolts * 4095 / 3100));
+}
+
+time_t simUtc() {
+  return(scenario.epoch + simNow() / SIM_US_PER_S);
+}
+
+void simGnssPower(bool on) {
+  if(on && !gnssOn) {
+    gnssOnSince = simNow();
+  } else if(!on && gnssOn) {
+    simStats.gnssOnUs += simNow() - gnssOnSince;
+  }
+  gnssOn = on;
+}
+
+bool simGnssHasFix() {
+  return(gnssOn && scenario.gnssFixDelay >= 0 &&
+         simNow() - gnssOnSince >= (uint64_t)scenario.gnssFixDelay);
+}
+
+// ============= Process control =============
+
+const char* simPath(const char* sub) {
+  static thread_local std::string path;
+  path = dataDir + "/" + sub;
+  return(path.c_str());
+}
+
+void simExit(SimExit reason) {
+  fflush(stdout);
+  simGnssPower(false);
+  simStats.awakeUs += simNow() - wakeStart;
+  sim->exitReason = reason;
+  memcpy(sim->rtc, __start_rtc_data, __stop_rtc_data - __start_rtc_data);
+  _exit(0);
+}
+
+static void runChild(bool provision) {
+  mainThread = pthread_self();
+  memcpy(__start_rtc_data, sim->rtc, __stop_rtc_data - __start_rtc_data);
+  wakeStart = sim->nowUs;
+
+  if(provision) {
+    loadConfig();
+    for(int i = 0; i < scenario.numSettings; i++) {
+      String key = scenario.settings[i][0];
+      String value = scenario.settings[i][1];
+      int errorCode = doSetting(key, value);
+      if(errorCode != noError) {
+        fprintf(stderr, "%s: +%s=%s: %s\n", scenario.name, key.c_str(), value.c_str(), parseError(errorCode).c_str());
+      }
+    }
+    simExit(SIM_EXIT_PROVISIONED);
+  }
+
+  setup();
+  for(;;) {
+    loop();
+  }
+}
+
+static bool forkChild(bool provision) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0) {
+    runChild(provision);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "%s: firmware crashed at t=%.1fs (status %d)\n",
+            scenario.name, sim->nowUs / 1e6, status);
+    return(false);
+  }
+  return(true);
+}
+
+// determine which of the configured wake sources fires first after going to sleep
+static bool nextWake(uint64_t &when, int &cause, uint64_t &ext1Status) {
+  uint64_t t = sim->nowUs;
+  when = UINT64_MAX;
+
+  if(sim->timerUs) {
+    when = t + sim->timerUs;
+    cause = ESP_SLEEP_WAKEUP_TIMER;
+  }
+
+  // only the accelerometer is modelled on EXT0; the KEY button is never pressed
+  if(sim->ext0Pin == ACC_INT && sim->ext0Level == HIGH) {
+    uint64_t m = simNextMotion(t);
+    if(m < when) {
+      when = m;
+      cause = ESP_SLEEP_WAKEUP_EXT0;
+    }
+  }
+
+  if(sim->ext1Mask & BIT(POWER)) {
+    bool wantOn = (sim->ext1Mode == ESP_EXT1_WAKEUP_ANY_HIGH);
+    uint64_t p = UINT64_MAX;
+    if(simPowerSwitchOn(t) == wantOn) {
+      p = t;
+    } else {
+      for(int i = 0; i < scenario.numPowerOff; i++) {
+        uint64_t edge = wantOn ? scenario.powerOff[i].end : scenario.powerOff[i].start;
+        if(edge > t && edge < p) {
+          p = edge;
+        }
+      }
+    }
+    if(p < when) {
+      when = p;
+      cause = ESP_SLEEP_WAKEUP_EXT1;
+      ext1Status = BIT(POWER);
+    }
+  }
+
+  // the ULP runs once per period, until it wakes the main cores or stops itself
+  if(sim->ulpRunning && sim->ulpPeriodUs) {
+    for(uint64_t u = t + sim->ulpPeriodUs; u < min(when, scenario.duration) && sim->ulpRunning; u += sim->ulpPeriodUs) {
+      if(simUlpRun(u) && sim->ulpWake) {
+        when = u;
+        cause = ESP_SLEEP_WAKEUP_ULP;
+        break;
+      }
+    }
+  }
+
+  return(when < scenario.duration);
+}
+
+static bool runScenario() {
+  dataDir = std::string("sim_data/") + scenario.name;
+  std::string cmd = "rm -rf '" + dataDir + "' && mkdir -p '" + dataDir + "'";
+  if(system(cmd.c_str()) != 0) {
+    fprintf(stderr, "%s: cannot create %s\n", scenario.name, dataDir.c_str());
+    return(false);
+  }
+
+  if(sim) {
+    munmap(sim, sizeof(SimShared));
+  }
+  sim = (SimShared*)mmap(NULL, sizeof(SimShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  memset(sim, 0, sizeof(SimShared));
+  memcpy(sim->rtc, __start_rtc_data, __stop_rtc_data - __start_rtc_data);
+  sim->wakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+
+  if(!forkChild(true)) {
+    return(false);
+  }
+
+  while(sim->nowUs < scenario.duration) {
+    sim->stats.wakes++;
+    sim->timerUs = 0;
+    sim->ext0Pin = -1;
+    sim->ext1Mask = 0;
+    sim->ulpWake = false;
+    if(!forkChild(false)) {
+      return(false);
+    }
+
+    if(sim->exitReason == SIM_EXIT_TIMEOUT) {
+      break;
+    }
+    if(sim->exitReason == SIM_EXIT_RESTART) {
+      sim->wakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+      continue;
+    }
+
+    uint64_t when;
+    int cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+    uint64_t ext1Status = 0;
+    if(!nextWake(when, cause, ext1Status)) {
+      sim->nowUs = scenario.duration;
+      break;
+    }
+    sim->nowUs = max(when, sim->nowUs);
+    sim->wakeCause = cause;
+    sim->ext1Status = ext1Status;
+    switch(cause) {
+      case ESP_SLEEP_WAKEUP_TIMER:   sim->stats.timerWakes++;  break;
+      case ESP_SLEEP_WAKEUP_EXT0:    sim->stats.motionWakes++; break;
+      case ESP_SLEEP_WAKEUP_EXT1:    sim->stats.buttonWakes++; break;
+      case ESP_SLEEP_WAKEUP_ULP:     sim->stats.ulpWakes++;    break;
+    }
+  }
+
+  if(sim->stats.payloadErrors) {
+    fprintf(stderr, "%s: %u uplinks do not decode\n", scenario.name, sim->stats.payloadErrors);
+    return(false);
+  }
+  if(sim->stats.timeErrors) {
+    fprintf(stderr, "%s: %u measurements decode to the wrong time\n", scenario.name, sim->stats.timeErrors);
+    return(false);
+  }
+  return(true);
+}
+
+// Every value within the range of its field must decode to within one step of itself.
+// Sweeps all fields at once, each with its own stride through its range.
+static bool checkPayload() {
+  struct { float lo, hi, step; } f[] = {
+    { 2500, 5050, 10 },     { -327, 327, 0.01 },    { 0, 127, 0.5 },    { 0, 6553, 0.1 },
+    { 0, 65535, 1 },        { 0, 65535, 1 },        { 32, 95, 0.25 },   { 32, 95, 0.25 },
+    { 32, 95, 0.25 },       { 0, 65535, 1 },        { 0, 409, 0.1 },    { 0, 409, 0.1 },
+    { 0, 500, 0.1 },        { 0, 500, 0.1 },        { -90, 90, 1e-7 },  { -180, 180, 1e-7 },
+    { -3276, 3276, 0.1 },   { 0, 25, 0.1 },
+  };
+  const int n = sizeof(f) / sizeof(f[0]);
+  int failures = 0;
+  for(int i = 0; i <= 1000; i++) {
+    double x[n];
+    for(int j = 0; j < n; j++) {
+      x[j] = f[j].lo + (f[j].hi - f[j].lo) * ((i * (j + 1) * 7919) % 1001) / 1000.0;
+    }
+    PayloadValues v = { (uint8_t)((i % 8) << 1), (uint16_t)x[0], (float)x[1], (float)x[2], (float)x[3],
+                        (float)x[4], (float)x[5], (float)x[6], (float)x[7], (float)x[8], (float)x[9],
+                        (float)x[10], (float)x[11], (float)x[12], (float)x[13], x[14], x[15],
+                        (float)x[16], (float)x[17], (uint8_t)(i % 40) };
+    uint8_t buf[PAYLOAD_MAX_SIZE];
+    size_t len = payloadEncode(v, buf);
+    PayloadValues d;
+    if(!payloadDecode(payloadPort(v), buf, len, d)) {
+      fprintf(stderr, "payload %d: does not decode\n", i);
+      failures++;
+      continue;
+    }
+    double got[n] = { (double)d.batt, d.temp, d.humi, d.pres, d.lumi, d.uva, d.dbMin, d.dbAvg, d.dbMax,
+                      d.co2, d.pm2_5, d.pm10, d.voc, d.nox, d.lat, d.lon, d.alt, d.hdop };
+    double want[n] = { (double)v.batt, v.temp, v.humi, v.pres, v.lumi, v.uva, v.dbMin, v.dbAvg, v.dbMax,
+                       v.co2, v.pm2_5, v.pm10, v.voc, v.nox, v.lat, v.lon, v.alt, v.hdop };
+    for(int j = 0; j < n; j++) {
+      bool present = (j < 12) || (j < 14 ? v.flags & PAYLOAD_VOC_NOX : v.flags & PAYLOAD_GNSS);
+      // float values are only as exact as their own precision
+      double tolerance = f[j].step * 1.001 + fabs(want[j]) * 1e-6;
+      if(present && fabs(got[j] - want[j]) > tolerance) {
+        fprintf(stderr, "payload %d: field %d is %.7f, encoded %.7f\n", i, j, got[j], want[j]);
+        failures++;
+      }
+    }
+  }
+  return(failures == 0);
+}
+
+static void printHeader() {
+  printf("%-20s %6s %6s %6s %6s %6s %9s %6s %7s %6s %10s %6s %8s %8s %7s\n",
+         "scenario", "days", "wakes", "timer", "motion", "ulp", "awake[s]", "awake%", "gnss[s]",
+         "uplink", "airtime[s]", "joins", "flash[kB]", "writes/d", "records");
+}
+
+static void printReport() {
+  const SimStats &s = sim->stats;
+  double days = scenario.duration / (86400.0 * SIM_US_PER_S);
+  printf("%-20s %6.1f %6u %6u %6u %6u %9.0f %6.2f %7.0f %6u %10.1f %3u/%-2u %8.1f %8.1f %7u\n",
+         scenario.name, days, s.wakes, s.timerWakes, s.motionWakes, s.ulpWakes, s.awakeUs / 1e6,
+         100.0 * s.awakeUs / scenario.duration, s.gnssOnUs / 1e6, s.uplinks, s.airtimeUs / 1e6,
+         s.joinAccepts, s.joinRequests, s.flashBytes / 1024.0, s.flashWrites / days, s.records);
+}
+
+// ============= Scenario files =============
+
+// parses durations such as 90, 30s, 15m, 2h, 1d6h
+static bool parseDuration(const char* str, uint64_t &us) {
+  us = 0;
+  const char* p = str;
+  while(*p) {
+    char* end;
+    double v = strtod(p, &end);
+    if(end == p) {
+      return(false);
+    }
+    uint64_t unit = SIM_US_PER_S;
+    switch(*end) {
+      case 's': end++; break;
+      case 'm': unit *= 60;     end++; break;
+      case 'h': unit *= 3600;   end++; break;
+      case 'd': unit *= 86400;  end++; break;
+      case '\0': break;
+      default: return(false);
+    }
+    us += (uint64_t)(v * unit);
+    p = end;
+  }
+  return(true);
+}
+
+// A scenario is a text file with one keyword per line ('#' starts a comment):
+//   duration <t>                 simulated time (default 7d)
+//   dip <bbb>                    DIP switch positions, 1 = on
+//   battery <mV> [<mV>]          battery voltage at the start and end of the scenario
+//   gnss <t> | none              time to first fix after power-on of the receiver
+//   join-fail <n>                number of JoinRequests that go unanswered
+//   uplink-loss <pct>            share of confirmed uplinks that are not acknowledged
+//   sd                           an SD card is inserted
+//   wifi                         the configured network is in range
+//   epoch <unix>                 UTC time at the start, as reported by the GNSS
+//   motion <from> <to> [<t>]     accelerometer pulses every <t>, or a single one at <from>
+//   power-off <from> <to>        power switch turned off during this window
+//   set <key> <value>            configuration applied before the first boot
+static bool loadScenario(const char* file) {
+  FILE* f = fopen(file, "r");
+  if(!f) {
+    fprintf(stderr, "Cannot open scenario %s\n", file);
+    return(false);
+  }
+
+  scenario = SimScenario();
+  const char* base = strrchr(file, '/');
+  strncpy(scenario.name, base ? base + 1 : file, sizeof(scenario.name) - 1);
+  char* dot = strrchr(scenario.name, '.');
+  if(dot) {
+    *dot = '\0';
+  }
+
+  char line[256];
+  int lineNum = 0;
+  bool ok = true;
+  while(ok && fgets(line, sizeof(line), f)) {
+    lineNum++;
+    char* hash = strchr(line, '#');
+    if(hash) {
+      *hash = '\0';
+    }
+    char* argv[5] = { 0 };
+    int argc = 0;
+    for(char* tok = strtok(line, " \t\r\n"); tok && argc < 5; tok = strtok(NULL, " \t\r\n")) {
+      argv[argc++] = tok;
+    }
+    if(argc == 0) {
+      continue;
+    }
+
+    uint64_t a, b, c;
+    const char* cmd = argv[0];
+    if(!strcmp(cmd, "duration") && argc == 2) {
+      ok = parseDuration(argv[1], scenario.duration);
+    } else
+    if(!strcmp(cmd, "dip") && argc == 2 && strlen(argv[1]) == 3) {
+      for(int i = 0; i < 3; i++) {
+        scenario.dip[i] = (argv[1][i] == '1');
+      }
+    } else
+    if(!strcmp(cmd, "battery") && (argc == 2 || argc == 3)) {
+      scenario.battStart = atoi(argv[1]);
+      scenario.battEnd = argc == 3 ? atoi(argv[2]) : scenario.battStart;
+    } else
+    if(!strcmp(cmd, "gnss") && argc == 2) {
+      if(!strcmp(argv[1], "none")) {
+        scenario.gnssFixDelay = -1;
+      } else {
+        ok = parseDuration(argv[1], a);
+        scenario.gnssFixDelay = a;
+      }
+    } else
+    if(!strcmp(cmd, "join-fail") && argc == 2) {
+      scenario.joinFailures = atoi(argv[1]);
+    } else
+    if(!strcmp(cmd, "uplink-loss") && argc == 2) {
+      scenario.uplinkLossPct = atoi(argv[1]);
+    } else
+    if(!strcmp(cmd, "sd") && argc == 1) {
+      scenario.sdCard = true;
+    } else
+    if(!strcmp(cmd, "wifi") && argc == 1) {
+      scenario.wifi = true;
+    } else
+    if(!strcmp(cmd, "epoch") && argc == 2) {
+      scenario.epoch = atoll(argv[1]);
+    } else
+    if(!strcmp(cmd, "motion") && (argc == 3 || argc == 4) && scenario.numMotion < SIM_MAX_MOTION) {
+      c = 0;
+      ok = parseDuration(argv[1], a) && parseDuration(argv[2], b) && (argc == 3 || parseDuration(argv[3], c));
+      scenario.motion[scenario.numMotion++] = { a, b, c };
+    } else
+    if(!strcmp(cmd, "power-off") && argc == 3 && scenario.numPowerOff < SIM_MAX_POWEROFF) {
+      ok = parseDuration(argv[1], a) && parseDuration(argv[2], b);
+      scenario.powerOff[scenario.numPowerOff++] = { a, b, 0 };
+    } else
+    if(!strcmp(cmd, "set") && argc == 3 && scenario.numSettings < SIM_MAX_SETTINGS) {
+      strncpy(scenario.settings[scenario.numSettings][0], argv[1], 71);
+      strncpy(scenario.settings[scenario.numSettings][1], argv[2], 71);
+      scenario.numSettings++;
+    } else {
+      ok = false;
+    }
+
+    if(!ok) {
+      fprintf(stderr, "%s:%d: invalid line\n", file, lineNum);
+    }
+  }
+  fclose(f);
+  return(ok);
+}
+
+int main(int argc, char** argv) {
+  setenv("TZ", "UTC", 1);
+  tzset();
+
+  int first = 1;
+  if(argc > 1 && !strcmp(argv[1], "-v")) {
+    simVerbose = true;
+    first++;
+  }
+  if(first >= argc) {
+    fprintf(stderr, "Usage: %s [-v] <scenario> [<scenario> ...]\n", argv[0]);
+    return(1);
+  }
+
+  if(!checkPayload()) {
+    return(1);
+  }
+
+  printHeader();
+  int failed = 0;
+  for(int i = first; i < argc; i++) {
+    if(!loadScenario(argv[i]) || !runScenario()) {
+      failed++;
+      continue;
+    }
+    printReport();
+  }
+
+  return(failed ? 1 : 0);
+}
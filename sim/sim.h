@@ -0,0 +1,140 @@
+#ifndef _SIM_H
+#define _SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Host simulation of the MJLO firmware.
+// Every wake of the device runs setup() and loop() in a forked child process until
+// esp_deep_sleep_start() is called; the RTC memory image, the requested wake sources
+// and the statistics are handed back to the parent through shared memory.
+// Time is virtual: delay() and all blocking driver calls advance the clock instantly.
+
+#define SIM_US_PER_S       1000000ULL
+#define SIM_MAX_RTC        (16 * 1024)
+#define SIM_MAX_MOTION     64
+#define SIM_MAX_POWEROFF   16
+#define SIM_MAX_SETTINGS   32
+#define SIM_ULP_WORDS      128      // RTC slow memory reserved for the ULP
+#define SIM_MAX_READINGS   64       // SCD41 readings kept to check the time of an uplink
+
+struct SimWindow {
+  uint64_t start;       // virtual time (us since power-on)
+  uint64_t end;
+  uint64_t period;      // motion pulse period, 0 = single pulse
+};
+
+struct SimScenario {
+  char name[64];
+  uint64_t duration = 7 * 24 * 3600 * SIM_US_PER_S;
+  uint8_t dip[3] = { 0, 0, 0 };             // DIP1..DIP3 switch positions, 1 = on
+  uint16_t battStart = 4000;                // battery voltage at start (mV)
+  uint16_t battEnd = 3800;                  // battery voltage at end of the scenario (mV)
+  int64_t gnssFixDelay = 35 * SIM_US_PER_S; // time from GNSS power-on to first fix, -1 = never
+  uint32_t joinFailures = 0;                // number of JoinRequests that are not answered
+  uint32_t uplinkLossPct = 0;               // percentage of confirmed uplinks that are not acked
+  bool sdCard = false;
+  bool wifi = false;                        // a network is in range, see sim/mock/network.cpp
+  time_t epoch = 1748844000;                // UTC time at power-on, as seen by GNSS
+
+  SimWindow motion[SIM_MAX_MOTION];
+  int numMotion = 0;
+  SimWindow powerOff[SIM_MAX_POWEROFF];
+  int numPowerOff = 0;
+
+  char settings[SIM_MAX_SETTINGS][2][72];   // key, value pairs applied before first boot
+  int numSettings = 0;
+};
+
+struct SimStats {
+  uint32_t wakes;
+  uint32_t timerWakes;
+  uint32_t motionWakes;
+  uint32_t buttonWakes;
+  uint32_t ulpWakes;
+  uint64_t awakeUs;
+  uint64_t gnssOnUs;
+  uint32_t uplinks;
+  uint32_t records;         // measurements in the uplinks, more than one per batch
+  uint32_t joinRequests;
+  uint32_t joinAccepts;
+  uint64_t airtimeUs;
+  uint32_t nvsWrites;
+  uint32_t flashWrites;
+  uint64_t flashBytes;
+  uint32_t payloadErrors;   // uplinks that do not decode to the same bytes, see RadioLib.cpp
+  uint32_t timeErrors;      // measurements that decode to the wrong time, see RadioLib.cpp
+};
+
+struct SimReading {
+  time_t utc;
+  float temp;
+};
+
+enum SimExit {
+  SIM_EXIT_SLEEP,
+  SIM_EXIT_RESTART,
+  SIM_EXIT_TIMEOUT,
+  SIM_EXIT_PROVISIONED,
+};
+
+// state shared between the parent and the child process for a single wake
+struct SimShared {
+  SimStats stats;
+  uint8_t rtc[SIM_MAX_RTC];
+
+  uint64_t nowUs;             // virtual monotonic time since power-on
+  int64_t clockOffsetUs;      // device wall clock = nowUs + clockOffsetUs
+  int wakeCause;              // esp_sleep_wakeup_cause_t for the next boot
+  uint64_t ext1Status;
+
+  int exitReason;             // SimExit
+  uint64_t timerUs;           // requested timer wake-up, 0 = disabled
+  int ext0Pin;                // -1 = disabled
+  int ext0Level;
+  uint64_t ext1Mask;
+  int ext1Mode;
+  bool ulpWake;               // ULP wake-up enabled
+
+  // the ULP coprocessor keeps running across wakes
+  uint32_t ulpMem[SIM_ULP_WORDS];
+  uint32_t ulpEntry;
+  uint64_t ulpPeriodUs;
+  bool ulpRunning;
+  bool ulpDivider;            // battery divider enabled by the ULP, reads 0 when off
+
+  // the last SCD41 readings, of which each measurement in an uplink must be one
+  SimReading readings[SIM_MAX_READINGS];
+  uint32_t numReadings;
+};
+
+extern SimScenario scenario;
+extern SimShared* sim;
+#define simStats (sim->stats)
+extern bool simVerbose;
+
+// virtual time
+uint64_t simNow();
+void simAdvance(uint64_t us);
+void simWaitUntil(uint64_t us);
+bool simIsMainThread();
+void simThreadStarted();
+void simThreadStopped();
+
+// hardware model
+int simPinLevel(uint8_t pin);
+uint16_t simBatteryMillivolts();
+uint16_t simBatteryMillivoltsAt(uint64_t t);
+uint16_t simAdcCounts(uint32_t pinMillivolts);
+bool simUlpRun(uint64_t t);
+bool simPowerSwitchOn(uint64_t t);
+uint64_t simNextMotion(uint64_t from);
+time_t simUtc();
+void simGnssPower(bool on);
+bool simGnssHasFix();
+
+// process control
+const char* simPath(const char* sub);
+void simExit(SimExit reason) __attribute__((noreturn));
+
+#endif
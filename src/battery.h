@@ -0,0 +1,177 @@
+#ifndef _BATTERY_H
+#define _BATTERY_H
+
+#include <Arduino.h>
+#include "esp32s3/ulp.h"
+#include "ulp_adc.h"
+#include "driver/rtc_io.h"
+#include "soc/rtc_io_reg.h"
+#include "esp_sleep.h"
+#include "pins.h"
+#include "config.h"
+
+// During deep sleep, the ULP coprocessor samples the battery voltage, keeps
+// min/avg/max statistics and wakes the main cores when the voltage crosses a
+// threshold. The program is built with the FSM macros, as the Arduino build
+// cannot compile and embed a ULP-RISC-V binary.
+
+#define ULP_PERIOD_US       (60 * 1000000UL)    // battery sampling interval during sleep
+#define ULP_BATT_CHANNEL    ADC_CHANNEL_0       // BAT_ADC is GPIO1 = ADC1 channel 0
+#define BATT_DIVIDER        4.9f
+#define ULP_BATT_SETTLE     17500               // cycles (~1 ms) for the divider to settle before sampling
+#define BATT_EMPTY_MV       2750                // below this, the device goes into low power mode
+#define BATT_WAKE_EMPTY_MV  2700                // wake from sleep to go into low power mode
+#define BATT_RESUME_MV      3300                // wake from low power mode once recharged
+
+// variables at the start of RTC slow memory, of which the ULP uses the lower 16 bits
+enum UlpVariables {
+  ULP_BATT_LOW,       // wake when a sample is below this raw value
+  ULP_BATT_HIGH,      // wake when a sample is above this raw value
+  ULP_BATT_LAST,
+  ULP_BATT_MIN,
+  ULP_BATT_MAX,
+  ULP_BATT_SUM_LO,
+  ULP_BATT_SUM_HI,
+  ULP_BATT_COUNT,
+  ULP_PROG_START
+};
+
+// battery voltage per raw ADC count, calibrated before going to sleep
+RTC_DATA_ATTR float ulpMillivoltsPerCount = 0;
+
+struct BatteryStats {
+  uint16_t min, avg, max;   // mV
+  uint16_t count;           // number of samples
+};
+
+static inline uint16_t ulpVar(int var) {
+  return(RTC_SLOW_MEM[var] & 0xFFFF);
+}
+
+// statistics of the battery voltage during the last deep sleep
+bool ulpBatteryStats(BatteryStats &stats) {
+  stats.count = ulpVar(ULP_BATT_COUNT);
+  if(ulpMillivoltsPerCount == 0 || stats.count == 0) {
+    return(false);
+  }
+  uint32_t sum = ((uint32_t)ulpVar(ULP_BATT_SUM_HI) << 16) | ulpVar(ULP_BATT_SUM_LO);
+  stats.min = ulpVar(ULP_BATT_MIN) * ulpMillivoltsPerCount;
+  stats.avg = (sum / stats.count) * ulpMillivoltsPerCount;
+  stats.max = ulpVar(ULP_BATT_MAX) * ulpMillivoltsPerCount;
+  return(true);
+}
+
+// start sampling the battery, waking when it drops below lowMv or rises above highMv
+// a threshold of 0 disables that check
+void ulpStart(uint16_t lowMv, uint16_t highMv) {
+  // the ULP reads raw counts, so calibrate these against the corrected reading
+  uint16_t raw = analogRead(BAT_ADC);
+  uint16_t mv = analogReadMilliVolts(BAT_ADC) * BATT_DIVIDER;
+  if(raw == 0) {
+    return;
+  }
+  ulpMillivoltsPerCount = (float)mv / raw;
+
+  const ulp_insn_t program[] = {
+    I_MOVI(R3, 0),                    // R3 = base address of the variables
+
+    // the divider draws current, so only enable it (BAT_CTRL pullup) around the sample
+    I_WR_REG(RTC_IO_TOUCH_PAD2_REG, RTC_IO_TOUCH_PAD2_RUE_S, RTC_IO_TOUCH_PAD2_RUE_S, 1),
+    I_DELAY(ULP_BATT_SETTLE),
+    I_ADC(R0, 0, ULP_BATT_CHANNEL),   // R0 = battery sample
+    I_WR_REG(RTC_IO_TOUCH_PAD2_REG, RTC_IO_TOUCH_PAD2_RUE_S, RTC_IO_TOUCH_PAD2_RUE_S, 0),
+    I_ST(R0, R3, ULP_BATT_LAST),
+
+    // min: overflow if sample < min
+    I_LD(R1, R3, ULP_BATT_MIN),
+    I_SUBR(R2, R0, R1),
+    M_BXF(1),
+    M_BX(2),
+    M_LABEL(1),
+    I_ST(R0, R3, ULP_BATT_MIN),
+    M_LABEL(2),
+
+    // max: overflow if max < sample
+    I_LD(R1, R3, ULP_BATT_MAX),
+    I_SUBR(R2, R1, R0),
+    M_BXF(3),
+    M_BX(4),
+    M_LABEL(3),
+    I_ST(R0, R3, ULP_BATT_MAX),
+    M_LABEL(4),
+
+    // 32-bit sum and sample count for the average
+    I_LD(R1, R3, ULP_BATT_SUM_LO),
+    I_ADDR(R1, R1, R0),
+    I_ST(R1, R3, ULP_BATT_SUM_LO),
+    M_BXF(5),
+    M_BX(6),
+    M_LABEL(5),
+    I_LD(R1, R3, ULP_BATT_SUM_HI),
+    I_ADDI(R1, R1, 1),
+    I_ST(R1, R3, ULP_BATT_SUM_HI),
+    M_LABEL(6),
+    I_LD(R1, R3, ULP_BATT_COUNT),
+    I_ADDI(R1, R1, 1),
+    I_ST(R1, R3, ULP_BATT_COUNT),
+
+    // thresholds: wake the main cores and stop sampling
+    I_LD(R1, R3, ULP_BATT_LOW),
+    I_SUBR(R2, R0, R1),
+    M_BXF(7),
+    I_LD(R1, R3, ULP_BATT_HIGH),
+    I_SUBR(R2, R1, R0),
+    M_BXF(7),
+    I_HALT(),
+    M_LABEL(7),
+    I_WAKE(),
+    I_END(),
+    I_HALT(),
+  };
+
+  // release the ADC from the Arduino driver, so that it can be handed to the ULP
+  perimanClearPinBus(BAT_ADC);
+
+  ulp_adc_cfg_t cfg = {
+    .adc_n = ADC_UNIT_1,
+    .channel = ULP_BATT_CHANNEL,
+    .atten = ADC_ATTEN_DB_12,
+    .width = ADC_BITWIDTH_DEFAULT,
+    .ulp_mode = ADC_ULP_MODE_FSM,
+  };
+  if(ulp_adc_init(&cfg) != ESP_OK) {
+    PRINTF("[ULP] Failed to configure ADC\n");
+    return;
+  }
+
+  // hand BAT_CTRL to the RTC domain with the divider off, the ULP enables it for each sample
+  static_assert(BAT_CTRL == 2, "the ULP program writes the pad register of RTC GPIO 2");
+  rtc_gpio_init((gpio_num_t)BAT_CTRL);
+  rtc_gpio_set_direction((gpio_num_t)BAT_CTRL, RTC_GPIO_MODE_INPUT_ONLY);
+  rtc_gpio_pullup_dis((gpio_num_t)BAT_CTRL);
+
+  RTC_SLOW_MEM[ULP_BATT_LOW] = lowMv / ulpMillivoltsPerCount;
+  RTC_SLOW_MEM[ULP_BATT_HIGH] = highMv ? (uint16_t)(highMv / ulpMillivoltsPerCount) : 0xFFFF;
+  RTC_SLOW_MEM[ULP_BATT_LAST] = raw;
+  RTC_SLOW_MEM[ULP_BATT_MIN] = 0xFFFF;
+  RTC_SLOW_MEM[ULP_BATT_MAX] = 0;
+  RTC_SLOW_MEM[ULP_BATT_SUM_LO] = 0;
+  RTC_SLOW_MEM[ULP_BATT_SUM_HI] = 0;
+  RTC_SLOW_MEM[ULP_BATT_COUNT] = 0;
+
+  size_t size = sizeof(program) / sizeof(ulp_insn_t);
+  if(ulp_process_macros_and_load(ULP_PROG_START, program, &size) != ESP_OK) {
+    PRINTF("[ULP] Failed to load program\n");
+    return;
+  }
+  ulp_set_wakeup_period(0, ULP_PERIOD_US);
+  ulp_run(ULP_PROG_START);
+  esp_sleep_enable_ulp_wakeup();
+}
+
+void ulpStop() {
+  ulp_timer_stop();
+  RTC_SLOW_MEM[ULP_BATT_COUNT] = 0;
+}
+
+#endif
@@ -1,4 +1,6 @@
 #include <Arduino.h>
+#include <type_traits>
+#include "esp_rom_crc.h"
 #include "config.h"
 #include "config_manager.h"
 
@@ -22,55 +24,88 @@ esp_sleep_wakeup_cause_t wakeup_reason;
 Preferences store;
 Config cfg;
 
+// Snapshot of the parsed cfg, kept in RTC memory such that a wake from deep sleep
+// does not need to read and parse all settings from NVS again
+static_assert(std::is_trivially_copyable<Config>::value, "Config must be copyable into RTC memory");
+RTC_DATA_ATTR uint8_t cfgSnapshot[sizeof(Config)] = { 0 };
+RTC_DATA_ATTR uint32_t cfgSnapshotCrc = 0;
+RTC_DATA_ATTR uint32_t cfgSnapshotGeneration = 0;
+RTC_DATA_ATTR uint32_t cfgGeneration = 1;
+
 // ============= Settings Metadata =============
-// Define all settings with their metadata (name, group, default, validator)
-const SettingMetadata settingsMetadata[] = {
+// Define all settings with their metadata (name, group, default, validator, max length)
+constexpr SettingMetadata settingsMetadata[] = {
   // LoRaWAN Settings
-  { "version",      "Version",       GROUP_LORAWAN, "1.1",            validateVersion },
-  { "method",       "Method",        GROUP_LORAWAN, "OTAA",           validateMethod },
-  { "relay",        "Relay",         GROUP_LORAWAN, "OFF",            validateRelay },
+  { "version",      "Version",       GROUP_LORAWAN, "1.1",            validateVersion,  6 },
+  { "method",       "Method",        GROUP_LORAWAN, "OTAA",           validateMethod,   4 },
+  { "relay",        "Relay",         GROUP_LORAWAN, "OFF",            validateRelay,   11 },
   
   // Uplink Settings
-  { "adr",          "ADR",           GROUP_UPLINK,  "OFF",            validateADR },
-  { "dr",           "DR",            GROUP_UPLINK,  "5",              validateDataRate },
-  { "dbm",          "dBm",           GROUP_UPLINK,  "16",             validateDBm },
-  { "confirmed",    "Confirmed",     GROUP_UPLINK,  "0",              validateBoolean },
-  { "interval",     "Interval",      GROUP_UPLINK,  "fixed,30",       validateInterval },
-  { "sleep",        "Sleep",         GROUP_UPLINK,  "1",              validateBoolean },
-  { "operation",    "Operation",     GROUP_UPLINK,  "mobile,5",       validateOperation },
-  { "timeout",      "Timeout",       GROUP_UPLINK,  "120",            validateTimeout },
+  { "adr",          "ADR",           GROUP_UPLINK,  "OFF",            validateADR,     64 },
+  { "dr",           "DR",            GROUP_UPLINK,  "5",              validateDataRate,  9 },
+  { "dbm",          "dBm",           GROUP_UPLINK,  "16",             validateDBm,      3 },
+  { "confirmed",    "Confirmed",     GROUP_UPLINK,  "0",              validateBoolean,  3 },
+  { "interval",     "Interval",      GROUP_UPLINK,  "fixed,30",       validateInterval, 16 },
+  { "batch",        "Batch",         GROUP_UPLINK,  "1",              validateBatch,    2 },
+  { "sleep",        "Sleep",         GROUP_UPLINK,  "1",              validateBoolean,  3 },
+  { "operation",    "Operation",     GROUP_UPLINK,  "mobile,5",       validateOperation, 16 },
+  { "timeout",      "Timeout",       GROUP_UPLINK,  "120",            validateTimeout,  4 },
+  { "retention",    "Retention",     GROUP_UPLINK,  "0",              validateRetention, 4 },
   
   // OTAA Activation
-  { "deveui",       "DevEUI",        GROUP_ACTIVATION_OTAA, "",       validateHex16 },
-  { "joineui",      "JoinEUI",       GROUP_ACTIVATION_OTAA, "",       validateHex16 },
-  { "appkey",       "AppKey",        GROUP_ACTIVATION_OTAA, "",       validateHex32 },
-  { "nwkkey",       "NwkKey",        GROUP_ACTIVATION_OTAA, "",       validateHex32 },
+  { "deveui",       "DevEUI",        GROUP_ACTIVATION_OTAA, "",       validateHex16,   16 },
+  { "joineui",      "JoinEUI",       GROUP_ACTIVATION_OTAA, "",       validateHex16,   16 },
+  { "appkey",       "AppKey",        GROUP_ACTIVATION_OTAA, "",       validateHex32,   32 },
+  { "nwkkey",       "NwkKey",        GROUP_ACTIVATION_OTAA, "",       validateHex32,   32 },
   
   // ABP Activation
-  { "devaddr",      "DevAddr",       GROUP_ACTIVATION_ABP,  "",       validateHex8 },
-  { "appskey",      "AppSKey",       GROUP_ACTIVATION_ABP,  "",       validateHex32 },
-  { "nwksenckey",   "NwkSEncKey",    GROUP_ACTIVATION_ABP,  "",       validateHex32 },
-  { "fnwksintkey",  "FNwkSIntKey",   GROUP_ACTIVATION_ABP,  "",       validateHex32 },
-  { "snwksintkey",  "SNwkSIntKey",   GROUP_ACTIVATION_ABP,  "",       validateHex32 },
+  { "devaddr",      "DevAddr",       GROUP_ACTIVATION_ABP,  "",       validateHex8,     8 },
+  { "appskey",      "AppSKey",       GROUP_ACTIVATION_ABP,  "",       validateHex32,   32 },
+  { "nwksenckey",   "NwkSEncKey",    GROUP_ACTIVATION_ABP,  "",       validateHex32,   32 },
+  { "fnwksintkey",  "FNwkSIntKey",   GROUP_ACTIVATION_ABP,  "",       validateHex32,   32 },
+  { "snwksintkey",  "SNwkSIntKey",   GROUP_ACTIVATION_ABP,  "",       validateHex32,   32 },
   
   // 2.4GHz WiFi Settings
-  { "name",         "Name",          GROUP_WIFI_2G4,        "LRF-1",  validateName },
-  { "ssid",         "SSID",          GROUP_WIFI_2G4,        "LoRangeFinder-1", validateSSID },
-  { "pass",         "Pass",          GROUP_WIFI_2G4,        "L0R4ngeF1nder",   validatePassword },
-  { "user",         "User",          GROUP_WIFI_2G4,        "",       validateUser },
+  { "name",         "Name",          GROUP_WIFI_2G4,        "LRF-1",  validateName,    16 },
+  { "ssid",         "SSID",          GROUP_WIFI_2G4,        "LoRangeFinder-1", validateSSID, 32 },
+  { "pass",         "Pass",          GROUP_WIFI_2G4,        "L0R4ngeF1nder",   validatePassword, 64 },
+  { "user",         "User",          GROUP_WIFI_2G4,        "",       validateUser,    64 },
+  { "ip",           "IP",            GROUP_WIFI_2G4,        "",       validateIP,      47 },
+  { "publish",      "Publish",       GROUP_WIFI_2G4,        "",       validatePublish, 96 },
   
   // Time Settings
-  { "timezone",     "Timezone",      GROUP_TIME,            "60",     validateTimezone },
-  { "dst",          "DST",           GROUP_TIME,            "0",      validateDST },
+  { "timezone",     "Timezone",      GROUP_TIME,            "60",     validateTimezone,  6 },
+  { "dst",          "DST",           GROUP_TIME,            "0",      validateDST,      3 },
 };
 
 const uint16_t NUM_SETTINGS_METADATA = sizeof(settingsMetadata) / sizeof(SettingMetadata);
 
+// Settings are stored and looked up by the hash of their key, so these must be unique
+constexpr bool uniqueKeyHashes() {
+  for (size_t i = 0; i < sizeof(settingsMetadata) / sizeof(SettingMetadata); i++) {
+    for (size_t j = 0; j < i; j++) {
+      if (hashKey(settingsMetadata[i].key) == hashKey(settingsMetadata[j].key)) return false;
+    }
+  }
+  return true;
+}
+static_assert(uniqueKeyHashes(), "Setting keys must have unique hashes");
+static_assert(sizeof(settingsMetadata) / sizeof(SettingMetadata) <= CFG_MAX_SETTINGS, "Too many settings");
+
 // Global ConfigManager instance
 ConfigManager configMgr(settingsMetadata, NUM_SETTINGS_METADATA);
 
 // ============= Helper Functions =============
 
+// Mark whether an activation key has a value
+static void setKeyFlag(uint16_t flag, bool isSet) {
+  if (isSet) {
+    cfg.actvn.keys |= flag;
+  } else {
+    cfg.actvn.keys &= ~flag;
+  }
+}
+
 // Apply a setting value to the cfg structure
 void applySetting(const char* key, const String& value) {
   String v = value;
@@ -187,6 +222,9 @@ void applySetting(const char* key, const String& value) {
       cfg.interval.fixed = true;
     }
   }
+  else if (strcmp(key, "batch") == 0) {
+    cfg.interval.batch = (uint8_t)v.toInt();
+  }
   else if (strcmp(key, "sleep") == 0) {
     v.toUpperCase();
     cfg.operation.sleep = (v == "Y" || v == "YES" || v == "ON" || v == "1");
@@ -208,47 +246,69 @@ void applySetting(const char* key, const String& value) {
   else if (strcmp(key, "timeout") == 0) {
     cfg.operation.timeout = (uint16_t)v.toInt();
   }
+  else if (strcmp(key, "retention") == 0) {
+    cfg.operation.retention = (uint16_t)v.toInt();
+  }
   // OTAA Activation
   else if (strcmp(key, "deveui") == 0) {
     if (v.length() > 0) cfg.actvn.otaa.devEUI = hexStringToUint64(v.c_str());
+    setKeyFlag(KEY_DEVEUI, v.length() > 0);
   }
   else if (strcmp(key, "joineui") == 0) {
     if (v.length() > 0) cfg.actvn.otaa.joinEUI = hexStringToUint64(v.c_str());
+    setKeyFlag(KEY_JOINEUI, v.length() > 0);
   }
   else if (strcmp(key, "appkey") == 0) {
     if (v.length() > 0) hexStringToByteArray(v.c_str(), cfg.actvn.otaa.appKey, 32);
+    setKeyFlag(KEY_APPKEY, v.length() > 0);
   }
   else if (strcmp(key, "nwkkey") == 0) {
     if (v.length() > 0) hexStringToByteArray(v.c_str(), cfg.actvn.otaa.nwkKey, 32);
+    setKeyFlag(KEY_NWKKEY, v.length() > 0);
   }
   // ABP Activation
   else if (strcmp(key, "devaddr") == 0) {
     if (v.length() > 0) cfg.actvn.abp.devAddr = hexStringToUint32(v.c_str());
+    setKeyFlag(KEY_DEVADDR, v.length() > 0);
   }
   else if (strcmp(key, "appskey") == 0) {
     if (v.length() > 0) hexStringToByteArray(v.c_str(), cfg.actvn.abp.appSKey, 32);
+    setKeyFlag(KEY_APPSKEY, v.length() > 0);
   }
   else if (strcmp(key, "nwksenckey") == 0) {
     if (v.length() > 0) hexStringToByteArray(v.c_str(), cfg.actvn.abp.nwkSEncKey, 32);
+    setKeyFlag(KEY_NWKSENCKEY, v.length() > 0);
   }
   else if (strcmp(key, "fnwksintkey") == 0) {
     if (v.length() > 0) hexStringToByteArray(v.c_str(), cfg.actvn.abp.fNwkSIntKey, 32);
+    setKeyFlag(KEY_FNWKSINTKEY, v.length() > 0);
   }
   else if (strcmp(key, "snwksintkey") == 0) {
     if (v.length() > 0) hexStringToByteArray(v.c_str(), cfg.actvn.abp.sNwkSIntKey, 32);
+    setKeyFlag(KEY_SNWKSINTKEY, v.length() > 0);
   }
   // WiFi Settings
   else if (strcmp(key, "name") == 0) {
-    cfg.wl2g4.name = v;
+    strlcpy(cfg.wl2g4.name, v.c_str(), sizeof(cfg.wl2g4.name));
   }
   else if (strcmp(key, "ssid") == 0) {
-    cfg.wl2g4.ssid = v;
+    strlcpy(cfg.wl2g4.ssid, v.c_str(), sizeof(cfg.wl2g4.ssid));
   }
   else if (strcmp(key, "pass") == 0) {
-    cfg.wl2g4.pass = v;
+    strlcpy(cfg.wl2g4.pass, v.c_str(), sizeof(cfg.wl2g4.pass));
   }
   else if (strcmp(key, "user") == 0) {
-    cfg.wl2g4.user = v;
+    strlcpy(cfg.wl2g4.user, v.c_str(), sizeof(cfg.wl2g4.user));
+  }
+  else if (strcmp(key, "ip") == 0) {
+    uint32_t addr[3] = { 0 };
+    if (!parseStaticIP(v.c_str(), addr)) memset(addr, 0, sizeof(addr));
+    cfg.wl2g4.ip = addr[0];
+    cfg.wl2g4.gateway = addr[1];
+    cfg.wl2g4.subnet = addr[2];
+  }
+  else if (strcmp(key, "publish") == 0) {
+    strlcpy(cfg.wl2g4.publish, v.c_str(), sizeof(cfg.wl2g4.publish));
   }
   // Time Settings
   else if (strcmp(key, "timezone") == 0) {
@@ -285,51 +345,78 @@ int doSetting(String &key, String &value) {
     if (meta) value = String(meta->defaultValue);
   }
   
-  int error = configMgr.set(key.c_str(), value);
+  int error = configMgr.set(key.c_str(), value.c_str());
   if (error == noError) {
     applySetting(key.c_str(), value);
+    cfgGeneration++;    // snapshot is outdated, reload from NVS on next wake
   }
   return error;
 }
 
 bool isValidGroupOTAA() {
-  return (configMgr.get("deveui").length() > 0 &&
-          configMgr.get("joineui").length() > 0 &&
-          configMgr.get("appkey").length() > 0 &&
-          (cfg.actvn.version != v11 || configMgr.get("nwkkey").length() > 0));
+  uint16_t keys = cfg.actvn.keys;
+  return ((keys & KEY_DEVEUI) &&
+          (keys & KEY_JOINEUI) &&
+          (keys & KEY_APPKEY) &&
+          (cfg.actvn.version != v11 || (keys & KEY_NWKKEY)));
 }
 
 bool isValidGroupABP() {
-  return (configMgr.get("devaddr").length() > 0 &&
-          configMgr.get("appskey").length() > 0 &&
-          configMgr.get("nwksenckey").length() > 0 &&
-          (cfg.actvn.version != v11 || configMgr.get("fnwksintkey").length() > 0) &&
-          (cfg.actvn.version != v11 || configMgr.get("snwksintkey").length() > 0));
+  uint16_t keys = cfg.actvn.keys;
+  return ((keys & KEY_DEVADDR) &&
+          (keys & KEY_APPSKEY) &&
+          (keys & KEY_NWKSENCKEY) &&
+          (cfg.actvn.version != v11 || (keys & KEY_FNWKSINTKEY)) &&
+          (cfg.actvn.version != v11 || (keys & KEY_SNWKSINTKEY)));
+}
+
+static uint32_t snapshotCrc() {
+  return esp_rom_crc32_le(cfgSnapshotGeneration, cfgSnapshot, sizeof(cfgSnapshot));
+}
+
+// Restore cfg from the RTC snapshot; fails if no settings were changed since it was taken
+static bool restoreConfigSnapshot() {
+  if (cfgSnapshotGeneration != cfgGeneration || snapshotCrc() != cfgSnapshotCrc) {
+    return false;
+  }
+  memcpy(&cfg, cfgSnapshot, sizeof(Config));
+  return true;
 }
 
-void loadConfig() {
+static void storeConfigSnapshot() {
+  memcpy(cfgSnapshot, &cfg, sizeof(Config));
+  cfgSnapshotGeneration = cfgGeneration;
+  cfgSnapshotCrc = snapshotCrc();
+}
+
+// Load the configuration; when fromSnapshot is set (e.g. on a wake from deep sleep),
+// the parsed configuration is taken from RTC memory if it is still valid
+void loadConfig(bool fromSnapshot) {
+  if (fromSnapshot && restoreConfigSnapshot()) {
+    return;
+  }
+
   configMgr.load();
   
   // Apply all loaded settings to cfg structure
   for (uint16_t i = 0; i < NUM_SETTINGS_METADATA; i++) {
-    String value = configMgr.getByIndex(i);
-    applySetting(settingsMetadata[i].key, value);
+    applySetting(settingsMetadata[i].key, configMgr.getValue(i));
   }
+
+  storeConfigSnapshot();
 }
 
 String printConfig(int group) {
   return configMgr.printSettings(group);
 }
 
-String printFullConfig(bool inclVersion) {
-  String ret = "";
+void printFullConfig(Print& out, bool inclVersion) {
   if (inclVersion) {
-    ret += ("\r\nMJLO by Steven @ Ichthus\r\nFirmware " MJLO_VERSION "\r\nCompiled " __DATE__ "\r\n");
+    out.print("\r\nMJLO by Steven @ Ichthus\r\nFirmware " MJLO_VERSION "\r\nCompiled " __DATE__ "\r\n");
   }
   for (int i = 0; i < GROUP_COUNT; i++) {
-    ret += printConfig(i);
+    configMgr.printSettings(out, i);
   }
-  return ret;
 }
 
 String parseError(int errorCode) {
@@ -61,9 +61,23 @@ struct KeysABP {
   uint8_t sNwkSIntKey[16];
 };
 
+// flags for the activation keys that have a (non-empty) value configured
+enum KeyFlags {
+  KEY_DEVEUI      = BIT(0),
+  KEY_JOINEUI     = BIT(1),
+  KEY_APPKEY      = BIT(2),
+  KEY_NWKKEY      = BIT(3),
+  KEY_DEVADDR     = BIT(4),
+  KEY_APPSKEY     = BIT(5),
+  KEY_NWKSENCKEY  = BIT(6),
+  KEY_FNWKSINTKEY = BIT(7),
+  KEY_SNWKSINTKEY = BIT(8)
+};
+
 struct CfgActivation {
   bool version = v11;
   bool method = OTAA;
+  uint16_t keys = 0;    // KeyFlags
   KeysOTAA otaa;
   KeysABP abp;
 };
@@ -88,6 +102,7 @@ struct CfgInterval {
   bool fixed = true;
   uint32_t period = 60;
   uint32_t dutycycle = 864;
+  uint8_t batch = 1;      // measurements per uplink when stationary, see payloadBatch()
 };
 
 struct CfgOperation {
@@ -96,13 +111,19 @@ struct CfgOperation {
   uint8_t uplinks = 5;// number of uplinks when no motion in mobile mode
   uint32_t heartbeat = 600;
   uint16_t timeout = 120;
+  uint16_t retention = 0;   // days of measurement logs to keep, 0 = until storage is full
 };
 
+// fixed-size strings so that the Config struct can be copied into RTC memory
 struct Cfg2G4 {
-  String name;
-  String ssid;
-  String pass;
-  String user;
+  char name[17];
+  char ssid[33];
+  char pass[65];
+  char user[65];
+  uint32_t ip = 0;      // static address, gateway and subnet mask; 0 to use DHCP
+  uint32_t gateway = 0;
+  uint32_t subnet = 0;
+  char publish[97];     // endpoint for the measurements when on WiFi, see publish.h
 };
 
 struct Config {
@@ -118,6 +139,9 @@ struct Config {
 
 extern Config cfg;
 
+// incremented whenever a setting is changed, invalidating the RTC snapshot of cfg
+extern RTC_DATA_ATTR uint32_t cfgGeneration;
+
 // Settings metadata and count (defined in config.cpp)
 extern const SettingMetadata settingsMetadata[];
 extern const uint16_t NUM_SETTINGS_METADATA;
@@ -126,9 +150,9 @@ extern const uint16_t NUM_SETTINGS_METADATA;
 int doSetting(String &key, String &value);
 bool isValidGroupOTAA();
 bool isValidGroupABP();
-void loadConfig();
+void loadConfig(bool fromSnapshot = false);
 String printConfig(int group);
-String printFullConfig(bool inclVersion);
+void printFullConfig(Print& out, bool inclVersion);
 String parseError(int errorCode);
 int execCommand(String &command);
 
@@ -1,148 +1,161 @@
+#include <initializer_list>
 #include "config_manager.h"
 #include "config.h"
+#include "publish.h"
+#include "payload.h"
 
 // ============= Validators Implementation =============
 
-int validateVersion(const String& val) {
-  String v = val;
-  v.toLowerCase();
-  if (v == "1.0.4" || v == "0" || v == "1.0.4r" || v == "0r" || 
-      v == "1.1" || v == "1") {
+// Case-insensitive match against a list of accepted values
+static bool matchesAny(const char* val, std::initializer_list<const char*> options) {
+  for (const char* option : options) {
+    if (strcasecmp(val, option) == 0) return true;
+  }
+  return false;
+}
+
+static bool startsWith(const char* val, const char* prefix) {
+  return strncasecmp(val, prefix, strlen(prefix)) == 0;
+}
+
+static const char* skipSpaces(const char* val) {
+  while (*val == ' ' || *val == '\t') val++;
+  return val;
+}
+
+int validateVersion(const char* val) {
+  if (matchesAny(val, { "1.0.4", "0", "1.0.4r", "0r", "1.1", "1" })) {
     return noError;
   }
   return valueError;
 }
 
-int validateMethod(const String& val) {
-  String v = val;
-  v.toUpperCase();
-  if (v == "ABP" || v == "0" || v == "OTAA" || v == "1") {
+int validateMethod(const char* val) {
+  if (matchesAny(val, { "ABP", "0", "OTAA", "1" })) {
     return noError;
   }
   return valueError;
 }
 
-int validateRelay(const String& val) {
-  String v = val;
-  v.toUpperCase();
-  if (v == "OFF" || v == "0") return noError;
-  
+int validateRelay(const char* val) {
+  if (matchesAny(val, { "OFF", "0" })) return noError;
+
   uint8_t mode, smartlevel, backoff;
-  if (sscanf(val.c_str(), "%hhu,%hhu,%hhu", &mode, &smartlevel, &backoff) == 3) {
+  if (sscanf(val, "%hhu,%hhu,%hhu", &mode, &smartlevel, &backoff) == 3) {
     return noError;
   }
   return valueError;
 }
 
-int validateADR(const String& val) {
-  String v = val;
-  v.toUpperCase();
-  if (v == "N" || v == "NO" || v == "OFF" || v == "0" ||
-      v == "Y" || v == "YES" || v == "ON" || v == "1") {
+int validateADR(const char* val) {
+  if (matchesAny(val, { "N", "NO", "OFF", "0", "Y", "YES", "ON", "1" })) {
     return noError;
   }
-  if (v.startsWith("DR,") || v.startsWith("DBM,")) {
+  if (startsWith(val, "DR,") || startsWith(val, "DBM,")) {
     return noError;
   }
   return valueError;
 }
 
-int validateDataRate(const String& val) {
-  String v = val;
-  v.toUpperCase();
-  if (v == "0" || v == "SF12" || v == "SF12BW125" ||
-      v == "1" || v == "SF11" || v == "SF11BW125" ||
-      v == "2" || v == "SF10" || v == "SF10BW125" ||
-      v == "3" || v == "SF9" || v == "SF9BW125" ||
-      v == "4" || v == "SF8" || v == "SF8BW125" ||
-      v == "5" || v == "SF7" || v == "SF7BW125" ||
-      v == "6" || v == "SF7BW250" ||
-      v == "7" || v == "FSK") {
+int validateDataRate(const char* val) {
+  if (matchesAny(val, { "0", "SF12", "SF12BW125",
+                        "1", "SF11", "SF11BW125",
+                        "2", "SF10", "SF10BW125",
+                        "3", "SF9", "SF9BW125",
+                        "4", "SF8", "SF8BW125",
+                        "5", "SF7", "SF7BW125",
+                        "6", "SF7BW250",
+                        "7", "FSK" })) {
     return noError;
   }
   return valueError;
 }
 
-int validateDBm(const String& val) {
-  int valInt = val.toInt();
+int validateDBm(const char* val) {
+  int valInt = atoi(val);
   if (valInt >= -16 && valInt <= 16) {  // Default band is EU868 with max 16 dBm
     return noError;
   }
   return valueError;
 }
 
-int validateBoolean(const String& val) {
-  String v = val;
-  v.toUpperCase();
-  if (v == "N" || v == "NO" || v == "OFF" || v == "0" ||
-      v == "Y" || v == "YES" || v == "ON" || v == "1") {
+int validateBoolean(const char* val) {
+  if (matchesAny(val, { "N", "NO", "OFF", "0", "Y", "YES", "ON", "1" })) {
     return noError;
   }
   return valueError;
 }
 
-int validateInterval(const String& val) {
-  String v = val;
-  v.toLowerCase();
-  if (v.startsWith("dc,")) {
-    String subval = v.substring(3);
-    if (subval == "fup" || subval == "0.1%" || subval == "1%") {
+int validateInterval(const char* val) {
+  if (startsWith(val, "dc,")) {
+    const char* subval = val + 3;
+    if (matchesAny(subval, { "fup", "0.1%", "1%" })) {
       return noError;
     }
-    int num = subval.toInt();
+    int num = atoi(subval);
     if (num > 0 && num < 8640) return noError;
     return valueError;
   }
-  if (v.startsWith("fixed,")) {
-    String subval = v.substring(6);
-    int num = subval.toInt();
+  if (startsWith(val, "fixed,")) {
+    int num = atoi(val + 6);
     if (num >= 10 && num <= 65535) return noError;
     return valueError;
   }
   return valueError;
 }
 
-int validateOperation(const String& val) {
-  String v = val;
-  v.toLowerCase();
-  if (v == "stationary" || v == "0") return noError;
-  if (v == "mobile" || v == "1") return noError;
-  if (v.startsWith("mobile,") || v.startsWith("1,")) {
-    String subval = v.substring(v.indexOf(",") + 1);
-    int num = subval.toInt();
+int validateOperation(const char* val) {
+  if (matchesAny(val, { "stationary", "0" })) return noError;
+  if (matchesAny(val, { "mobile", "1" })) return noError;
+  if (startsWith(val, "mobile,") || startsWith(val, "1,")) {
+    int num = atoi(strchr(val, ',') + 1);
     if (num > 0 && num < 256) return noError;
     return valueError;
   }
   return valueError;
 }
 
-int validateTimeout(const String& val) {
-  if (val.length() == 0) return noError;
-  int timeout = val.toInt();
+int validateTimeout(const char* val) {
+  if (strlen(val) == 0) return noError;
+  int timeout = atoi(val);
   if (timeout < 0 || timeout > 3600) return valueError;
   return noError;
 }
 
-int validateHexString(const String& val, uint16_t expectedLength) {
-  if (val.length() > 0 && val.length() != expectedLength) return valueError;
-  if (val.length() > 0 && !isHexString(val)) return valueError;
+int validateRetention(const char* val) {
+  if (strlen(val) == 0) return noError;
+  int days = atoi(val);
+  if (days < 0 || days > 732) return valueError;   // STORAGE_MAX_DAYS
   return noError;
 }
 
-int validateTimezone(const String& val) {
-  String v = val;
-  v.trim();
-  if (v.length() == 0) return valueError;
+int validateBatch(const char* val) {
+  if (strlen(val) == 0) return noError;
+  int records = atoi(val);
+  if (records < 1 || records > PAYLOAD_BATCH_MAX) return valueError;
+  return noError;
+}
+
+int validateHexString(const char* val, uint16_t expectedLength) {
+  size_t len = strlen(val);
+  if (len > 0 && len != expectedLength) return valueError;
+  if (len > 0 && !isHexString(val)) return valueError;
+  return noError;
+}
+
+int validateTimezone(const char* val) {
+  const char* v = skipSpaces(val);
+  if (strlen(v) == 0) return valueError;
 
   int minutes = 0;
-  if (v.indexOf(":") >= 0) {
-    int colon = v.indexOf(":");
-    int hours = v.substring(0, colon).toInt();
-    int mins = v.substring(colon + 1).toInt();
-    if (hours < 0 || v.startsWith("-")) mins = -abs(mins);
+  const char* colon = strchr(v, ':');
+  if (colon) {
+    int hours = atoi(v);
+    int mins = atoi(colon + 1);
+    if (hours < 0 || v[0] == '-') mins = -abs(mins);
     minutes = hours * 60 + mins;
   } else {
-    int vInt = v.toInt();
+    int vInt = atoi(v);
     if (abs(vInt) <= 14) minutes = vInt * 60;
     else minutes = vInt;
   }
@@ -151,101 +164,247 @@ int validateTimezone(const String& val) {
   return noError;
 }
 
-int validateDST(const String& val) {
-  String v = val;
-  v.trim();
-  if (v.length() == 0) return valueError;
-  int vInt = v.toInt();
+int validateDST(const char* val) {
+  const char* v = skipSpaces(val);
+  if (strlen(v) == 0) return valueError;
+  int vInt = atoi(v);
   if (abs(vInt) <= 12) vInt = vInt * 60;
   if (vInt < 0 || vInt > 720) return valueError;
   return noError;
 }
 
-int validateName(const String& val) {
-  if (val.length() >= 4 && val.length() <= 16) return noError;
+int validateName(const char* val) {
+  size_t len = strlen(val);
+  if (len >= 4 && len <= 16) return noError;
   return valueError;
 }
 
-int validateSSID(const String& val) {
-  if (val.length() >= 1 && val.length() <= 32) return noError;
+int validateSSID(const char* val) {
+  size_t len = strlen(val);
+  if (len >= 1 && len <= 32) return noError;
   return valueError;
 }
 
-int validatePassword(const String& val) {
-  if (val.length() >= 8 && val.length() <= 64) return noError;
+int validatePassword(const char* val) {
+  size_t len = strlen(val);
+  if (len >= 8 && len <= 64) return noError;
   return valueError;
 }
 
-int validateUser(const String& val) {
-  if (val.length() <= 64) return noError;
+int validateUser(const char* val) {
+  if (strlen(val) <= 64) return noError;
   return valueError;
 }
 
-// Hex validators - each checks format and expected length
-int validateHex8(const String& val) {
-  if (val.length() > 0 && val.length() != 8) return valueError;
-  if (val.length() > 0 && !isHexString(val)) return valueError;
-  return noError;
+static const char* parseIPv4(const char* val, uint32_t& addr) {
+  addr = 0;
+  for (int i = 0; i < 4; i++) {
+    if (!isdigit((unsigned char)*val)) return nullptr;
+    int octet = 0;
+    while (isdigit((unsigned char)*val) && octet <= 255) octet = octet * 10 + (*val++ - '0');
+    if (octet > 255) return nullptr;
+    addr |= (uint32_t)octet << (8 * i);
+    if (i < 3 && *val++ != '.') return nullptr;
+  }
+  return val;
+}
+
+bool parseStaticIP(const char* val, uint32_t addr[3]) {
+  const char* v = skipSpaces(val);
+  addr[2] = 0x00FFFFFF;   // 255.255.255.0
+  for (int i = 0; i < 3; i++) {
+    v = parseIPv4(skipSpaces(v), addr[i]);
+    if (!v) return false;
+    v = skipSpaces(v);
+    if (*v == '\0') return i >= 1;
+    if (*v++ != ',') return false;
+  }
+  return false;
 }
 
-int validateHex16(const String& val) {
-  if (val.length() > 0 && val.length() != 16) return valueError;
-  if (val.length() > 0 && !isHexString(val)) return valueError;
+int validateIP(const char* val) {
+  uint32_t addr[3];
+  if (strlen(skipSpaces(val)) == 0) return noError;   // DHCP
+  if (!parseStaticIP(val, addr)) return valueError;
   return noError;
 }
 
-int validateHex32(const String& val) {
-  if (val.length() > 0 && val.length() != 32) return valueError;
-  if (val.length() > 0 && !isHexString(val)) return valueError;
+int validatePublish(const char* val) {
+  PublishEndpoint ep;
+  if (strlen(val) == 0) return noError;   // not published
+  if (!publishParseEndpoint(val, ep)) return valueError;
   return noError;
 }
 
+// Hex validators - each checks format and expected length
+int validateHex8(const char* val) {
+  return validateHexString(val, 8);
+}
+
+int validateHex16(const char* val) {
+  return validateHexString(val, 16);
+}
+
+int validateHex32(const char* val) {
+  return validateHexString(val, 32);
+}
+
 // ============= ConfigManager Implementation =============
 
 ConfigManager::ConfigManager(const SettingMetadata* meta, uint16_t count)
-  : metadata(meta), metadataCount(count), isDirty(false), inTransaction(false) {
+  : metadata(meta), metadataCount(count), isDirty(false), isLoaded(false), inTransaction(false) {
   memset(settingDirty, 0, sizeof(settingDirty));
-  memset(cacheValid, 0, sizeof(cacheValid));
+  memset(values, 0, sizeof(values));
+  buildIndex();
+}
+
+// Build the hash index and assign every setting its slot in the value storage
+void ConfigManager::buildIndex() {
+  if (metadataCount > CFG_MAX_SETTINGS) {
+    metadataCount = CFG_MAX_SETTINGS;
+  }
+  memset(keyIndex, 0, sizeof(keyIndex));
+
+  uint16_t offset = 0;
+  for (uint16_t i = 0; i < metadataCount; i++) {
+    // stop at the settings that don't fit into the storage
+    if (offset + metadata[i].maxLength + 1 > CFG_STORAGE_SIZE) {
+      metadataCount = i;
+      break;
+    }
+    valueOffset[i] = offset;
+    offset += metadata[i].maxLength + 1;
+
+    keyHash[i] = hashKey(metadata[i].key);
+    uint16_t slot = keyHash[i] & (CFG_INDEX_SIZE - 1);
+    while (keyIndex[slot]) {
+      slot = (slot + 1) & (CFG_INDEX_SIZE - 1);
+    }
+    keyIndex[slot] = i + 1;
+  }
+}
+
+void ConfigManager::storeValue(uint16_t idx, const char* value) {
+  strlcpy(&values[valueOffset[idx]], value, metadata[idx].maxLength + 1);
+}
+
+// Blob layout: version, count, then per setting: key hash (4), length (1), value
+bool ConfigManager::readBlob() {
+  uint8_t blob[CFG_BLOB_SIZE];
+  size_t len = nvs.getBytesLength("settings");
+  if (len < 2 || len > sizeof(blob)) return false;
+  if (nvs.getBytes("settings", blob, len) != len) return false;
+  if (blob[0] != CFG_BLOB_VERSION) return false;
+
+  size_t pos = 2;
+  for (uint8_t n = 0; n < blob[1] && pos + 5 <= len; n++) {
+    uint32_t hash;
+    memcpy(&hash, &blob[pos], 4);
+    uint8_t valueLen = blob[pos + 4];
+    pos += 5;
+    if (pos + valueLen > len) break;
+
+    // look the setting up by its hash; unknown settings are dropped
+    uint16_t slot = hash & (CFG_INDEX_SIZE - 1);
+    while (keyIndex[slot]) {
+      uint16_t idx = keyIndex[slot] - 1;
+      if (keyHash[idx] == hash) {
+        uint16_t maxLen = metadata[idx].maxLength;
+        uint16_t copyLen = valueLen < maxLen ? valueLen : maxLen;
+        memcpy(&values[valueOffset[idx]], &blob[pos], copyLen);
+        values[valueOffset[idx] + copyLen] = '\0';
+        break;
+      }
+      slot = (slot + 1) & (CFG_INDEX_SIZE - 1);
+    }
+    pos += valueLen;
+  }
+  return true;
+}
+
+// Read settings stored as separate strings by older firmware versions
+bool ConfigManager::migrateStrings() {
+  bool found = false;
+  for (uint16_t i = 0; i < metadataCount; i++) {
+    const SettingMetadata& meta = metadata[i];
+    if (nvs.isKey(meta.key) &&
+        nvs.getString(meta.key, &values[valueOffset[i]], meta.maxLength + 1) > 0) {
+      found = true;
+    }
+  }
+  return found;
+}
+
+int ConfigManager::writeBlob() {
+  uint8_t blob[CFG_BLOB_SIZE];
+  size_t pos = 2;
+  blob[0] = CFG_BLOB_VERSION;
+  blob[1] = metadataCount;
+  for (uint16_t i = 0; i < metadataCount; i++) {
+    const char* value = &values[valueOffset[i]];
+    uint8_t valueLen = strlen(value);
+    memcpy(&blob[pos], &keyHash[i], 4);
+    blob[pos + 4] = valueLen;
+    memcpy(&blob[pos + 5], value, valueLen);
+    pos += 5 + valueLen;
+  }
+  if (nvs.putBytes("settings", blob, pos) != pos) {
+    return busyError;
+  }
+  return noError;
 }
 
 int ConfigManager::load() {
   if (!nvs.begin("config", true)) {  // Read-only mode
     PRINTF("Failed to open NVS config namespace");
+    // the namespace doesn't exist yet on a fresh device: use defaults
+    for (uint16_t i = 0; i < metadataCount; i++) {
+      storeValue(i, metadata[i].defaultValue);
+    }
+    isLoaded = true;
     return busyError;
   }
 
-  invalidateAllCache();
-
   for (uint16_t i = 0; i < metadataCount; i++) {
-    const SettingMetadata& meta = metadata[i];
-    String value = nvs.getString(meta.key, meta.defaultValue);
-    valueCache[i] = value;
-    cacheValid[i] = true;
-    settingDirty[i] = false;
+    storeValue(i, metadata[i].defaultValue);
   }
 
+  bool migrate = false;
+  if (!readBlob()) {
+    migrate = migrateStrings();
+  }
   nvs.end();
+
+  memset(settingDirty, 0, sizeof(settingDirty));
   isDirty = false;
+  isLoaded = true;
+
+  // convert the old per-key strings into the blob, and remove them
+  if (migrate && nvs.begin("config", false)) {
+    PRINTF("Migrating settings to binary storage");
+    if (writeBlob() == noError) {
+      for (uint16_t i = 0; i < metadataCount; i++) {
+        nvs.remove(metadata[i].key);
+      }
+    }
+    nvs.end();
+  }
   return noError;
 }
 
 int ConfigManager::save() {
   if (!isDirty && !inTransaction) return noError;
-  
+
   if (!nvs.begin("config", false)) {  // Read-write mode
     PRINTF("Failed to open NVS config namespace for writing");
     return busyError;
   }
-  
-  for (uint16_t i = 0; i < metadataCount; i++) {
-    if (settingDirty[i]) {
-      const SettingMetadata& meta = metadata[i];
-      nvs.putString(meta.key, valueCache[i]);
-      settingDirty[i] = false;
-    }
-  }
 
+  int error = writeBlob();
   nvs.end();
+  if (error != noError) return error;
+
+  memset(settingDirty, 0, sizeof(settingDirty));
   isDirty = false;
   return noError;
 }
@@ -254,23 +413,17 @@ int ConfigManager::saveSetting(const char* key) {
   uint16_t idx = getMetadataIndex(key);
   if (idx >= metadataCount) return keyError;
 
-  if (!nvs.begin("config", false)) {
-    return busyError;
-  }
-
-  nvs.putString(metadata[idx].key, valueCache[idx]);
-  settingDirty[idx] = false;
-
-  nvs.end();
-  return noError;
+  // all settings are stored in a single blob
+  isDirty = true;
+  return save();
 }
 
-int ConfigManager::set(const char* key, const String& value) {
+int ConfigManager::set(const char* key, const char* value) {
   uint16_t idx = getMetadataIndex(key);
   if (idx >= metadataCount) return keyError;
 
   const SettingMetadata& meta = metadata[idx];
-  
+
   // Validate
   if (meta.validator) {
     int result = meta.validator(value);
@@ -278,19 +431,20 @@ int ConfigManager::set(const char* key, const String& value) {
   }
 
   // Check for length limits on strings
-  if (meta.maxLength > 0 && value.length() > meta.maxLength) {
+  if (strlen(value) > meta.maxLength) {
     return lengthError;
   }
 
+  // make sure the other settings are present before the blob is written
+  if (!isLoaded) load();
+
   // Only mark dirty if value actually changed
-  if (valueCache[idx] != value) {
-    valueCache[idx] = value;
+  if (strcmp(&values[valueOffset[idx]], value) != 0) {
+    storeValue(idx, value);
     settingDirty[idx] = true;
     isDirty = true;
   }
 
-  cacheValid[idx] = true;
-  
   // Auto-save if not in transaction
   if (!inTransaction) {
     return save();
@@ -299,47 +453,46 @@ int ConfigManager::set(const char* key, const String& value) {
   return noError;
 }
 
-String ConfigManager::get(const char* key) {
-  uint16_t idx = getMetadataIndex(key);
-  if (idx >= metadataCount) return "";
-  return getByIndex(idx);
+const char* ConfigManager::get(const char* key) {
+  return getValue(getMetadataIndex(key));
 }
 
-int ConfigManager::setByIndex(uint16_t idx, const String& value) {
+int ConfigManager::setByIndex(uint16_t idx, const char* value) {
   if (idx >= metadataCount) return keyError;
   return set(metadata[idx].key, value);
 }
 
-String ConfigManager::getByIndex(uint16_t idx) {
+const char* ConfigManager::getValue(uint16_t idx) {
   if (idx >= metadataCount) return "";
-  if (!cacheValid[idx]) {
-    // Load from NVS if not cached
-    if (nvs.begin("config", true)) {
-      valueCache[idx] = nvs.getString(metadata[idx].key, metadata[idx].defaultValue);
-      nvs.end();
-      cacheValid[idx] = true;
-    }
-  }
-  return valueCache[idx];
+  // Load from NVS if not cached (e.g. when cfg was restored from RTC memory)
+  if (!isLoaded) load();
+  return &values[valueOffset[idx]];
 }
 
 String ConfigManager::printSettings(int group) {
   String result = "";
   for (uint16_t i = 0; i < metadataCount; i++) {
     if (group < 0 || metadata[i].group == group) {
-      result += "\r\n+" + String(metadata[i].displayName) + "=" + getByIndex(i);
+      result += "\r\n+" + String(metadata[i].displayName) + "=" + getValue(i);
     }
   }
   return result;
 }
 
+void ConfigManager::printSettings(Print& out, int group) {
+  for (uint16_t i = 0; i < metadataCount; i++) {
+    if (group < 0 || metadata[i].group == group) {
+      out.printf("\r\n+%s=%s", metadata[i].displayName, getValue(i));
+    }
+  }
+}
+
 int ConfigManager::resetToDefaults() {
-  invalidateAllCache();
   for (uint16_t i = 0; i < metadataCount; i++) {
-    valueCache[i] = String(metadata[i].defaultValue);
+    storeValue(i, metadata[i].defaultValue);
     settingDirty[i] = true;
-    cacheValid[i] = true;
   }
+  isLoaded = true;
   isDirty = true;
   return noError;
 }
@@ -362,13 +515,13 @@ int ConfigManager::commitTransaction() {
 
 void ConfigManager::cancelTransaction() {
   inTransaction = false;
-  // Invalidate cache and reload from NVS
-  invalidateAllCache();
+  // Drop the cached values and reload from NVS on next access
+  isLoaded = false;
   memset(settingDirty, 0, sizeof(settingDirty));
   isDirty = false;
 }
 
-int ConfigManager::validate(const char* key, const String& value) {
+int ConfigManager::validate(const char* key, const char* value) {
   const SettingMetadata* meta = getMetadata(key);
   if (!meta) return keyError;
   if (meta->validator) return meta->validator(value);
@@ -382,8 +535,12 @@ const SettingMetadata* ConfigManager::getMetadata(const char* key) {
 }
 
 uint16_t ConfigManager::getMetadataIndex(const char* key) {
-  for (uint16_t i = 0; i < metadataCount; i++) {
-    if (strcmp(metadata[i].key, key) == 0) return i;
+  uint32_t hash = hashKey(key);
+  uint16_t slot = hash & (CFG_INDEX_SIZE - 1);
+  while (keyIndex[slot]) {
+    uint16_t idx = keyIndex[slot] - 1;
+    if (keyHash[idx] == hash && strcmp(metadata[idx].key, key) == 0) return idx;
+    slot = (slot + 1) & (CFG_INDEX_SIZE - 1);
   }
   return metadataCount;  // Not found
 }
@@ -393,13 +550,3 @@ bool ConfigManager::isSettingDirty(const char* key) {
   if (idx >= metadataCount) return false;
   return settingDirty[idx];
 }
-
-void ConfigManager::invalidateCache(uint16_t idx) {
-  if (idx < 50) {
-    cacheValid[idx] = false;
-  }
-}
-
-void ConfigManager::invalidateAllCache() {
-  memset(cacheValid, 0, sizeof(cacheValid));
-}
@@ -30,7 +30,7 @@ enum SettingGroup {
 };
 
 // Validator function type: returns error code (0 = success)
-typedef int (*ValidatorFn)(const String& value);
+typedef int (*ValidatorFn)(const char* value);
 
 struct SettingMetadata {
   const char* key;           // e.g., "version", "dr", "timezone"
@@ -38,24 +38,44 @@ struct SettingMetadata {
   SettingGroup group;
   const char* defaultValue;  // String representation
   ValidatorFn validator;     // nullptr = no validation
-  uint16_t maxLength;        // For strings, 0 = no limit
+  uint16_t maxLength;        // Maximum length of the stored value
 };
 
+// FNV-1a hash of a setting key, usable at compile time
+constexpr uint32_t hashKey(const char* key) {
+  uint32_t hash = 2166136261u;
+  while (*key) {
+    hash = (hash ^ (uint8_t)*key++) * 16777619u;
+  }
+  return hash;
+}
+
 // ============= Configuration Manager Class =============
 
+#define CFG_MAX_SETTINGS  48      // maximum number of settings
+#define CFG_INDEX_SIZE    64      // hash index slots (power of two, > CFG_MAX_SETTINGS)
+#define CFG_STORAGE_SIZE  1024    // bytes available for all values
+#define CFG_BLOB_VERSION  1
+#define CFG_BLOB_SIZE     (2 + CFG_MAX_SETTINGS * 5 + CFG_STORAGE_SIZE)
+
 class ConfigManager {
 private:
   Preferences nvs;
   const SettingMetadata* metadata;
   uint16_t metadataCount;
   bool isDirty;
+  bool isLoaded;
   
-  // Dirty tracking per setting (assuming max 50 settings)
-  bool settingDirty[50];
+  // Dirty tracking per setting
+  bool settingDirty[CFG_MAX_SETTINGS];
   
-  // Cache for string values
-  String valueCache[50];
-  bool cacheValid[50];
+  // Open-addressing hash index on the key: setting index + 1, 0 = empty
+  uint8_t keyIndex[CFG_INDEX_SIZE];
+  uint32_t keyHash[CFG_MAX_SETTINGS];
+
+  // Packed value storage: one fixed slot of maxLength + 1 bytes per setting
+  uint16_t valueOffset[CFG_MAX_SETTINGS];
+  char values[CFG_STORAGE_SIZE];
   
   // Transaction support
   bool inTransaction;
@@ -66,24 +86,25 @@ public:
   // Load all settings from flash
   int load();
   
-  // Save only changed settings to flash
+  // Save changed settings to flash
   int save();
   
   // Force save a specific setting
   int saveSetting(const char* key);
   
   // Set a single setting (validated, marked dirty)
-  int set(const char* key, const String& value);
+  int set(const char* key, const char* value);
   
-  // Get a setting value (from cache if available)
-  String get(const char* key);
+  // Get a setting value without copying it; valid until the setting changes
+  const char* get(const char* key);
   
   // Get setting by index
-  int setByIndex(uint16_t idx, const String& value);
-  String getByIndex(uint16_t idx);
+  int setByIndex(uint16_t idx, const char* value);
+  const char* getValue(uint16_t idx);
   
   // Print all settings (optionally for a group)
   String printSettings(int group = -1);
+  void printSettings(Print& out, int group = -1);
   
   // Reset to defaults (without writing to flash)
   int resetToDefaults();
@@ -97,7 +118,7 @@ public:
   void cancelTransaction();
   
   // Validate a setting without applying
-  int validate(const char* key, const String& value);
+  int validate(const char* key, const char* value);
   
   // Get metadata for a setting
   const SettingMetadata* getMetadata(const char* key);
@@ -108,33 +129,43 @@ public:
   bool isSettingDirty(const char* key);
   
 private:
-  void invalidateCache(uint16_t idx);
-  void invalidateAllCache();
+  void buildIndex();
+  void storeValue(uint16_t idx, const char* value);
+  bool readBlob();
+  bool migrateStrings();
+  int writeBlob();
 };
 
 // ============= Validators (Reusable) =============
 
-int validateVersion(const String& val);
-int validateMethod(const String& val);
-int validateRelay(const String& val);
-int validateADR(const String& val);
-int validateDataRate(const String& val);
-int validateDBm(const String& val);
-int validateBoolean(const String& val);
-int validateInterval(const String& val);
-int validateOperation(const String& val);
-int validateTimeout(const String& val);
-int validateTimezone(const String& val);
-int validateDST(const String& val);
-int validateName(const String& val);
-int validateSSID(const String& val);
-int validatePassword(const String& val);
-int validateUser(const String& val);
+int validateVersion(const char* val);
+int validateMethod(const char* val);
+int validateRelay(const char* val);
+int validateADR(const char* val);
+int validateDataRate(const char* val);
+int validateDBm(const char* val);
+int validateBoolean(const char* val);
+int validateInterval(const char* val);
+int validateOperation(const char* val);
+int validateTimeout(const char* val);
+int validateRetention(const char* val);
+int validateBatch(const char* val);
+int validateTimezone(const char* val);
+int validateDST(const char* val);
+int validateName(const char* val);
+int validateSSID(const char* val);
+int validatePassword(const char* val);
+int validateUser(const char* val);
+int validateIP(const char* val);
+int validatePublish(const char* val);
+
+// "ip,gateway[,subnet]" as addresses in network byte order; the subnet defaults to /24
+bool parseStaticIP(const char* val, uint32_t addr[3]);
 
 // Hex validators for keys (with length validation)
-int validateHex8(const String& val);      // 8 hex characters (4 bytes)
-int validateHex16(const String& val);     // 16 hex characters (8 bytes)
-int validateHex32(const String& val);     // 32 hex characters (16 bytes)
+int validateHex8(const char* val);      // 8 hex characters (4 bytes)
+int validateHex16(const char* val);     // 16 hex characters (8 bytes)
+int validateHex32(const char* val);     // 32 hex characters (16 bytes)
 
 // Global config manager instance
 extern ConfigManager configMgr;
@@ -0,0 +1,851 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <math.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_rom_crc.h"
+#include "config.h"
+#include "datalog.h"
+#include "lzss.h"
+
+// ============= Dates =============
+
+uint16_t dayNumber(int year, int month, int day) {
+  year -= month <= 2;
+  int era = (year >= 0 ? year : year - 399) / 400;
+  int yoe = year - era * 400;
+  int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return(era * 146097 + doe - 719468);
+}
+
+void dayPath(uint16_t day, char *path, size_t len) {
+  time_t t = (time_t)day * 86400;
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  // a day number ends in 2149, the clamps only bound the length for the compiler
+  snprintf(path, len, "/%04u-%02u-%02u.bin", (tm.tm_year + 1900) % 10000u, (tm.tm_mon + 1) % 100u, tm.tm_mday % 100u);
+}
+
+bool dayOfPath(const char *path, uint16_t &day) {
+  int y, m, d;
+  char ext[5];
+  if(path[0] == '/') {
+    path++;
+  }
+  if(strlen(path) != 14 || sscanf(path, "%4d-%2d-%2d.%4s", &y, &m, &d, ext) != 4 || strcmp(ext, "bin") != 0) {
+    return(false);
+  }
+  day = dayNumber(y, m, d);
+  return(true);
+}
+
+uint32_t logParseTime(const char *str) {
+  int y, mo, d, h = 0, mi = 0, sec = 0;
+  int n = sscanf(str, "%4d-%2d-%2d%*[T ]%2d:%2d:%2d", &y, &mo, &d, &h, &mi, &sec);
+  if(n >= 3) {
+    if(mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || sec > 59) {
+      return(0);
+    }
+    return(dayNumber(y, mo, d) * 86400UL + h * 3600UL + mi * 60UL + sec);
+  }
+  char *end;
+  unsigned long t = strtoul(str, &end, 10);
+  return(end != str && *end == '\0' ? t : 0);
+}
+
+// ============= Fixed-point conversion =============
+
+// round value / scale to an integer in [lo, hi), anything else is stored as na
+template<typename T>
+static T logScale(double value, double scale, double lo, double hi, T na) {
+  double raw = round(value / scale);
+  if(isnan(raw) || raw < lo || raw >= hi) {
+    return(na);
+  }
+  return((T)raw);
+}
+
+uint8_t logU8(double value, double scale) {
+  return(logScale<uint8_t>(value, scale, 0, LOG_NA_U8, LOG_NA_U8));
+}
+
+int16_t logI16(double value, double scale) {
+  return(logScale<int16_t>(value, scale, LOG_NA_I16 + 1, INT16_MAX + 1.0, LOG_NA_I16));
+}
+
+uint16_t logU16(double value, double scale) {
+  return(logScale<uint16_t>(value, scale, 0, LOG_NA_U16, LOG_NA_U16));
+}
+
+int32_t logI32(double value, double scale) {
+  return(logScale<int32_t>(value, scale, LOG_NA_I32 + 1.0, INT32_MAX + 1.0, LOG_NA_I32));
+}
+
+uint32_t logU32(double value, double scale) {
+  return(logScale<uint32_t>(value, scale, 0, LOG_NA_U32, LOG_NA_U32));
+}
+
+// ============= Writer =============
+
+// Records are staged in RTC memory and written to flash in batches. The ring is kept
+// in RTC_NOINIT memory, so that it also survives a crash or watchdog reset; seq
+// identifies the records, of which [flushedSeq, nextSeq) are still to be written.
+struct LogStaged {
+  uint32_t seq;
+  LogRecord rec;
+};
+
+struct LogStaging {
+  uint32_t magic;
+  uint32_t nextSeq;
+  uint32_t flushedSeq;
+  uint32_t flushingSeq;       // nextSeq during a flush, 0 otherwise
+  uint32_t flushTo;           // file size once that flush is complete
+  uint32_t fileSize;          // file size after the last flush, 0 if unknown
+  char path[16];
+  LogStaged ring[LOG_STAGE_RECORDS];
+
+  // write statistics of the current day file
+  uint32_t writes;
+  uint32_t bytes;
+  uint32_t writeUs;
+};
+
+#define LOG_STAGING_MAGIC   0x47545352    // "RSTG"
+
+RTC_NOINIT_ATTR LogStaging staging;
+
+volatile uint32_t fsChanges = 0;
+
+#define LOG_VFS_ROOT        "/littlefs"   // mount point of LittleFS, for truncate()
+
+static uint16_t logCrc(const LogRecord &rec) {
+  return(esp_rom_crc16_le(0, (const uint8_t*)&rec, offsetof(LogRecord, crc)));
+}
+
+static inline uint32_t logStaged() {
+  return(staging.nextSeq - staging.flushedSeq);
+}
+
+void logReport() {
+  Serial.printf("[Log] %s: %u records staged, %u flash writes, %u bytes, %u ms writing\r\n",
+                staging.path, (unsigned)logStaged(), (unsigned)staging.writes,
+                (unsigned)staging.bytes, (unsigned)(staging.writeUs / 1000));
+}
+
+static bool logRecovered = false;
+
+// validate the staged records once after a reset
+static void logRecover() {
+  logRecovered = true;
+  if(staging.magic != LOG_STAGING_MAGIC || logStaged() > LOG_STAGE_RECORDS) {
+    memset(&staging, 0, sizeof(staging));
+    staging.magic = LOG_STAGING_MAGIC;
+    return;
+  }
+
+  // reset during a flush: LittleFS commits a file on close, so either the whole
+  // batch is in the file or none of it
+  if(staging.flushingSeq) {
+    File file = LittleFS.open(staging.path, FILE_READ);
+    if(file && file.size() >= staging.flushTo) {
+      staging.flushedSeq = staging.flushingSeq;
+    }
+    file.close();
+    logRepair(staging.path);
+    staging.flushingSeq = 0;
+    staging.fileSize = 0;
+  }
+
+  // drop records that were not completely staged
+  uint32_t lost = 0;
+  for(uint32_t seq = staging.flushedSeq; seq != staging.nextSeq; seq++) {
+    LogStaged &slot = staging.ring[seq % LOG_STAGE_RECORDS];
+    if(slot.seq != seq || slot.rec.crc != logCrc(slot.rec)) {
+      slot.seq = 0;
+      lost++;
+    }
+  }
+  if(lost) {
+    Serial.printf("[Log] %u staged records lost\r\n", (unsigned)lost);
+  }
+}
+
+bool logLatest(LogRecord &rec) {
+  if(!logRecovered) {
+    logRecover();
+  }
+  uint32_t seq = staging.nextSeq - 1;
+  const LogStaged &slot = staging.ring[seq % LOG_STAGE_RECORDS];
+  if(slot.seq != seq || slot.rec.crc != logCrc(slot.rec)) {
+    return(false);
+  }
+  rec = slot.rec;
+  return(true);
+}
+
+size_t logAppend(const char *path, LogRecord &rec) {
+  if(!logRecovered) {
+    logRecover();
+  }
+  size_t written = 0;
+  if(strcmp(path, staging.path) != 0) {
+    // a new day: finish the previous file
+    written += logFlush();
+    if(staging.path[0]) {
+      logReport();
+    }
+    strlcpy(staging.path, path, sizeof(staging.path));
+    staging.fileSize = 0;
+    staging.writes = 0;
+    staging.bytes = 0;
+    staging.writeUs = 0;
+  }
+
+  // make room when earlier flushes failed
+  if(logStaged() == LOG_STAGE_RECORDS) {
+    Serial.printf("[Log] Staging full, dropping a record\r\n");
+    staging.flushedSeq++;
+  }
+
+  rec.crc = logCrc(rec);
+  LogStaged &slot = staging.ring[staging.nextSeq % LOG_STAGE_RECORDS];
+  slot.rec = rec;
+  slot.seq = staging.nextSeq;
+  staging.nextSeq++;
+
+  // write once the staged records fill the file up to a batch boundary
+  uint32_t end = max(staging.fileSize, (uint32_t)sizeof(LogHeader)) + logStaged() * sizeof(LogRecord);
+  if(end % LOG_BATCH_BYTES == 0 || logStaged() == LOG_STAGE_RECORDS) {
+    written += logFlush();
+  }
+  return(written);
+}
+
+size_t logFlush() {
+  if(!logRecovered) {
+    logRecover();
+  }
+  if(logStaged() == 0) {
+    return(0);
+  }
+
+  uint32_t tStart = micros();
+  File file = LittleFS.open(staging.path, FILE_APPEND);
+  if(!file) {
+    Serial.printf("[Log] Failed to open %s\r\n", staging.path);
+    return(0);
+  }
+
+  size_t start = file.size();
+  size_t size = start;
+  if(size == 0) {
+    LogHeader header = { 0 };
+    header.magic = LOG_MAGIC;
+    header.version = LOG_VERSION;
+    header.recordSize = sizeof(LogRecord);
+    header.devEUI = cfg.actvn.otaa.devEUI;
+    strlcpy(header.firmware, MJLO_VERSION, sizeof(header.firmware));
+    size += file.write((uint8_t*)&header, sizeof(LogHeader));
+  }
+
+  // a torn write leaves a partial record: pad it, the decoder skips it on its CRC
+  if(size % sizeof(LogRecord)) {
+    uint8_t pad[sizeof(LogRecord)];
+    memset(pad, 0xFF, sizeof(pad));
+    size += file.write(pad, sizeof(LogRecord) - size % sizeof(LogRecord));
+  }
+
+  // gather the batch, so that it is handed to the filesystem in one write
+  uint8_t batch[LOG_STAGE_RECORDS * sizeof(LogRecord)];
+  size_t len = 0;
+  for(uint32_t seq = staging.flushedSeq; seq != staging.nextSeq; seq++) {
+    const LogStaged &slot = staging.ring[seq % LOG_STAGE_RECORDS];
+    if(slot.seq == seq) {
+      memcpy(&batch[len], &slot.rec, sizeof(LogRecord));
+      len += sizeof(LogRecord);
+    }
+  }
+  staging.flushTo = size + len;
+  staging.flushingSeq = staging.nextSeq;
+  size_t written = file.write(batch, len);
+  file.close();
+  fsChanges++;
+
+  if(written != len) {
+    Serial.printf("[Log] Failed to write %s (%u of %u bytes)\r\n", staging.path, (unsigned)written, (unsigned)len);
+  }
+
+  // only the records that were written completely leave the staging ring, the rest
+  // are retried by the next flush after padding any partial record
+  size_t records = written / sizeof(LogRecord);
+  for(size_t n = 0; staging.flushedSeq != staging.nextSeq; staging.flushedSeq++) {
+    if(staging.ring[staging.flushedSeq % LOG_STAGE_RECORDS].seq == staging.flushedSeq) {
+      if(n == records) {
+        break;
+      }
+      n++;
+    }
+  }
+  staging.flushingSeq = 0;
+  staging.fileSize = size + records * sizeof(LogRecord);
+
+  uint32_t tWrite = micros() - tStart;
+  staging.writes++;
+  staging.bytes += staging.fileSize - start;
+  staging.writeUs += tWrite;
+  Serial.printf("[Log] %u records written to %s in %u ms\r\n", (unsigned)records,
+                staging.path, (unsigned)(tWrite / 1000));
+  return(staging.fileSize - start);
+}
+
+// Check the tail of a plain day file after power was lost. Records are written
+// in flushes of at most LOG_STAGE_RECORDS, so only the records of the last flush
+// can be incomplete: a partial record and records with an invalid CRC at the end
+// of the file are cut off. The CRC of the last valid record is the commit marker.
+int32_t logRepair(const char *path) {
+  File file = LittleFS.open(path, FILE_READ);
+  if(!file) {
+    return(0);
+  }
+  size_t size = file.size();
+  size_t end = size;
+  LogHeader header;
+  if(file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) || header.magic != LOG_MAGIC) {
+    end = 0;                  // the header itself was not written
+  } else if(!(header.flags & LOG_FLAG_PACKED)) {
+    end -= (end - sizeof(LogHeader)) % sizeof(LogRecord);
+    uint8_t batch[LOG_STAGE_RECORDS * sizeof(LogRecord)];
+    size_t from = end > sizeof(LogHeader) + sizeof(batch) ? end - sizeof(batch) : sizeof(LogHeader);
+    size_t len = file.seek(from) ? file.read(batch, end - from) : 0;
+    while(len >= sizeof(LogRecord)) {
+      const LogRecord &rec = *(const LogRecord*)&batch[len - sizeof(LogRecord)];
+      if(rec.crc == logCrc(rec)) {
+        break;
+      }
+      len -= sizeof(LogRecord);
+    }
+    end = from + len;
+  }
+  file.close();
+  if(end == size) {
+    return(0);
+  }
+
+  Serial.printf("[Log] Truncating %s from %u to %u bytes\r\n", path, (unsigned)size, (unsigned)end);
+  int ret = truncate((String(LOG_VFS_ROOT) + path).c_str(), end);
+  fsChanges++;
+  if(ret != 0) {
+    Serial.printf("[Log] Failed to truncate %s\r\n", path);
+    return(-1);
+  }
+  return(size - end);
+}
+
+// ============= Packing =============
+
+#define LOG_PACK_TMP "/pack.tmp"
+
+#define LOG_PACKED_SIZE offsetof(LogRecord, crc)
+#define LOG_BLOCK_BYTES (LOG_PACKED_SIZE * LOG_PACK_RECORDS)
+
+// records to differences with the previous record, stored byte j of all records first
+static void logShuffle(const LogRecord *recs, uint8_t count, uint8_t *out) {
+  for(size_t j = 0; j < LOG_PACKED_SIZE; j++) {
+    uint8_t prev = 0;
+    for(size_t i = 0; i < count; i++) {
+      uint8_t cur = ((const uint8_t*)&recs[i])[j];
+      out[j * count + i] = cur - prev;
+      prev = cur;
+    }
+  }
+}
+
+static void logUnshuffle(const uint8_t *in, uint8_t count, LogRecord *recs) {
+  for(size_t j = 0; j < LOG_PACKED_SIZE; j++) {
+    uint8_t cur = 0;
+    for(size_t i = 0; i < count; i++) {
+      cur += in[j * count + i];
+      ((uint8_t*)&recs[i])[j] = cur;
+    }
+  }
+}
+
+static bool logWriteBlock(File &out, const LogRecord *recs, uint8_t count, uint8_t *buf) {
+  uint8_t *shuffled = buf + LZSS_BOUND(LOG_BLOCK_BYTES);
+  logShuffle(recs, count, shuffled);
+  LogBlock block = { recs[0].time, 0, 0, count };
+  block.crc = esp_rom_crc16_le(0, shuffled, count * LOG_PACKED_SIZE);
+  block.size = lzssCompress(shuffled, count * LOG_PACKED_SIZE, buf, LZSS_BOUND(LOG_BLOCK_BYTES));
+  return(block.size && out.write((uint8_t*)&block, sizeof(block)) == sizeof(block) &&
+         out.write(buf, block.size) == block.size);
+}
+
+int32_t logPack(const char *path) {
+  if(strcmp(path, staging.path) == 0) {
+    return(0);                              // still being written
+  }
+  LogReader reader(LittleFS.open(path, FILE_READ));
+  LogHeader header;
+  if(!reader.file || !reader.begin(header)) {
+    return(-1);
+  }
+  if(header.flags & LOG_FLAG_PACKED) {
+    return(0);
+  }
+
+  uint32_t tStart = micros();
+  uint32_t before = reader.file.size();
+  File out = LittleFS.open(LOG_PACK_TMP, FILE_WRITE);
+  LogRecord *recs = (LogRecord*)malloc(sizeof(LogRecord) * LOG_PACK_RECORDS);
+  uint8_t *buf = (uint8_t*)malloc(LZSS_BOUND(LOG_BLOCK_BYTES) + LOG_BLOCK_BYTES);
+  bool ok = out && recs && buf;
+
+  // the record count is known at the end, the header is rewritten then
+  header.flags |= LOG_FLAG_PACKED;
+  header.records = 0;
+  ok = ok && out.write((uint8_t*)&header, sizeof(header)) == sizeof(header);
+  uint8_t count = 0;
+  while(ok && reader.next(recs[count])) {
+    header.records++;
+    if(++count == LOG_PACK_RECORDS) {
+      ok = logWriteBlock(out, recs, count, buf);
+      count = 0;
+    }
+  }
+  if(ok && count) {
+    ok = logWriteBlock(out, recs, count, buf);
+  }
+  ok = ok && out.seek(0) && out.write((uint8_t*)&header, sizeof(header)) == sizeof(header);
+  uint32_t after = out ? out.size() : 0;
+  free(recs);
+  free(buf);
+  out.close();
+  reader.file.close();
+
+  // replacing the file is atomic: a reset leaves either the plain or the packed file
+  ok = ok && LittleFS.rename(LOG_PACK_TMP, path);
+  if(!ok) {
+    LittleFS.remove(LOG_PACK_TMP);
+  }
+  fsChanges++;
+  if(!ok) {
+    Serial.printf("[Log] Failed to pack %s\r\n", path);
+    return(-1);
+  }
+  Serial.printf("[Log] Packed %s: %u records, %u -> %u bytes in %u ms\r\n", path, (unsigned)header.records,
+                (unsigned)before, (unsigned)after, (unsigned)((micros() - tStart) / 1000));
+  return(before - after);
+}
+
+// ============= Reader =============
+
+void LogReader::open(File f) {
+  file = f;
+  skipped = 0;
+  packed = false;
+  blockLen = 0;
+  blockPos = 0;
+}
+
+bool LogReader::begin(LogHeader &header) {
+  if(file.read((uint8_t*)&header, sizeof(LogHeader)) != sizeof(LogHeader) ||
+     header.magic != LOG_MAGIC || header.recordSize != sizeof(LogRecord)) {
+    return(false);
+  }
+  packed = header.flags & LOG_FLAG_PACKED;
+  return(true);
+}
+
+bool LogReader::readBlock() {
+  LogBlock hdr;
+  if(file.read((uint8_t*)&hdr, sizeof(hdr)) != sizeof(hdr) || hdr.records > LOG_PACK_RECORDS ||
+     hdr.size > LZSS_BOUND(LOG_BLOCK_BYTES)) {
+    return(false);
+  }
+  uint8_t *buf = (uint8_t*)malloc(hdr.size + LOG_BLOCK_BYTES);
+  uint8_t *shuffled = buf + hdr.size;
+  size_t len = buf && file.read(buf, hdr.size) == hdr.size ? lzssDecompress(buf, hdr.size, shuffled, LOG_BLOCK_BYTES) : 0;
+  blockLen = 0;
+  blockPos = 0;
+  if(len == hdr.records * LOG_PACKED_SIZE && esp_rom_crc16_le(0, shuffled, len) == hdr.crc) {
+    logUnshuffle(shuffled, hdr.records, block);
+    for(blockLen = 0; blockLen < hdr.records; blockLen++) {
+      block[blockLen].crc = logCrc(block[blockLen]);
+    }
+  } else {
+    skipped += hdr.records;
+  }
+  free(buf);
+  return(true);
+}
+
+// position before the first record at or after time; records are in time order
+bool LogReader::seek(uint32_t time) {
+  if(packed) {
+    // stop at the last block that starts before time
+    size_t pos = file.position();
+    LogBlock hdr, next;
+    while(file.read((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr) && hdr.time < time &&
+          file.seek(file.position() + hdr.size) &&
+          file.read((uint8_t*)&next, sizeof(next)) == sizeof(next) && next.time < time) {
+      pos += sizeof(hdr) + hdr.size;
+      file.seek(pos);
+    }
+    blockLen = 0;
+    blockPos = 0;
+    return(file.seek(pos));
+  }
+
+  // bisection over the fixed-size records
+  uint32_t lo = 0;
+  uint32_t hi = (file.size() - sizeof(LogHeader)) / sizeof(LogRecord);
+  while(lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    uint32_t t = 0;
+    file.seek(sizeof(LogHeader) + mid * sizeof(LogRecord));
+    file.read((uint8_t*)&t, sizeof(t));
+    if(t < time) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return(file.seek(sizeof(LogHeader) + lo * sizeof(LogRecord)));
+}
+
+bool LogReader::next(LogRecord &rec) {
+  while(true) {
+    if(packed) {
+      while(blockPos == blockLen) {
+        if(!readBlock()) {
+          return(false);
+        }
+      }
+      rec = block[blockPos++];
+    } else if(file.read((uint8_t*)&rec, sizeof(LogRecord)) != sizeof(LogRecord)) {
+      return(false);
+    }
+    if(rec.crc == logCrc(rec)) {
+      return(true);
+    }
+    skipped++;
+  }
+}
+
+// ============= Query =============
+
+LogQuery::LogQuery(uint32_t from, uint32_t to) : reader(File()), single(false), from(from), to(to) {}
+
+// the first indexed day on or after day, UINT32_MAX if there is none
+static uint32_t indexedDay(uint32_t day) {
+  uint16_t lo = 0;
+  uint16_t hi = storage.count;
+  while(lo < hi) {
+    uint16_t mid = (lo + hi) / 2;
+    if(storageDay(mid) < day) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return(lo < storage.count ? storageDay(lo) : UINT32_MAX);
+}
+
+// open the next day file in the range, positioned at from
+bool LogQuery::openDay(LogHeader &header) {
+  skippedDays += reader.skipped;
+  reader.open(File());
+  while(day <= lastDay) {
+    if(storage.magic == STORAGE_MAGIC) {
+      day = indexedDay(day);
+      if(day > lastDay) {
+        break;
+      }
+    }
+    char path[16];
+    dayPath(day++, path, sizeof(path));
+    if(!LittleFS.exists(path)) {
+      continue;
+    }
+    reader.open(LittleFS.open(path, FILE_READ));
+    if(reader.begin(header) && reader.seek(from)) {
+      return(true);
+    }
+    reader.open(File());
+  }
+  return(false);
+}
+
+bool LogQuery::begin(LogHeader &header) {
+  if(single) {
+    return(reader.begin(header));
+  }
+
+  day = from / 86400;
+  lastDay = to > from ? (to - 1) / 86400 : 0;
+
+  // without the index, limit the days to look up to those of which there is a file
+  if(storage.magic != STORAGE_MAGIC) {
+    uint32_t first = UINT32_MAX;
+    uint32_t last = 0;
+    File root = LittleFS.open("/");
+    File file = root.openNextFile();
+    while(file) {
+      uint16_t d;
+      if(!file.isDirectory() && dayOfPath(file.name(), d) && d >= day && d <= lastDay) {
+        first = min(first, (uint32_t)d);
+        last = max(last, (uint32_t)d);
+      }
+      file = root.openNextFile();
+    }
+    root.close();
+    day = first;
+    lastDay = last;
+  }
+  if(openDay(header)) {
+    return(true);
+  }
+
+  // nothing in flash (yet), describe this device
+  memset(&header, 0, sizeof(header));
+  header.magic = LOG_MAGIC;
+  header.version = LOG_VERSION;
+  header.recordSize = sizeof(LogRecord);
+  header.devEUI = cfg.actvn.otaa.devEUI;
+  strlcpy(header.firmware, MJLO_VERSION, sizeof(header.firmware));
+  return(true);
+}
+
+bool LogQuery::next(LogRecord &rec) {
+  while(!staged) {
+    while(reader.file && reader.next(rec)) {
+      if(rec.time >= to) {
+        break;
+      }
+      if(rec.time >= from) {
+        return(true);
+      }
+    }
+    LogHeader header;
+    if(!single && openDay(header)) {
+      continue;
+    }
+
+    // then the records that are not in the file yet
+    staged = true;
+    if(!logRecovered) {
+      logRecover();
+    }
+    stagedSeq = staging.flushedSeq;
+    if(single && strcmp(path(), staging.path) != 0) {
+      stagedSeq = staging.nextSeq;
+    }
+  }
+
+  while(stagedSeq != staging.nextSeq) {
+    const LogStaged &slot = staging.ring[stagedSeq % LOG_STAGE_RECORDS];
+    if(slot.seq == stagedSeq++ && slot.rec.crc == logCrc(slot.rec) && slot.rec.time >= from && slot.rec.time < to) {
+      rec = slot.rec;
+      return(true);
+    }
+  }
+  return(false);
+}
+
+// ============= Decoder =============
+
+enum LogFieldType {
+  FIELD_U8,
+  FIELD_I16,
+  FIELD_U16,
+  FIELD_I32,
+  FIELD_U32,
+  FIELD_F32
+};
+
+struct LogField {
+  const char *name;
+  uint8_t offset;
+  uint8_t type;
+  double scale;
+  uint8_t decimals;
+};
+
+#define FIELD(member, type, scale, decimals) \
+  { #member, offsetof(LogRecord, member), type, scale, decimals }
+
+static const LogField logFields[] = {
+  FIELD(lat,      FIELD_I32, 1e-7,   7),
+  FIELD(lon,      FIELD_I32, 1e-7,   7),
+  FIELD(alt,      FIELD_I16, 0.1,    1),
+  FIELD(hdop,     FIELD_U8,  0.1,    1),
+  FIELD(sats,     FIELD_U8,  1.0,    0),
+  FIELD(batt,     FIELD_U16, 1.0,    0),
+  FIELD(temp,     FIELD_I16, 0.01,   2),
+  FIELD(humi,     FIELD_U16, 0.01,   2),
+  FIELD(pres,     FIELD_U32, 0.001,  3),    // hPa
+  FIELD(lumi,     FIELD_F32, 1.0,    3),
+  FIELD(uva,      FIELD_U16, 0.1,    1),
+  FIELD(uvb,      FIELD_U16, 0.1,    1),
+  FIELD(co2,      FIELD_U16, 1.0,    0),
+  FIELD(scdTemp,  FIELD_I16, 0.01,   2),
+  FIELD(scdHumi,  FIELD_U16, 0.01,   2),
+  FIELD(pm1_0,    FIELD_U16, 0.1,    1),
+  FIELD(pm2_5,    FIELD_U16, 0.1,    1),
+  FIELD(pm4_0,    FIELD_U16, 0.1,    1),
+  FIELD(pm10,     FIELD_U16, 0.1,    1),
+  FIELD(temp5x,   FIELD_I16, 0.005,  3),
+  FIELD(humi5x,   FIELD_I16, 0.01,   2),
+  FIELD(vocIndex, FIELD_I16, 0.1,    1),
+  FIELD(noxIndex, FIELD_I16, 0.1,    1),
+  FIELD(dbMin,    FIELD_U16, 0.01,   2),
+  FIELD(dbAvg,    FIELD_U16, 0.01,   2),
+  FIELD(dbMax,    FIELD_U16, 0.01,   2),
+};
+
+#define NUM_LOG_FIELDS (sizeof(logFields) / sizeof(logFields[0]))
+
+// read a field from a record, returns false if it was not measured
+static bool logFieldValue(const LogRecord &rec, const LogField &field, double &value) {
+  const uint8_t *p = (const uint8_t*)&rec + field.offset;
+  switch(field.type) {
+    case(FIELD_U8): {
+      uint8_t v = *p;
+      value = v;
+      return(v != LOG_NA_U8);
+    }
+    case(FIELD_I16): {
+      int16_t v;
+      memcpy(&v, p, sizeof(v));
+      value = v;
+      return(v != LOG_NA_I16);
+    }
+    case(FIELD_U16): {
+      uint16_t v;
+      memcpy(&v, p, sizeof(v));
+      value = v;
+      return(v != LOG_NA_U16);
+    }
+    case(FIELD_I32): {
+      int32_t v;
+      memcpy(&v, p, sizeof(v));
+      value = v;
+      return(v != LOG_NA_I32);
+    }
+    case(FIELD_U32): {
+      uint32_t v;
+      memcpy(&v, p, sizeof(v));
+      value = v;
+      return(v != LOG_NA_U32);
+    }
+    case(FIELD_F32): {
+      float v;
+      memcpy(&v, p, sizeof(v));
+      value = v;
+      return(!isnan(v));
+    }
+  }
+  return(false);
+}
+
+size_t logFormat(const LogRecord &rec, LogFormat format, char *buf, size_t len) {
+  time_t t = rec.time;
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  char stamp[24];
+  strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+  size_t n = 0;
+  if(format == LOG_CSV) {
+    n += snprintf(&buf[n], len - n, "%s", stamp);
+  } else {
+    n += snprintf(&buf[n], len - n, "{\"time\":\"%s\"", stamp);
+  }
+
+  for(size_t i = 0; i < NUM_LOG_FIELDS && n < len; i++) {
+    const LogField &field = logFields[i];
+    double value;
+    bool valid = logFieldValue(rec, field, value);
+    if(format == LOG_CSV) {
+      n += valid ? snprintf(&buf[n], len - n, ",%.*f", field.decimals, value * field.scale)
+                 : snprintf(&buf[n], len - n, ",");
+    } else {
+      n += valid ? snprintf(&buf[n], len - n, ",\"%s\":%.*f", field.name, field.decimals, value * field.scale)
+                 : snprintf(&buf[n], len - n, ",\"%s\":null", field.name);
+    }
+  }
+
+  if(n < len) {
+    n += snprintf(&buf[n], len - n, format == LOG_CSV ? "\r\n" : "}");
+  }
+  return(min(n, len - 1));
+}
+
+size_t LogDecoder::formatRecord(const LogRecord &rec) {
+  size_t n = 0;
+  if(format == LOG_JSON) {
+    n = snprintf(line, sizeof(line), "%s", count ? ",\n" : "\n");
+  }
+  return(n + logFormat(rec, format, &line[n], sizeof(line) - n));
+}
+
+bool LogDecoder::nextLine() {
+  lineLen = 0;
+  linePos = 0;
+  if(finished) {
+    return(false);
+  }
+
+  if(!started) {
+    started = true;
+    LogHeader header;
+    if(!query.begin(header)) {
+      Serial.printf("[Log] Not a measurement log: %s\r\n", query.path());
+      finished = true;
+      return(false);
+    }
+    if(format == LOG_CSV) {
+      lineLen = snprintf(line, sizeof(line), "time");
+      for(size_t i = 0; i < NUM_LOG_FIELDS; i++) {
+        lineLen += snprintf(&line[lineLen], sizeof(line) - lineLen, ",%s", logFields[i].name);
+      }
+      lineLen += snprintf(&line[lineLen], sizeof(line) - lineLen, "\r\n");
+    } else {
+      lineLen = snprintf(line, sizeof(line), "{\"devEUI\":\"%08X%08X\",\"firmware\":\"%.*s\",\"records\":[",
+                         (uint32_t)(header.devEUI >> 32), (uint32_t)header.devEUI,
+                         (int)sizeof(header.firmware), header.firmware);
+    }
+    return(true);
+  }
+
+  LogRecord rec;
+  if(query.next(rec)) {
+    lineLen = formatRecord(rec);
+    count++;
+    return(true);
+  }
+
+  finished = true;
+  if(format == LOG_JSON) {
+    lineLen = snprintf(line, sizeof(line), "\n]}\n");
+    return(true);
+  }
+  return(false);
+}
+
+size_t LogDecoder::read(uint8_t *buf, size_t maxLen) {
+  size_t n = 0;
+  while(n < maxLen) {
+    if(linePos == lineLen && !nextLine()) {
+      break;
+    }
+    size_t len = min(lineLen - linePos, maxLen - n);
+    memcpy(&buf[n], &line[linePos], len);
+    linePos += len;
+    n += len;
+  }
+  return(n);
+}
@@ -0,0 +1,223 @@
+#ifndef _DATALOG_H
+#define _DATALOG_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+// Measurements are logged to one binary file per day, /<yyyy-mm-dd>.bin. A file
+// starts with a LogHeader, followed by fixed-size LogRecords. Both are 64 bytes,
+// such that a record never straddles a flash page. Values are stored as fixed-point
+// integers at the resolution of the sensor; a value that was not measured is stored
+// as the LOG_NA_* value of its type.
+//
+// Once a day is over, its file is packed: the header gets LOG_FLAG_PACKED and is
+// followed by blocks of up to LOG_PACK_RECORDS records. In a block, the records are
+// stored without their CRC as the bytewise difference with the previous record,
+// transposed so that the same byte of all records is adjacent, and LZSS-compressed.
+// Blocks are independent, so a reader can skip them by their LogBlock header.
+
+#define LOG_MAGIC         0x424C4A4D      // "MJLB"
+#define LOG_VERSION       1
+#define LOG_PAGE_SIZE     256             // flash program page
+#define LOG_BATCH_BYTES   (2 * LOG_PAGE_SIZE)   // records are written up to these boundaries
+#define LOG_STAGE_RECORDS 16              // records that can be staged in RTC memory
+#define LOG_PACK_RECORDS  32              // records per packed block
+#define LOG_FLAG_PACKED   0x01
+#define LOG_NA_U8         UINT8_MAX
+#define LOG_NA_I16        INT16_MIN
+#define LOG_NA_U16        UINT16_MAX
+#define LOG_NA_I32        INT32_MIN
+#define LOG_NA_U32        UINT32_MAX
+
+struct __attribute__((packed)) LogHeader {
+  uint32_t magic;
+  uint8_t  version;
+  uint8_t  recordSize;
+  uint8_t  flags;
+  uint8_t  reserved;
+  uint64_t devEUI;
+  char     firmware[16];
+  uint32_t records;                   // packed files only
+  uint8_t  padding[28];
+};
+
+struct __attribute__((packed)) LogBlock {
+  uint32_t time;                      // of the first record
+  uint16_t size;                      // compressed bytes that follow
+  uint16_t crc;                       // CRC16 of the records without their CRC
+  uint8_t  records;
+};
+
+struct __attribute__((packed)) LogRecord {
+  uint32_t time;                      // UTC, seconds since epoch
+  int32_t  lat, lon;                  // 1e-7 deg
+  int16_t  alt;                       // 0.1 m
+  uint8_t  hdop;                      // 0.1
+  uint8_t  sats;
+  uint16_t batt;                      // mV
+  int16_t  temp;                      // BME280: 0.01 degC
+  uint16_t humi;                      // BME280: 0.01 %RH
+  uint32_t pres;                      // BME280: 0.1 Pa
+  float    lumi;                      // TSL2591: lux
+  uint16_t uva, uvb;                  // AS7331: 0.1 uW/cm2 (UVC does not reach the ground)
+  uint16_t co2;                       // SCD41: ppm
+  int16_t  scdTemp;                   // SCD41: 0.01 degC
+  uint16_t scdHumi;                   // SCD41: 0.01 %RH
+  uint16_t pm1_0, pm2_5, pm4_0, pm10; // SEN5x: 0.1 ug/m3
+  int16_t  temp5x;                    // SEN5x: 0.005 degC
+  int16_t  humi5x;                    // SEN5x: 0.01 %RH
+  int16_t  vocIndex, noxIndex;        // SEN5x: 0.1
+  uint16_t dbMin, dbAvg, dbMax;       // microphone: 0.01 dB(A)
+  uint16_t crc;                       // CRC16 of all preceding bytes
+};
+
+static_assert(sizeof(LogHeader) == 64, "LogHeader must fill a quarter flash page");
+static_assert(sizeof(LogRecord) == 64, "LogRecord must fill a quarter flash page");
+
+// days since 1970-01-01 of a civil date, and the path of the file of such a day
+uint16_t dayNumber(int year, int month, int day);
+void dayPath(uint16_t day, char *path, size_t len);
+bool dayOfPath(const char *path, uint16_t &day);
+
+// UTC seconds from "yyyy-mm-dd[Thh:mm[:ss]]" or a plain number of seconds, 0 if invalid
+uint32_t logParseTime(const char *str);
+
+// incremented after each change of the firmware to the filesystem is complete, so that a
+// listing can be cached: one read during a change is read again
+extern volatile uint32_t fsChanges;
+
+// conversion from a float to the fixed-point storage format
+uint8_t logU8(double value, double scale);
+int16_t logI16(double value, double scale);
+uint16_t logU16(double value, double scale);
+int32_t logI32(double value, double scale);
+uint32_t logU32(double value, double scale);
+
+// The index of the day files, kept up to date by flash.h. Valid when its magic is
+// STORAGE_MAGIC; readers elsewhere fall back to walking the filesystem otherwise.
+#define STORAGE_MAX_DAYS  732             // number of day files that are kept at most
+#define STORAGE_MAGIC     0x58444E49      // "INDX"
+
+struct StorageIndex {
+  uint32_t magic;
+  uint32_t quotaBytes;
+  uint32_t otherBytes;                // files that are not day files
+  uint32_t logBytes;                  // all day files together
+  uint16_t first;                     // ring position of the oldest day
+  uint16_t count;
+  uint16_t packed;                    // number of oldest days that are known to be packed
+  uint16_t days[STORAGE_MAX_DAYS];    // days since 1970-01-01, oldest first
+};
+
+extern StorageIndex storage;
+
+static inline uint16_t storageDay(uint16_t i) {
+  return(storage.days[(storage.first + i) % STORAGE_MAX_DAYS]);
+}
+
+// Append a record to the day file at path. Records are staged in RTC memory until
+// they fill the file up to the next LOG_BATCH_BYTES boundary, the day changes or
+// logFlush() is called. Both return the number of bytes written to the file.
+size_t logAppend(const char *path, LogRecord &rec);
+size_t logFlush();
+
+// Cut off a partial last flush of a day file, e.g. when power was lost while writing.
+// Returns the number of bytes removed, or -1 on failure.
+int32_t logRepair(const char *path);
+
+// The most recent record, which stays in RTC memory after it was written to flash.
+// Returns false if nothing was logged since power-on.
+bool logLatest(LogRecord &rec);
+
+// print the staging state and the flash writes to the current day file
+void logReport();
+
+// Pack a closed day file in place. Returns the number of bytes saved, 0 if it was
+// packed already, or -1 on failure.
+int32_t logPack(const char *path);
+
+// Sequential reading of the records of a plain or packed day file. Records with an
+// invalid CRC (e.g. a write interrupted by a reset) are skipped.
+class LogReader {
+public:
+  LogReader(File file) : file(file) {}
+
+  // start over on another file (or none), without copying a reader
+  void open(File f);
+  bool begin(LogHeader &header);
+  bool seek(uint32_t time);
+  bool next(LogRecord &rec);
+  uint32_t skipped = 0;
+  File file;
+
+private:
+  bool packed = false;
+  LogRecord block[LOG_PACK_RECORDS];
+  uint8_t blockLen = 0;
+  uint8_t blockPos = 0;
+
+  bool readBlock();
+};
+
+// The records in [from, to) of the day files, or of a single file. In a plain file the
+// first record is found by bisection, in a packed file by skipping blocks on their
+// LogBlock header, so that the cost follows the size of the result rather than that
+// of the files. The day files are found in the storage index. Records that are still
+// staged are included.
+class LogQuery {
+public:
+  LogQuery(File file) : reader(file), single(true) {}
+  LogQuery(uint32_t from, uint32_t to);
+
+  bool begin(LogHeader &header);
+  bool next(LogRecord &rec);
+  uint32_t skipped() const { return(skippedDays + reader.skipped); }
+  const char *path() { return(reader.file ? reader.file.path() : ""); }
+
+private:
+  LogReader reader;
+  bool single;
+  uint32_t from = 0;
+  uint32_t to = UINT32_MAX;
+  uint32_t day = 1;
+  uint32_t lastDay = 0;
+  uint32_t skippedDays = 0;
+  uint32_t stagedSeq = 0;
+  bool staged = false;
+
+  bool openDay(LogHeader &header);
+};
+
+enum LogFormat {
+  LOG_CSV,
+  LOG_JSON
+};
+
+// a record as a line of CSV (see LogDecoder for the columns) or a JSON object
+size_t logFormat(const LogRecord &rec, LogFormat format, char *buf, size_t len);
+
+// Streaming export of a binary log file. Each call to read() produces the next part
+// of the output, so that a file of any size can be served with a small buffer.
+class LogDecoder {
+public:
+  LogDecoder(File file, LogFormat format) : query(file), format(format) {}
+  LogDecoder(uint32_t from, uint32_t to, LogFormat format) : query(from, to), format(format) {}
+
+  size_t read(uint8_t *buf, size_t maxLen);
+  uint32_t skipped() const { return(query.skipped()); }
+
+private:
+  LogQuery query;
+  LogFormat format;
+  uint32_t count = 0;
+  bool started = false;
+  bool finished = false;
+  char line[512];
+  size_t lineLen = 0;
+  size_t linePos = 0;
+
+  bool nextLine();
+  size_t formatRecord(const LogRecord &rec);
+};
+
+#endif
@@ -520,26 +520,22 @@ class Display2_4G : public DisplayStyle {
       st7735.setTextSize(2);
       st7735.setTextColor(ST7735_WHITE, ST7735_BLACK);
 
-      String start, end;
+      size_t ssidLen = strlen(cfg.wl2g4.ssid);
+      size_t passLen = strlen(cfg.wl2g4.pass);
+      size_t userLen = strlen(cfg.wl2g4.user);
       st7735.setCursor(31, 3);
-      if(cfg.wl2g4.ssid.length() <= 10) {
+      if(ssidLen <= 10) {
         st7735.printf("%10s", cfg.wl2g4.ssid);
       } else {
-        start = cfg.wl2g4.ssid.substring(0, 4);
-        end = cfg.wl2g4.ssid.substring(cfg.wl2g4.ssid.length() - 4, cfg.wl2g4.ssid.length());
-        st7735.printf("%s__%s", start, end);
+        st7735.printf("%.4s__%s", cfg.wl2g4.ssid, &cfg.wl2g4.ssid[ssidLen - 4]);
       }
 
       st7735.setCursor(31, 23);
-      start = cfg.wl2g4.pass.substring(0, 1);
-      end = cfg.wl2g4.pass.substring(cfg.wl2g4.pass.length() - 1, cfg.wl2g4.pass.length());
-      st7735.printf("%s________%s", start, end);
+      st7735.printf("%.1s________%s", cfg.wl2g4.pass, passLen ? &cfg.wl2g4.pass[passLen - 1] : "");
 
       st7735.setCursor(31, 43);
-      if(cfg.wl2g4.user.length() > 0) {
-        start = cfg.wl2g4.user.begin();
-        end = cfg.wl2g4.user.end();
-        st7735.printf("%s________%s", start, end);
+      if(userLen > 0) {
+        st7735.printf("%.1s________%s", cfg.wl2g4.user, &cfg.wl2g4.user[userLen - 1]);
       } else {
         st7735.printf("          ");
       }
@@ -843,7 +839,7 @@ void selectMenu(int val) {
     case MENU_ABT: {
       sprintf(devAddrText,"Add: %08X", node.getDevAddr());
       displayMenus[MENU_ABT]->setCallback(1, devAddrText,        0xB5F6, false, NULL);
-      displayMenus[MENU_ABT]->setCallback(2, cfg.wl2g4.name.c_str(), 0xB5F6, false, NULL);
+      displayMenus[MENU_ABT]->setCallback(2, cfg.wl2g4.name, 0xB5F6, false, NULL);
       break;
     }
     default:
@@ -951,7 +947,7 @@ void loadMenus() {
   displayMenus[MENU_ABT]->setCallback(0, "    About    ",   0xB5F6, false, NULL);
   sprintf(devAddrText,"Add: %08X", node.getDevAddr());
   displayMenus[MENU_ABT]->setCallback(1, devAddrText,        0xB5F6, false, NULL);
-  displayMenus[MENU_ABT]->setCallback(2, cfg.wl2g4.name.c_str(), 0xB5F6, false, NULL);
+  displayMenus[MENU_ABT]->setCallback(2, cfg.wl2g4.name, 0xB5F6, false, NULL);
   displayMenus[MENU_ABT]->setCallback(3, "FW " MJLO_VERSION, 0xB5F6, false, NULL);
   displayMenus[MENU_ABT]->setCallback(4, "    LRF-1    ",    0xB5F6, false, NULL);
   displayMenus[MENU_ABT]->setCallback(5, "   Kroonos   ",    0xB5F6, false, NULL);
@@ -0,0 +1,78 @@
+#include <Arduino.h>
+#include <stdarg.h>
+#include <time.h>
+#include "events.h"
+
+volatile uint8_t eventClients = 0;
+
+// ring[pos % EVENT_BUFFER] holds byte pos of the stream, for the last EVENT_BUFFER bytes
+static uint8_t ring[EVENT_BUFFER];
+static uint32_t head = 0;
+static SemaphoreHandle_t eventLock = xSemaphoreCreateMutex();
+
+static void ringWrite(const char *data, size_t len) {
+  size_t at = head % EVENT_BUFFER;
+  size_t first = min(len, (size_t)EVENT_BUFFER - at);
+  memcpy(&ring[at], data, first);
+  memcpy(ring, &data[first], len - first);
+  head += len;
+}
+
+void eventPublish(const char *type, const char *data) {
+  size_t len = strlen(data);
+  if(!eventClients || len + 32 > EVENT_BUFFER) {
+    return;
+  }
+  xSemaphoreTake(eventLock, portMAX_DELAY);
+  ringWrite("event: ", 7);
+  ringWrite(type, strlen(type));
+  ringWrite("\ndata: ", 7);
+  ringWrite(data, len);
+  ringWrite("\n\n", 2);
+  xSemaphoreGive(eventLock);
+}
+
+void eventPublishf(const char *type, const char *fmt, ...) {
+  if(!eventClients) {
+    return;
+  }
+  time_t t = time(NULL);
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  char data[256];
+  size_t n = strftime(data, sizeof(data), "{\"time\":\"%Y-%m-%dT%H:%M:%SZ\",", &tm);
+
+  va_list args;
+  va_start(args, fmt);
+  n += vsnprintf(&data[n], sizeof(data) - n, fmt, args);
+  va_end(args);
+  if(n + 2 > sizeof(data)) {
+    return;                           // truncated
+  }
+  strcpy(&data[n], "}");
+  eventPublish(type, data);
+}
+
+uint32_t eventPosition() {
+  return(head);
+}
+
+size_t eventRead(uint32_t &pos, uint8_t *buf, size_t len) {
+  xSemaphoreTake(eventLock, portMAX_DELAY);
+  if(head - pos > EVENT_BUFFER) {
+    // overwritten: continue after the end of the oldest event that is still complete
+    pos = head - EVENT_BUFFER;
+    while(pos + 1 < head && !(ring[pos % EVENT_BUFFER] == '\n' && ring[(pos + 1) % EVENT_BUFFER] == '\n')) {
+      pos++;
+    }
+    pos = min(pos + 2, head);
+  }
+  size_t n = min((size_t)(head - pos), len);
+  size_t at = pos % EVENT_BUFFER;
+  size_t first = min(n, (size_t)EVENT_BUFFER - at);
+  memcpy(buf, &ring[at], first);
+  memcpy(&buf[first], ring, n - first);
+  pos += n;
+  xSemaphoreGive(eventLock);
+  return(n);
+}
@@ -0,0 +1,31 @@
+#ifndef _EVENTS_H
+#define _EVENTS_H
+
+#include <Arduino.h>
+
+// Live measurements for the /events stream of the web server (Server-Sent Events).
+// An event is formatted once into a ring buffer, which every client reads from at its
+// own position; a client that falls more than the buffer behind skips to the oldest
+// complete event. Event types:
+//   record   every logged record, as in the JSON export
+//   mic      the sound level of every second of a measurement
+//   gnss     every new fix of the receiver
+
+#define EVENT_BUFFER      4096        // bytes of the most recent events
+#define EVENT_MAX_CLIENTS 4
+
+// connected clients; producers skip formatting an event when there are none
+extern volatile uint8_t eventClients;
+
+// publish data, a single line of JSON, as an event of the given type
+void eventPublish(const char *type, const char *data);
+
+// as eventPublish(), with the fields in fmt following the current time
+void eventPublishf(const char *type, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Copy the stream from position pos into buf, and advance pos. A new client starts at
+// eventPosition(). Returns the number of bytes, 0 if there is nothing new.
+uint32_t eventPosition();
+size_t eventRead(uint32_t &pos, uint8_t *buf, size_t len);
+
+#endif
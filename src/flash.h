@@ -3,35 +3,171 @@
 
 #include <Arduino.h>
 #include "config.h"
+#include "datalog.h"
 #include <LittleFS.h>
 
-void checkAvailableStorage(const char *dateBuf) {
+// Retention of the daily measurement logs. The day files and the bytes they use are
+// indexed in RTC memory, so that the quota can be checked without walking the
+// filesystem (LittleFS.usedBytes() traverses all blocks). The index is only rebuilt
+// after a reset, or after files were changed through the web browser. Days before
+// today are packed (see datalog.h) while the device waits for its sensors.
+
+#define STORAGE_QUOTA       0.8         // fraction of the filesystem that may be used
+
+RTC_DATA_ATTR StorageIndex storage = { 0 };     // see datalog.h
+
+static void storageEvictOldest() {
+    char path[16];
+    dayPath(storageDay(0), path, sizeof(path));
+
+    File file = LittleFS.open(path, FILE_READ);
+    uint32_t size = file ? file.size() : 0;
+    file.close();
+
+    Serial.printf("Removing file %s (%u bytes)\r\n", path, (unsigned)size);
+    if(!LittleFS.remove(path)) {
+        Serial.printf("Failed to remove file\r\n");
+    }
+    fsChanges++;
+    storage.logBytes -= min(size, storage.logBytes);
+    storage.first = (storage.first + 1) % STORAGE_MAX_DAYS;
+    storage.count--;
+    if(storage.packed) {
+        storage.packed--;
+    }
+}
+
+// add a day in date order; normally it is the newest, but the clock may have been reset
+static void storageInsert(uint16_t day) {
+    if(storage.count == STORAGE_MAX_DAYS) {
+        storageEvictOldest();
+    }
+    uint16_t i = storage.count;
+    while(i > 0 && storageDay(i - 1) > day) {
+        storage.days[(storage.first + i) % STORAGE_MAX_DAYS] = storageDay(i - 1);
+        i--;
+    }
+    storage.days[(storage.first + i) % STORAGE_MAX_DAYS] = day;
+    storage.count++;
+    storage.packed = min(storage.packed, i);
+}
+
+// index all files in the root of the filesystem
+void storageRebuild() {
+    memset(&storage, 0, sizeof(storage));
+    storage.quotaBytes = LittleFS.totalBytes() * STORAGE_QUOTA;
+
     File root = LittleFS.open("/");
     File file = root.openNextFile();
+    while(file) {
+        uint16_t day;
+        if(file.isDirectory()) {
+            // not written by the firmware, nothing to account for
+        } else if(dayOfPath(file.name(), day)) {
+            uint32_t size = file.size();
+            String path = file.path();
+            file.close();
+            if(storage.count == STORAGE_MAX_DAYS && day < storageDay(0)) {
+                LittleFS.remove(path);      // older than all days that are kept
+                fsChanges++;
+            } else {
+                storage.logBytes += size;
+                storageInsert(day);
+            }
+        } else {
+            storage.otherBytes += file.size();
+        }
+        file = root.openNextFile();
+    }
+    root.close();
+
+    // the index is lost with power, as may be the end of the last flush to the newest day
+    if(storage.count) {
+        char path[16];
+        dayPath(storageDay(storage.count - 1), path, sizeof(path));
+        int32_t removed = logRepair(path);
+        if(removed > 0) {
+            storage.logBytes -= min((uint32_t)removed, storage.logBytes);
+        }
+    }
+    storage.magic = STORAGE_MAGIC;
+}
+
+// files were changed behind the back of the index
+void storageInvalidate() {
+    storage.magic = 0;
+}
 
-    while (LittleFS.usedBytes() > 0.8 * LittleFS.totalBytes()) {
-        if(!file)
+// remove the oldest days until within the quota and retention period; today is always kept
+void storageEnforce() {
+    uint16_t retention = cfg.operation.retention;
+    while(storage.count > 1) {
+        bool full = storage.otherBytes + storage.logBytes > storage.quotaBytes;
+        bool expired = retention && storageDay(storage.count - 1) - storageDay(0) >= retention;
+        if(!full && !expired) {
             break;
+        }
+        storageEvictOldest();
+    }
+}
 
-        String path = file.path();
-        file.close();
+// called before logging to a day file; only a new day needs any work
+void storageOpenDay(uint16_t day) {
+    if(storage.magic != STORAGE_MAGIC) {
+        storageRebuild();
+    }
+    if(storage.count && storageDay(storage.count - 1) == day) {
+        return;
+    }
+    for(uint16_t i = 0; i < storage.count; i++) {
+        if(storageDay(i) == day) {
+            return;
+        }
+    }
+    storageInsert(day);
+    storageEnforce();
+}
 
-        Serial.printf("Removing file %s (%d)\r\n", path.c_str(), path.length());
-        if(!LittleFS.remove(path)) {
-            Serial.printf("Failed to remove file\r\n");
+// account for bytes appended to a day file
+void storageAdded(size_t bytes) {
+    if(storage.magic != STORAGE_MAGIC) {
+        return;     // counted when the index is rebuilt
+    }
+    storage.logBytes += bytes;
+    if(storage.otherBytes + storage.logBytes > storage.quotaBytes) {
+        storageEnforce();
+    }
+}
+
+// pack the oldest day that is not packed yet; one file per call, as it takes a while
+void storageCompact() {
+    if(storage.magic != STORAGE_MAGIC) {
+        storageRebuild();
+    }
+    while(storage.packed + 1 < storage.count) {
+        char path[16];
+        dayPath(storageDay(storage.packed), path, sizeof(path));
+        int32_t saved = logPack(path);
+        storage.packed++;               // a file that cannot be packed stays as it is
+        if(saved > 0) {
+            storage.logBytes -= min((uint32_t)saved, storage.logBytes);
+            return;
         }
-        file = root.openNextFile();
     }
-    
-    char fileBuf[16];
-    sprintf(fileBuf, "/%s.csv", dateBuf);
-    Serial.printf("Opening file %s for appending\r\n", fileBuf);
-    file = LittleFS.open(fileBuf, "a");
-    if (!file.size()) {
-        Serial.printf("Created new file\r\n");
-        file.println("time,dev_eui,f_port,PayloadHex");
+}
+
+void storageReport() {
+    if(storage.magic != STORAGE_MAGIC) {
+        storageRebuild();
     }
-    file.close();
+    char oldest[16] = "-", newest[16] = "-";
+    if(storage.count) {
+        dayPath(storageDay(0), oldest, sizeof(oldest));
+        dayPath(storageDay(storage.count - 1), newest, sizeof(newest));
+    }
+    Serial.printf("Logs: %u days (%s .. %s, %u packed), %u bytes, other files %u bytes, quota %u bytes\r\n",
+                  storage.count, oldest, newest, storage.packed, (unsigned)storage.logBytes,
+                  (unsigned)storage.otherBytes, (unsigned)storage.quotaBytes);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -32,6 +32,10 @@
 #include "esp_chip_info.h"
 #include "esp_flash.h"
 #include "config.h"
+#include "datalog.h"
+#include "events.h"
+#include "payload.h"
+#include <vector>
 
 #include "fs_browser.h"
 
@@ -44,68 +48,278 @@ String Version_MQ = MJLO_VERSION;
 String Version_FB = "v1.1";
 //################ VARIABLES ###########################################
 
-typedef struct
-{
-  String filename;
-  String ftype;
-  String fsize;
-} fileinfo;
-
-String   webpage, MessageLine;
-fileinfo Filenames[366]; // Enough for most purposes!
+String   MessageLine;
 bool   StartupErrors = false;
-int    start, downloadtime = 1, uploadtime = 1, downloadsize, uploadsize, downloadrate, uploadrate, numfiles;
+int    start, downloadtime = 1, uploadtime = 1, downloadsize, uploadsize, downloadrate, uploadrate;
+
+//################ DIRECTORY INDEX #####################################
+// The entries of the root of the filesystem, as fixed-size records with the names in
+// one pool. The pages list the index; it is only read again from the filesystem after
+// a file was changed, which is counted by fsChanges (see datalog.h).
+struct DirEntry {
+  uint32_t size;                      // bytes
+  uint16_t name;                      // offset in dirNames
+  bool     isDir;
+};
+
+std::vector<DirEntry> dirEntries;
+std::vector<char> dirNames;
+uint32_t dirChanges = UINT32_MAX;     // fsChanges when the index was read
+
+void dirRefresh() {
+  if (dirChanges == fsChanges) return;
+  dirChanges = fsChanges;
+  dirEntries.clear();
+  dirNames.clear();
+  File root = FS.open("/");
+  for (File file = root ? root.openNextFile() : File(); file; file = root.openNextFile()) {
+    const char *name = file.name();
+    if (name[0] == '/') name++;
+    dirEntries.push_back({ (uint32_t)file.size(), (uint16_t)dirNames.size(), file.isDirectory() });
+    dirNames.insert(dirNames.end(), name, name + strlen(name) + 1);
+  }
+  root.close();
+}
+
+inline const char *dirName(uint16_t i) {
+  return &dirNames[dirEntries[i].name];
+}
+
+//################ CHUNKED PAGES #######################################
+// Pages are generated while they are sent, as a chunked response. Between the header
+// and the footer, the generator is called with an increasing step and produces the
+// next part of the page, such as one table row per directory entry, until it returns
+// false with the last part. Constant text is sent from where it is, so the heap used
+// by a page does not depend on its length.
+class ChunkedPage {
+public:
+  typedef std::function<bool(ChunkedPage &page, uint32_t step)> Generator;
+
+  ChunkedPage(Generator generator) : generator(generator) {}
+
+  void text(const char *constant) { this->constant = constant; }  // sent before the printed part
+  void print(const String &str) { part += str; }
+  size_t read(uint8_t *buf, size_t maxLen);
+
+private:
+  Generator generator;
+  uint32_t step = 0;
+  bool started = false;
+  bool ended = false;
+  const char *constant = "";
+  String part;
+  size_t partPos = 0;
+};
+
+size_t ChunkedPage::read(uint8_t *buf, size_t maxLen) {
+  size_t n = 0;
+  while (n < maxLen) {
+    if (*constant) {
+      size_t len = strnlen(constant, maxLen - n);
+      memcpy(&buf[n], constant, len);
+      constant += len;
+      n += len;
+    } else if (partPos < part.length()) {
+      size_t len = min(part.length() - partPos, maxLen - n);
+      memcpy(&buf[n], part.c_str() + partPos, len);
+      partPos += len;
+      n += len;
+    } else {
+      part = "";              // keeps its buffer for the next part
+      partPos = 0;
+      if (!started) {
+        started = true;
+        constant = HTML_Header.c_str();
+      } else if (generator) {
+        if (!generator(*this, step++)) {
+          generator = nullptr;  // releases what it captured
+        }
+      } else if (!ended) {
+        ended = true;
+        constant = HTML_Footer.c_str();
+      } else {
+        break;
+      }
+    }
+  }
+  return n;
+}
+
+void sendPage(AsyncWebServerRequest *request, ChunkedPage::Generator generator) {
+  std::shared_ptr<ChunkedPage> page = std::make_shared<ChunkedPage>(generator);
+  request->send(request->beginChunkedResponse("text/html", [page](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                              { return page->read(buffer, maxLen); }));
+}
+
+// a page of which the body is known in advance; a constant body is not copied
+void sendPage(AsyncWebServerRequest *request, const char *body) {
+  sendPage(request, [body](ChunkedPage &page, uint32_t step) -> bool {
+    page.text(body);
+    return false;
+  });
+}
+
+void sendPage(AsyncWebServerRequest *request, const String &body) {
+  sendPage(request, [body](ChunkedPage &page, uint32_t step) -> bool {
+    page.print(body);
+    return false;
+  });
+}
+
+// s as the contents of a JSON string, cut off at a whole character if buf is too small
+static void jsonEscape(const char *s, char *buf, size_t len) {
+  size_t n = 0;
+  for (; *s && n + 7 <= len; s++) {
+    if (*s == '"' || *s == '\\') {
+      buf[n++] = '\\';
+      buf[n++] = *s;
+    } else if ((uint8_t)*s < 0x20) {
+      n += snprintf(&buf[n], len - n, "\\u%04x", *s);
+    } else {
+      buf[n++] = *s;
+    }
+  }
+  buf[n] = '\0';
+}
+
+// the device name for a file or directory, "logs" if it has none; characters that are
+// not safe in a file name or in a quoted header value are replaced
+static String archiveName() {
+  char name[sizeof(cfg.wl2g4.name)];
+  strlcpy(name, strlen(cfg.wl2g4.name) ? cfg.wl2g4.name : "logs", sizeof(name));
+  for (char *c = name; *c; c++) {
+    if ((uint8_t)*c < 0x20 || (uint8_t)*c >= 0x7F || strchr("\"\\/:*?<>|", *c)) {
+      *c = '_';
+    }
+  }
+  return String(name);
+}
 
 wifi_mode_t wifiMode = WIFI_MODE_NULL;
 IPAddress IP;
 
+// The access point and address of the last connection, kept in RTC memory. With these,
+// a reconnect after deep sleep skips the scan for the network and the DHCP exchange,
+// which brings it down from seconds to a few hundred milliseconds. A change of settings
+// or a failed attempt drops the cache, after which the full procedure is used again.
+#define WIFI_CACHE_MAGIC   0x48434657   // "WFCH"
+#define WIFI_FAST_TIMEOUT  2000         // ms for a connection with the cached access point
+#define WIFI_LEASE_AGE     3600         // s that a DHCP lease is reused without asking
+
+struct WiFiCache {
+  uint32_t magic;
+  uint32_t cfgGeneration;
+  uint8_t  bssid[6];
+  uint8_t  channel;
+  uint32_t ip, gateway, subnet, dns;  // of the DHCP lease, 0 if none
+  uint32_t leaseTime;
+};
+
+RTC_DATA_ATTR WiFiCache wifiCache = { 0 };
+static bool mdnsStarted = false;
+
+static bool wifiCacheValid() {
+  return wifiCache.magic == WIFI_CACHE_MAGIC && wifiCache.cfgGeneration == cfgGeneration;
+}
+
+static void wifiCacheStore(bool leased) {
+  wifiCache.magic = WIFI_CACHE_MAGIC;
+  wifiCache.cfgGeneration = cfgGeneration;
+  memcpy(wifiCache.bssid, WiFi.BSSID(), sizeof(wifiCache.bssid));
+  wifiCache.channel = WiFi.channel();
+  if (leased) return;   // the cached lease was used, keep its age
+  if (cfg.wl2g4.ip) {
+    wifiCache.ip = 0;   // static address, nothing to cache
+    return;
+  }
+  wifiCache.ip = WiFi.localIP();
+  wifiCache.gateway = WiFi.gatewayIP();
+  wifiCache.subnet = WiFi.subnetMask();
+  wifiCache.dns = WiFi.dnsIP();
+  wifiCache.leaseTime = time(nullptr);
+}
+
+// start associating; with a cached access point on its channel, and a static or cached address
+static bool beginWiFi(bool fast) {
+  bool leased = false;
+  if (cfg.wl2g4.ip) {
+    WiFi.config(IPAddress(cfg.wl2g4.ip), IPAddress(cfg.wl2g4.gateway), IPAddress(cfg.wl2g4.subnet), IPAddress(cfg.wl2g4.gateway));
+  } else if (fast && wifiCache.ip && (uint32_t)time(nullptr) - wifiCache.leaseTime < WIFI_LEASE_AGE) {
+    WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway), IPAddress(wifiCache.subnet), IPAddress(wifiCache.dns));
+    leased = true;
+  } else {
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);   // DHCP
+  }
+
+  // an 'open' network has an empty password, WPA2 enterprise uses the identity set before
+  const char *pass = strlen(cfg.wl2g4.user) ? NULL : cfg.wl2g4.pass;
+  if (fast) {
+    WiFi.begin(cfg.wl2g4.ssid, pass, wifiCache.channel, wifiCache.bssid);
+  } else {
+    WiFi.begin(cfg.wl2g4.ssid, pass);
+  }
+  return leased;
+}
+
 bool connectWiFi() {
   wifiMode = WIFI_MODE_STA;
   Serial.printf("Attemping WiFi connection\r\n");
-  // WiFi.disconnect(true);
+  uint32_t started = millis();
+  WiFi.persistent(false);               // the settings are in cfg, don't write them to NVS on every connect
   bool mod = WiFi.mode(wifiMode);
+  Serial.printf("WiFi mode: %d\r\n", mod);
 
-  if (cfg.wl2g4.user == "") {
-    // the line below is for connecting to an 'open' network
-    wl_status_t begin = WiFi.begin(cfg.wl2g4.ssid.c_str(), cfg.wl2g4.pass.c_str());
-    Serial.printf("WiFi begin: %d . %d\r\n", mod, begin);
-  } else {
+  if (strlen(cfg.wl2g4.user) != 0) {
     // the lines below are for connecting to a WPA2 enterprise network 
     // (taken from the oficial wpa2_enterprise example from esp-idf)
-    ESP_ERROR_CHECK( esp_eap_client_set_identity((uint8_t *)cfg.wl2g4.user.c_str(), strlen(cfg.wl2g4.user.c_str())) );
-    ESP_ERROR_CHECK( esp_eap_client_set_username((uint8_t *)cfg.wl2g4.user.c_str(), strlen(cfg.wl2g4.user.c_str())) );
-    ESP_ERROR_CHECK( esp_eap_client_set_password((uint8_t *)cfg.wl2g4.pass.c_str(), strlen(cfg.wl2g4.pass.c_str())) );
+    ESP_ERROR_CHECK( esp_eap_client_set_identity((uint8_t *)cfg.wl2g4.user, strlen(cfg.wl2g4.user)) );
+    ESP_ERROR_CHECK( esp_eap_client_set_username((uint8_t *)cfg.wl2g4.user, strlen(cfg.wl2g4.user)) );
+    ESP_ERROR_CHECK( esp_eap_client_set_password((uint8_t *)cfg.wl2g4.pass, strlen(cfg.wl2g4.pass)) );
     ESP_ERROR_CHECK( esp_wifi_sta_enterprise_enable() );
-    WiFi.begin(cfg.wl2g4.ssid.c_str());
   }
 
-  Serial.printf("Connecting to [%s] with password [%s]...\r\n", cfg.wl2g4.ssid.c_str(), cfg.wl2g4.pass.c_str());
+  Serial.printf("Connecting to [%s] with password [%s]...\r\n", cfg.wl2g4.ssid, cfg.wl2g4.pass);
 
-  Serial.printf("Waiting for connection result..\r\n");
-  uint8_t wifiStatus = WiFi.waitForConnectResult(20000);
-  Serial.printf("Status: %d\r\n", wifiStatus);
+  uint8_t wifiStatus = WL_DISCONNECTED;
+  bool leased = false;
+  if (wifiCacheValid()) {
+    Serial.printf("Using cached access point on channel %u\r\n", wifiCache.channel);
+    leased = beginWiFi(true);
+    wifiStatus = WiFi.waitForConnectResult(WIFI_FAST_TIMEOUT);
+    if (wifiStatus != WL_CONNECTED) {
+      wifiCache.magic = 0;
+      WiFi.disconnect();
+    }
+  }
+  if (wifiStatus != WL_CONNECTED) {
+    Serial.printf("Waiting for connection result..\r\n");
+    leased = beginWiFi(false);
+    wifiStatus = WiFi.waitForConnectResult(20000);
+  }
+  Serial.printf("Status: %d after %u ms\r\n", wifiStatus, (unsigned)(millis() - started));
   switch (wifiStatus) {
     case WL_NO_SSID_AVAIL:
       return false;
     case WL_CONNECTED:
       IP = WiFi.localIP();
+      wifiCacheStore(leased);
       break;
     case WL_DISCONNECTED:
       WiFi.disconnect(true);
       wifiMode = WIFI_MODE_AP;
       WiFi.mode(wifiMode);
-      WiFi.softAP(cfg.wl2g4.ssid.c_str(), cfg.wl2g4.pass.c_str());
+      WiFi.softAP(cfg.wl2g4.ssid, cfg.wl2g4.pass);
       IP = WiFi.softAPIP();
       break;
   }
 
   Serial.printf("IP Address: %s\r\n", IP.toString().c_str());
-  if (WiFi.scanComplete() == -2) 
-    WiFi.scanNetworks(true);          // Complete an initial scan for WiFi networks, otherwise = 0 on first display!
-  
-  esp_err_t err = mdns_init();          // Initialise mDNS service
+  // networks are only scanned when the system page is viewed, see Display_System_Info()
+
+  esp_err_t err = mdnsStarted ? ESP_OK : mdns_init();   // Initialise mDNS service once
   if (!err) {
-    mdns_hostname_set(cfg.wl2g4.name.c_str());      // Set hostname
+    mdnsStarted = true;
+    mdns_hostname_set(cfg.wl2g4.name);      // Set hostname
   } else {
     printf("MDNS Init failed: %d\n", err);
   }
@@ -126,24 +340,43 @@ void start_file_browser() {
   server.on("/", HTTP_GET, [](AsyncWebServerRequest * request) {
     Serial.println("Home Page...");
     
-    Home(); // Build webpage ready for display
-    request->send(200, "text/html", webpage);
+    Home(request);
   });
 
   // ##################### DOWNLOAD HANDLER ##########################
   server.on("/download", HTTP_GET, [](AsyncWebServerRequest * request) {
     Serial.println("Downloading file...");
     
-    Select_File_For_Function("[DOWNLOAD]", "downloadhandler"); // Build webpage ready for display
-    request->send(200, "text/html", webpage);
+    Select_File_For_Function(request, "[DOWNLOAD]", "downloadhandler",
+      "<h3>Or Download the day logs of a period as one archive</h3>"
+      "<form action='/archive' method='get'>"
+      "From <input type='date' name='from' required> "
+      "to <input type='date' name='to' required> (inclusive) "
+      "<input type='submit' value='Download'></form>");
+  });
+
+  // Set handler for '/archive[?from=&to=]', a tar of the day logs from the day of from up to the day of to
+  server.on("/archive", HTTP_GET, [](AsyncWebServerRequest * request) {
+    Serial.println("Archive handler started...");
+    uint32_t from = request->hasParam("from") ? logParseTime(request->getParam("from")->value().c_str()) : 0;
+    uint32_t to = request->hasParam("to") ? logParseTime(request->getParam("to")->value().c_str()) : UINT32_MAX;
+    if ((request->hasParam("from") && !from) || !to || to < from) {
+      request->send(400, "text/plain", "Invalid period");
+      return;
+    }
+    String name = archiveName();
+    std::shared_ptr<TarStream> tar = std::make_shared<TarStream>(name, from / 86400, to / 86400);
+    AsyncWebServerResponse *response = request->beginResponse("application/x-tar", tar->length(), [tar](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                              { return tar->read(buffer, maxLen); });
+    response->addHeader("Content-Disposition", "attachment; filename=\"" + name + ".tar\"");
+    request->send(response);
   });
 
   // ##################### UPLOAD HANDLERS ###########################
   server.on("/upload", HTTP_GET, [](AsyncWebServerRequest * request) {
     Serial.println("Uploading file...");
     
-    UploadFileSelect(); // Build webpage ready for display
-    request->send(200, "text/html", webpage);
+    UploadFileSelect(request);
   });
 
   // Set handler for '/handleupload'
@@ -162,6 +395,7 @@ void start_file_browser() {
       Serial.print("Starting to Format Filing System...");
       FS.end();
       bool formatted = FS.format();
+      fsChanges++;
       if (formatted) {
         Serial.println(" Successful Filing System Format...");
       }
@@ -176,47 +410,156 @@ void start_file_browser() {
   server.on("/stream", HTTP_GET, [](AsyncWebServerRequest * request) {
     Serial.println("Streaming file...");
           
-    Select_File_For_Function("[STREAM]", "streamhandler"); // Build webpage ready for display
-    request->send(200, "text/html", webpage);
+    Select_File_For_Function(request, "[STREAM]", "streamhandler");
+  });
+
+  // ##################### EXPORT HANDLER ############################
+  server.on("/export", HTTP_GET, [](AsyncWebServerRequest * request) {
+    Serial.println("Exporting log...");
+          
+    Select_File_For_Function(request, "[EXPORT]", "exporthandler",
+      "<h3>Or Export the measurements of a period</h3>"
+      "<form action='/query' method='get'>"
+      "From <input type='datetime-local' name='from' required> "
+      "to <input type='datetime-local' name='to' required> (UTC) "
+      "<select name='format'><option value='csv'>CSV</option><option value='json'>JSON</option></select> "
+      "<input type='submit' value='Export'></form>");
+  });
+
+  // Set handler for '/query?from=&to=[&format=json]', times as yyyy-mm-ddThh:mm or seconds
+  server.on("/query", HTTP_GET, [](AsyncWebServerRequest * request) {
+    Serial.println("Query handler started...");
+    uint32_t from = request->hasParam("from") ? logParseTime(request->getParam("from")->value().c_str()) : 0;
+    uint32_t to = request->hasParam("to") ? logParseTime(request->getParam("to")->value().c_str()) : 0;
+    if (!from || to <= from) {
+      request->send(400, "text/plain", "Invalid period");
+      return;
+    }
+    bool json = request->hasParam("format") && request->getParam("format")->value() == "json";
+    std::shared_ptr<LogDecoder> decoder = std::make_shared<LogDecoder>(from, to, json ? LOG_JSON : LOG_CSV);
+    AsyncWebServerResponse *response = request->beginChunkedResponse(json ? "application/json" : "text/csv",
+                                                                      [decoder](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                                      { return decoder->read(buffer, maxLen); });
+    response->addHeader("Content-Disposition", "attachment; filename=\"" + String(from) + "-" + String(to) + (json ? ".json\"" : ".csv\""));
+    request->send(response);
   });
 
   // ##################### RENAME HANDLER ############################
   server.on("/rename", HTTP_GET, [](AsyncWebServerRequest * request) {
     Serial.println("Renaming file...");
     
-    File_Rename(); // Build webpage ready for display
-    request->send(200, "text/html", webpage);
+    File_Rename(request);
   });
 
   // ##################### DIR HANDLER ###############################
   server.on("/dir", HTTP_GET, [](AsyncWebServerRequest * request) {
     Serial.println("File Directory...");
     
-    Dir(request); // Build webpage ready for display
-    request->send(200, "text/html", webpage);
+    Dir(request);
   });
 
   // ##################### DELETE HANDLER ############################
   server.on("/delete", HTTP_GET, [](AsyncWebServerRequest * request) {
     Serial.println("Deleting file...");
           
-    Select_File_For_Function("[DELETE]", "deletehandler"); // Build webpage ready for display
-    request->send(200, "text/html", webpage);
+    Select_File_For_Function(request, "[DELETE]", "deletehandler");
   });
 
   // ##################### FORMAT HANDLER ############################
   server.on("/format", HTTP_GET, [](AsyncWebServerRequest * request) {
     Serial.println("Request to Format File System...");
           
-    Format(); // Build webpage ready for display
-    request->send(200, "text/html", webpage);
+    Format(request);
   });
 
   // ##################### SYSTEM HANDLER ############################
   server.on("/system", HTTP_GET, [](AsyncWebServerRequest * request) {
     
-    Display_System_Info(); // Build webpage ready for display
-    request->send(200, "text/html", webpage);
+    Display_System_Info(request);
+  });
+
+  // ##################### API HANDLERS #############################
+  // JSON for collectors; times are UTC, values in the units of the CSV export
+
+  // the latest measurement, from the record in RTC memory
+  server.on("/api/now", HTTP_GET, [](AsyncWebServerRequest * request) {
+    LogRecord rec;
+    if (!logLatest(rec)) {
+      request->send(404, "application/json", "{\"error\":\"no measurement yet\"}");
+      return;
+    }
+    char json[512];
+    logFormat(rec, LOG_JSON, json, sizeof(json));
+    request->send(200, "application/json", json);
+  });
+
+  // /api/history?from=&to=, times as yyyy-mm-ddThh:mm or seconds; the last 24 hours by default
+  server.on("/api/history", HTTP_GET, [](AsyncWebServerRequest * request) {
+    uint32_t to = request->hasParam("to") ? logParseTime(request->getParam("to")->value().c_str()) : time(NULL) + 1;
+    uint32_t from = request->hasParam("from") ? logParseTime(request->getParam("from")->value().c_str()) : to - 86400;
+    if (!from || to <= from) {
+      request->send(400, "application/json", "{\"error\":\"invalid period\"}");
+      return;
+    }
+    std::shared_ptr<LogDecoder> decoder = std::make_shared<LogDecoder>(from, to, LOG_JSON);
+    request->send(request->beginChunkedResponse("application/json", [decoder](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                { return decoder->read(buffer, maxLen); }));
+  });
+
+  server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest * request) {
+    LogRecord rec;
+    bool logged = logLatest(rec);
+    time_t now = time(NULL);
+    char stamp[24], latest[24] = "";
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    if (logged) {
+      time_t t = rec.time;
+      strftime(latest, sizeof(latest), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+    }
+    // the storage index (see flash.h) saves a traversal of all blocks on every poll
+    uint32_t used = storage.magic == STORAGE_MAGIC ? storage.logBytes + storage.otherBytes : FS.usedBytes();
+    char name[100];
+    jsonEscape(cfg.wl2g4.name, name, sizeof(name));
+    char json[512];
+    snprintf(json, sizeof(json),
+             "{\"devEUI\":\"%08X%08X\",\"name\":\"%s\",\"firmware\":\"%s\",\"time\":\"%s\",\"uptime\":%u,"
+             "\"latest\":%s%s%s,\"batt\":%d,\"heap\":%u,\"rssi\":%d,\"ip\":\"%s\",\"fsTotal\":%u,\"fsUsed\":%u}",
+             (uint32_t)(cfg.actvn.otaa.devEUI >> 32), (uint32_t)cfg.actvn.otaa.devEUI, name, MJLO_VERSION, stamp,
+             (unsigned)(millis() / 1000), logged ? "\"" : "", logged ? latest : "null", logged ? "\"" : "",
+             logged ? (int)rec.batt : -1, (unsigned)ESP.getFreeHeap(), (int)WiFi.RSSI(), IP.toString().c_str(),
+             (unsigned)FS.totalBytes(), (unsigned)used);
+    request->send(200, "application/json", json);
+  });
+
+  // /api/decode?port=&payload=: the values of an uplink, payload in hex, as the network server receives it
+  server.on("/api/decode", HTTP_GET, [](AsyncWebServerRequest * request) {
+    PayloadValues v;
+    if (!request->hasParam("port") || !request->hasParam("payload") ||
+        !payloadDecodeHex(request->getParam("port")->value().toInt(), request->getParam("payload")->value().c_str(), v)) {
+      request->send(400, "application/json", "{\"error\":\"invalid payload\"}");
+      return;
+    }
+    char json[512];
+    payloadFormat(v, PAYLOAD_JSON, json, sizeof(json));
+    request->send(200, "application/json", json);
+  });
+
+  // live measurements as Server-Sent Events; all clients read the same buffer, see events.h
+  server.on("/events", HTTP_GET, [](AsyncWebServerRequest * request) {
+    if (eventClients >= EVENT_MAX_CLIENTS) {
+      request->send(503, "text/plain", "Too many clients");
+      return;
+    }
+    eventClients++;
+    request->onDisconnect([]() { eventClients--; });
+    std::shared_ptr<uint32_t> pos = std::make_shared<uint32_t>(eventPosition());
+    AsyncWebServerResponse *response = request->beginChunkedResponse("text/event-stream", [pos](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      if (index == 0) return snprintf((char *)buffer, maxLen, "retry: 3000\n\n");   // sends the headers right away
+      size_t n = eventRead(*pos, buffer, maxLen);
+      return n ? n : RESPONSE_TRY_AGAIN;   // polled again by the server
+    });
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
   });
 
   // ##################### IMAGE HANDLER ############################
@@ -232,11 +575,14 @@ void start_file_browser() {
 
   server.begin();  // Start the server
   Serial.println("System started successfully...");
-  Directory();   // Update the file list
 }
 
 void end_file_browser() {
   server.end();
+  // the index is only needed while serving
+  std::vector<DirEntry>().swap(dirEntries);
+  std::vector<char>().swap(dirNames);
+  dirChanges = UINT32_MAX;
 }
 //#############################################################################################
 String HTML_Header = "\
@@ -269,6 +615,7 @@ h4{color:#333;text-align:center}\
 <a href='/dir'>Directory</a>\
 <a href='/download'>Download</a>\
 <a href='/stream'>Stream</a>\
+<a href='/export'>Export</a>\
 <a href='/delete'>Delete</a>\
 <a href='/system'>Status</a>\
 <a href='/update'>Update</a>\
@@ -285,141 +632,163 @@ String HTML_Footer = "\
 </html>";
 //#############################################################################################
 void Dir(AsyncWebServerRequest * request) {
-  String Fname1, Fname2;
-  int index = 0;
-  Directory(); // Get a list of the current files on the FS
-  webpage  = HTML_Header;
-  webpage += "<h3>File System Content</h3><br>";
-  if (numfiles > 0) {
-    webpage += "<table class='center'>";
-    webpage += "<tr><th>Type</th><th>File Name</th><th>File Size</th><th class='sp'></th><th>Type</th><th>File Name</th><th>File Size</th></tr>";
-    while (index < numfiles) {
-      Fname1 = Filenames[index].filename;
-      Fname2 = Filenames[index + 1].filename;
-      webpage += "<tr>";
-      webpage += "<td style = 'width:5%'>" + Filenames[index].ftype + "</td><td style = 'width:25%'>" + Fname1 + "</td><td style = 'width:10%'>" + Filenames[index].fsize + "</td>";
-      webpage += "<td class='sp'></td>";
-      if (index < numfiles - 1) {
-        webpage += "<td style = 'width:5%'>" + Filenames[index + 1].ftype + "</td><td style = 'width:25%'>" + Fname2 + "</td><td style = 'width:10%'>" + Filenames[index + 1].fsize + "</td>";
+  // rows of two entries
+  String message = MessageLine;
+  MessageLine = "";
+  dirRefresh();
+  sendPage(request, [message](ChunkedPage &page, uint32_t step) -> bool {
+    uint16_t next = (step - 1) * 2;
+    if (step == 0) {
+      page.print("<h3>File System Content</h3><br>");
+      if (dirEntries.empty()) {
+        page.print("<h2>No Files Found</h2>");
+        return false;
       }
-      webpage += "</tr>";
-      index = index + 2;
+      page.print("<table class='center'>");
+      page.print("<tr><th>Type</th><th>File Name</th><th>File Size</th><th class='sp'></th><th>Type</th><th>File Name</th><th>File Size</th></tr>");
+      return true;
     }
-    webpage += "</table>";
-    webpage += "<p style='background-color:yellow;'><b>" + MessageLine + "</b></p>";
-    MessageLine = "";
-  }
-  else
-  {
-    webpage += "<h2>No Files Found</h2>";
-  }
-  webpage += HTML_Footer;
-  request->send(200, "text/html", webpage);
-}
-//#############################################################################################
-void Directory() {
-  numfiles  = 0; // Reset number of FS files counter
-  File root = FS.open("/");
-  if (root) {
-    root.rewindDirectory();
-    File file = root.openNextFile();
-    while (file) { // Now get all the filenames, file types and sizes
-      String filename = file.name();
-      Filenames[numfiles].filename = (String(file.name()).startsWith("/") ? String(file.name()).substring(1) : file.name());
-      Filenames[numfiles].ftype  = (file.isDirectory() ? "Dir" : "File");
-      Filenames[numfiles].fsize  = ConvBinUnits(file.size(), 1);
-      numfiles++;
-      file = root.openNextFile();
+    page.print("<tr>");
+    for (int i = 0; i < 2 && next < dirEntries.size(); i++, next++) {
+      if (i) page.print("<td class='sp'></td>");
+      page.print("<td style = 'width:5%'>" + String(dirEntries[next].isDir ? "Dir" : "File") + "</td><td style = 'width:25%'>" + dirName(next) + "</td><td style = 'width:10%'>" + ConvBinUnits(dirEntries[next].size, 1) + "</td>");
     }
-    root.close();
-  }
+    page.print("</tr>");
+    if (next < dirEntries.size()) {
+      return true;
+    }
+    page.print("</table>");
+    page.print("<p style='background-color:yellow;'><b>" + message + "</b></p>");
+    return false;
+  });
 }
 //#############################################################################################
-void UploadFileSelect() {
-  webpage  = HTML_Header;
-  webpage += "<h3>Select a File to [UPLOAD] to this device</h3>";
-  webpage += "<form method = 'POST' action = '/handleupload' enctype='multipart/form-data'>";
-  webpage += "<input type='file' name='filename'><br><br>";
-  webpage += "<input type='submit' value='Upload'>";
-  webpage += "</form>";
-  webpage += HTML_Footer;
+void UploadFileSelect(AsyncWebServerRequest *request) {
+  sendPage(request,
+    "<h3>Select a File to [UPLOAD] to this device</h3>"
+    "<form method = 'POST' action = '/handleupload' enctype='multipart/form-data'>"
+    "<input type='file' name='filename'><br><br>"
+    "<input type='submit' value='Upload'>"
+    "</form>");
 }
 //#############################################################################################
-void Format() {
-  webpage  = HTML_Header;
-  webpage += "<h3>***  Format Filing System on this device ***</h3>";
-  webpage += "<form action='/handleformat'>";
-  webpage += "<input type='radio' id='YES' name='format' value = 'YES'><label for='YES'>YES</label><br><br>";
-  webpage += "<input type='radio' id='NO'  name='format' value = 'NO' checked><label for='NO'>NO</label><br><br>";
-  webpage += "<input type='submit' value='Format?'>";
-  webpage += "</form>";
-  webpage += HTML_Footer;
+void Format(AsyncWebServerRequest *request) {
+  sendPage(request,
+    "<h3>***  Format Filing System on this device ***</h3>"
+    "<form action='/handleformat'>"
+    "<input type='radio' id='YES' name='format' value = 'YES'><label for='YES'>YES</label><br><br>"
+    "<input type='radio' id='NO'  name='format' value = 'NO' checked><label for='NO'>NO</label><br><br>"
+    "<input type='submit' value='Format?'>"
+    "</form>");
 }
 //#############################################################################################
+// The network delivers an upload in chunks of about one TCP segment. They are gathered
+// in a buffer of one flash sector per upload, such that LittleFS is written in whole,
+// aligned sectors rather than in partial pages. The buffer is held by the request, which
+// frees it when the upload ends or the connection is lost.
+#define UPLOAD_BUFFER_SIZE 4096
+
+struct UploadBuffer {
+  size_t   len;
+  uint32_t writes;
+  uint8_t  data[UPLOAD_BUFFER_SIZE];
+};
+
+static bool uploadFlush(File &file, UploadBuffer *buf) {
+  if (!buf->len) return true;
+  bool ok = file.write(buf->data, buf->len) == buf->len;
+  buf->len = 0;
+  buf->writes++;
+  return ok;
+}
+
 void handleFileUpload(AsyncWebServerRequest *request, const String& filename, size_t index, uint8_t *data, size_t len, bool final) {
   if (!index) {
     String file = filename;
     if (!filename.startsWith("/")) file = "/" + filename;
     request->_tempFile = FS.open(file, "w");
     if (!request->_tempFile) Serial.println("Error creating file for upload...");
+    UploadBuffer *buf = (UploadBuffer *)malloc(sizeof(UploadBuffer));
+    if (buf) {
+      buf->len = 0;
+      buf->writes = 0;
+    }
+    request->_tempObject = buf;   // without a buffer, chunks are written as they come
     start = millis();
   }
-  if (request->_tempFile) {
-    if (len) {
-      request->_tempFile.write(data, len); // Chunked data
-      Serial.println("Transferred : " + String(len) + " Bytes");
-    }
-    Directory();              // update file list
-    if (final) {
-      uploadsize = request->_tempFile.size();
-      request->_tempFile.close();
-      uploadtime = millis() - start;
-      request->redirect("/dir");
+  if (!request->_tempFile) {     // failed to open, or failed to write an earlier chunk
+    if (final) request->redirect("/dir");
+    return;
+  }
+  UploadBuffer *buf = (UploadBuffer *)request->_tempObject;
+  bool ok = true;
+  if (buf) {
+    while (len && ok) {
+      size_t n = min(len, UPLOAD_BUFFER_SIZE - buf->len);
+      memcpy(buf->data + buf->len, data, n);
+      buf->len += n;
+      data += n;
+      len -= n;
+      if (buf->len == UPLOAD_BUFFER_SIZE) ok = uploadFlush(request->_tempFile, buf);
     }
+    if (final && ok) ok = uploadFlush(request->_tempFile, buf);
+  } else if (len) {
+    ok = request->_tempFile.write(data, len) == len;
+  }
+  if (!ok) Serial.printf("Upload of %s failed at %u bytes\r\n", filename.c_str(), (unsigned)(index + len));
+  if (final || !ok) {
+    uploadsize = request->_tempFile.size();
+    request->_tempFile.close();
+    fsChanges++;
+    uploadtime = max((int)(millis() - start), 1);
+    uploadrate = (int)((uint64_t)uploadsize * 1000 / uploadtime);
+    Serial.printf("Uploaded %s: %u bytes in %u ms (%u B/s, %u flash writes)\r\n", filename.c_str(),
+                  (unsigned)uploadsize, (unsigned)uploadtime, (unsigned)uploadrate, buf ? (unsigned)buf->writes : 0);
+    if (final) request->redirect("/dir");
   }
 }
 //#############################################################################################
-void Handle_File_Delete(String filename) { // Delete the file
-  webpage = HTML_Header;
+void Handle_File_Delete(AsyncWebServerRequest *request, String filename) { // Delete the file
   if (!filename.startsWith("/")) filename = "/" + filename;
   File dataFile = FS.open(filename, "r"); // Now read FS to see if file exists
   if (dataFile) {  // It does so delete it
     dataFile.close();  // as per https://github.com/lorol/LITTLEFS/issues/22
     FS.remove(filename);
-    Directory();    // update file list
-    webpage += "<h3>File '" + filename.substring(1) + "' has been deleted</h3>";
-    webpage += "<a href='/dir'>[Enter]</a><br><br>";
+    fsChanges++;
+    sendPage(request, "<h3>File '" + filename.substring(1) + "' has been deleted</h3><a href='/dir'>[Enter]</a><br><br>");
   }
   else
   {
-    webpage += "<h3>File [ " + filename + " ] does not exist</h3>";
-    webpage += "<a href='/dir'>[Enter]</a><br><br>";
+    sendPage(request, "<h3>File [ " + filename + " ] does not exist</h3><a href='/dir'>[Enter]</a><br><br>");
   }
-  webpage  += HTML_Footer;
 }
 //#############################################################################################
-void File_Rename() { // Rename the file
-  webpage = HTML_Header;
-  webpage += "<h3>Select a File to [RENAME] on this device</h3>";
-  webpage += "<FORM action='/renamehandler'>";
-  webpage += "<table class='center'>";
-  webpage += "<tr><th>File name</th><th>New Filename</th><th>Select</th></tr>";
-  int index = 0;
-  while (index < numfiles) {
-    webpage += "<tr><td><input type='text' name='oldfile' style='color:blue;' value = '" + Filenames[index].filename + "' readonly></td>";
-    webpage += "<td><input type='text' name='newfile'></td><td><input type='radio' name='choice'></tr>";
-    index++;
-  }
-  webpage += "</table><br>";
-  webpage += "<input type='submit' value='Enter'>";
-  webpage += "</form>";
-  webpage += HTML_Footer;
+void File_Rename(AsyncWebServerRequest *request) { // Rename the file
+  dirRefresh();
+  sendPage(request, [](ChunkedPage &page, uint32_t step) -> bool {
+    if (step == 0) {
+      page.print("<h3>Select a File to [RENAME] on this device</h3>");
+      page.print("<FORM action='/renamehandler'>");
+      page.print("<table class='center'>");
+      page.print("<tr><th>File name</th><th>New Filename</th><th>Select</th></tr>");
+      return true;
+    }
+    if (step <= dirEntries.size()) {
+      page.print("<tr><td><input type='text' name='oldfile' style='color:blue;' value = '" + String(dirName(step - 1)) + "' readonly></td>");
+      page.print("<td><input type='text' name='newfile'></td><td><input type='radio' name='choice'></tr>");
+      return true;
+    }
+    page.print("</table><br>");
+    page.print("<input type='submit' value='Enter'>");
+    page.print("</form>");
+    return false;
+  });
 }
 //#############################################################################################
 void Handle_File_Rename(AsyncWebServerRequest *request, String filename, int Args) { // Rename the file
   String newfilename;
+  String body;
   //int Args = request->args();
-  webpage = HTML_Header;
   for (int i = 0; i < Args; i++) {
     if (request->arg(i) != "" && request->arg(i + 1) == "on") {
       filename  = request->arg(i - 1);
@@ -432,29 +801,192 @@ void Handle_File_Rename(AsyncWebServerRequest *request, String filename, int Arg
   if (CurrentFile && (filename != "/") && (newfilename != "/") && (filename != newfilename)) { // It does so rename it, ignore if no entry made, or Newfile name exists already
     CurrentFile.close();  // gotta close first
     if (FS.rename(filename, newfilename)) {
+      fsChanges++;
       filename  = filename.substring(1);
       newfilename = newfilename.substring(1);
-      webpage += "<h3>File '" + filename + "' has been renamed to '" + newfilename + "'</h3>";
-      webpage += "<a href='/dir'>[Enter]</a><br><br>";
-      Directory();  // update file list
+      body += "<h3>File '" + filename + "' has been renamed to '" + newfilename + "'</h3>";
+      body += "<a href='/dir'>[Enter]</a><br><br>";
     }
   }
   else
   {
-    if (filename == "/" && newfilename == "/") webpage += "<h3>File was not renamed</h3>";
-    else webpage += "<h3>New filename exists, cannot rename</h3>";
-    webpage += "<a href='/rename'>[Enter]</a><br><br>";
+    if (filename == "/" && newfilename == "/") body += "<h3>File was not renamed</h3>";
+    else body += "<h3>New filename exists, cannot rename</h3>";
+    body += "<a href='/rename'>[Enter]</a><br><br>";
   }
   CurrentFile.close();
-  webpage  += HTML_Footer;
+  sendPage(request, body);
+}
+
+//#############################################################################################
+// A tar archive of the day logs in a range of days, generated while it is sent. The
+// files and their sizes are fixed when the archive is started, so that its length is
+// known; a log that grows meanwhile is cut at that size. Only one 512-byte header is
+// held at a time.
+#define TAR_BLOCK 512
+
+TarStream::TarStream(const String &dir, uint32_t firstDay, uint32_t lastDay) : dir(dir) {
+  dirRefresh();
+  for (uint16_t i = 0; i < dirEntries.size(); i++) {
+    uint16_t day;
+    if (!dirEntries[i].isDir && dayOfPath(dirName(i), day) && day >= firstDay && day <= lastDay) {
+      files.push_back({ day, dirEntries[i].size });
+    }
+  }
+}
+
+size_t TarStream::length() {
+  size_t len = 2 * TAR_BLOCK;       // end of archive
+  for (const TarFile &f : files) {
+    len += TAR_BLOCK + (f.size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+  }
+  return len;
+}
+
+// ustar header of the next file
+void TarStream::makeHeader() {
+  const TarFile &f = files[next];
+  char path[16];
+  dayPath(f.day, path, sizeof(path));
+  file = FS.open(path, "r");
+  time_t mtime = file ? file.getLastWrite() : 0;
+
+  memset(header, 0, sizeof(header));
+  snprintf((char*)header, 100, "%s%s", dir.c_str(), path);       // name
+  snprintf((char*)header + 100, 8, "%07o", 0644);                // mode
+  snprintf((char*)header + 108, 8, "%07o", 0);                   // uid
+  snprintf((char*)header + 116, 8, "%07o", 0);                   // gid
+  snprintf((char*)header + 124, 12, "%011o", (unsigned)f.size);  // size
+  snprintf((char*)header + 136, 12, "%011o", (unsigned)mtime);   // mtime
+  header[156] = '0';                                             // regular file
+  memcpy(header + 257, "ustar", 6);
+  memcpy(header + 263, "00", 2);
+  memset(header + 148, ' ', 8);                                  // checksum, counted as spaces
+  unsigned sum = 0;
+  for (size_t i = 0; i < sizeof(header); i++) {
+    sum += header[i];
+  }
+  snprintf((char*)header + 148, 8, "%06o", sum);
 }
 
+size_t TarStream::read(uint8_t *buf, size_t maxLen) {
+  size_t n = 0;
+  while (n < maxLen) {
+    if (remaining == 0) {
+      // the next part: header, data, padding, then the next file or the end
+      if (part == TAR_HEADER) {
+        part = TAR_DATA;
+        remaining = files[next].size;
+      } else if (part == TAR_DATA) {
+        part = TAR_PADDING;
+        remaining = (TAR_BLOCK - files[next].size % TAR_BLOCK) % TAR_BLOCK;
+      } else if (part != TAR_END && next + (part != TAR_START) < files.size()) {
+        next += part != TAR_START;
+        part = TAR_HEADER;
+        remaining = TAR_BLOCK;
+        file.close();
+        makeHeader();
+      } else if (part != TAR_END) {
+        part = TAR_END;
+        remaining = 2 * TAR_BLOCK;
+        file.close();
+      } else {
+        break;
+      }
+      continue;
+    }
+
+    size_t len = min(maxLen - n, remaining);
+    if (part == TAR_HEADER) {
+      memcpy(&buf[n], header + TAR_BLOCK - remaining, len);
+    } else if (part == TAR_DATA) {
+      size_t got = file ? file.read(&buf[n], len) : 0;
+      memset(&buf[n + got], 0, len - got);                       // the file shrank
+    } else {
+      memset(&buf[n], 0, len);
+    }
+    n += len;
+    remaining -= len;
+  }
+  return n;
+}
 //#############################################################################################
-// Not found handler is also the handler for 'delete', 'download' and 'stream' functions
+// Send a file with support for resuming and revalidation: a single "Range: bytes=" range
+// is answered with 206 Partial Content, and a request with an ETag (size and time of the
+// last write) or Last-Modified that still matches with 304 Not Modified. A collector can
+// so fetch only the part of today's log that was appended since its last request.
+// Returns the number of bytes sent.
+int Send_File(AsyncWebServerRequest *request, String filename, String contentType) {
+  File file = FS.open(filename, "r");
+  if (!file || file.isDirectory()) {
+    request->send(404, "text/plain", "File not found");
+    return 0;
+  }
+  uint32_t size = file.size();
+  time_t modified = file.getLastWrite();
+  char etag[24], lastModified[32] = "";
+  snprintf(etag, sizeof(etag), "\"%x-%x\"", (unsigned)size, (unsigned)modified);
+  if (modified > 0) {
+    strftime(lastModified, sizeof(lastModified), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&modified));
+  }
+
+  // conditional requests, where clients send back what they got
+  bool notModified = request->hasHeader("If-None-Match") ? request->getHeader("If-None-Match")->value() == etag
+                   : request->hasHeader("If-Modified-Since") && modified > 0 && request->getHeader("If-Modified-Since")->value() == lastModified;
+  if (notModified) {
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("ETag", etag);
+    request->send(response);
+    return 0;
+  }
+
+  // a range is ignored if If-Range shows that it refers to another version of the file
+  uint32_t from = 0, to = size;     // [from, to)
+  bool partial = false;
+  if (request->hasHeader("Range") && (!request->hasHeader("If-Range") || request->getHeader("If-Range")->value() == etag)) {
+    String range = request->getHeader("Range")->value();
+    unsigned long first, last;
+    partial = true;
+    if (range.startsWith("bytes=-")) {                      // the last bytes
+      from = size - min((unsigned long)size, strtoul(range.c_str() + 7, NULL, 10));
+    } else if (sscanf(range.c_str(), "bytes=%lu-%lu", &first, &last) == 2) {
+      from = first;
+      to = min((unsigned long)size, last + 1);
+    } else if (sscanf(range.c_str(), "bytes=%lu-", &first) == 1) {
+      from = first;
+    } else {
+      partial = false;                                        // not a byte range
+    }
+    if (partial && (from >= to || range.indexOf(',') >= 0)) {
+      AsyncWebServerResponse *response = request->beginResponse(416);
+      response->addHeader("Content-Range", "bytes */" + String(size));
+      request->send(response);
+      return 0;
+    }
+  }
+
+  file.seek(from);
+  uint32_t len = to - from;
+  AsyncWebServerResponse *response = request->beginResponse(contentType, len, [file, len](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t
+                                                            { return file.read(buffer, min(maxLen, (size_t)(len - index))); });
+  if (partial) {
+    response->setCode(206);
+    response->addHeader("Content-Range", "bytes " + String(from) + "-" + String(to - 1) + "/" + String(size));
+  }
+  response->addHeader("Accept-Ranges", "bytes");
+  response->addHeader("ETag", etag);
+  if (modified > 0) response->addHeader("Last-Modified", lastModified);
+  response->addHeader("Server", "ESP Async Web Server");
+  request->send(response);
+  return len;
+}
+//#############################################################################################
+// Not found handler is also the handler for 'delete', 'download', 'stream' and 'export' functions
 void notFound(AsyncWebServerRequest *request) { // Process selected file types
   String filename;
   if (request->url().startsWith("/downloadhandler") ||
       request->url().startsWith("/streamhandler")   ||
+      request->url().startsWith("/exporthandler")   ||
       request->url().startsWith("/deletehandler")   ||
       request->url().startsWith("/renamehandler"))
   {
@@ -466,42 +998,45 @@ void notFound(AsyncWebServerRequest *request) { // Process selected file types
     {
       Serial.println("Download handler started...");
       MessageLine = "";
-      File file = FS.open(filename, "r");
-      String contentType = getContentType("download");
-      AsyncWebServerResponse *response = request->beginResponse(contentType, file.size(), [file](uint8_t *buffer, size_t maxLen, size_t total) mutable ->  size_t
-                                                                { return file.read(buffer, maxLen); });
-      response->addHeader("Server", "ESP Async Web Server");
-      request->send(response);
+      downloadsize = Send_File(request, filename, getContentType("download"));
       downloadtime = millis() - start;
-      downloadsize = GetFileSize(filename);
       // request->redirect("/dir");
     }
     if (request->url().startsWith("/streamhandler"))
     {
       Serial.println("Stream handler started...");
-      String ContentType = getContentType(filename);
-      AsyncWebServerResponse *response = request->beginResponse(FS, filename, ContentType);
-      request->send(response);
-      downloadsize = GetFileSize(filename);
+      downloadsize = Send_File(request, filename, getContentType(filename));
       downloadtime = millis() - start;
       // request->redirect("/dir");
     }
+    if (request->url().startsWith("/exporthandler"))
+    {
+      // binary measurement logs are decoded while sending, as CSV or with ?format=json
+      Serial.println("Export handler started...");
+      bool json = request->hasParam("format") && request->getParam("format")->value() == "json";
+      std::shared_ptr<LogDecoder> decoder = std::make_shared<LogDecoder>(FS.open(filename, "r"), json ? LOG_JSON : LOG_CSV);
+      AsyncWebServerResponse *response = request->beginChunkedResponse(json ? "application/json" : "text/csv",
+                                                                        [decoder](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                                        { return decoder->read(buffer, maxLen); });
+      String name = filename.substring(1, filename.lastIndexOf('.'));
+      response->addHeader("Content-Disposition", "attachment; filename=\"" + name + (json ? ".json\"" : ".csv\""));
+      request->send(response);
+      downloadtime = millis() - start;
+      downloadsize = GetFileSize(filename);
+    }
     if (request->url().startsWith("/deletehandler"))
     {
       Serial.println("Delete handler started...");
-      Handle_File_Delete(filename); // Build webpage ready for display
-      request->send(200, "text/html", webpage);
+      Handle_File_Delete(request, filename);
     }
     if (request->url().startsWith("/renamehandler"))
     {
-      Handle_File_Rename(request, filename, request->args()); // Build webpage ready for display
-      request->send(200, "text/html", webpage);
+      Handle_File_Rename(request, filename, request->args());
     }
   }
   else
   {
-    Page_Not_Found();
-    request->send(200, "text/html", webpage);
+    Page_Not_Found(request);
   }
 }
 //#############################################################################################
@@ -538,29 +1073,32 @@ String getContentType(String filenametype) { // Tell the browser what file type
   return "text/plain";
 }
 //#############################################################################################
-void Select_File_For_Function(String title, String function) {
-  String Fname1, Fname2;
-  int index = 0;
-  webpage = HTML_Header;
-  webpage += "<h3>Select a File to " + title + " from this device</h3>";
-  webpage += "<table class='center'>";
-  webpage += "<tr><th>File Name</th><th>File Size</th><th class='sp'></th><th>File Name</th><th>File Size</th></tr>";
-  while (index < numfiles) {
-    Fname1 = Filenames[index].filename;
-    Fname2 = Filenames[index + 1].filename;
-    if (Fname1.startsWith("/")) Fname1 = Fname1.substring(1);
-    if (Fname2.startsWith("/")) Fname2 = Fname2.substring(1);
-    webpage += "<tr>";
-    webpage += "<td style='width:25%'><button><a href='" + function + "~/" + Fname1 + "'>" + Fname1 + "</a></button></td><td style = 'width:10%'>" + Filenames[index].fsize + "</td>";
-    webpage += "<td class='sp'></td>";
-    if (index < numfiles - 1) {
-      webpage += "<td style='width:25%'><button><a href='" + function + "~/" + Fname2 + "'>" + Fname2 + "</a></button></td><td style = 'width:10%'>" + Filenames[index + 1].fsize + "</td>";
-    }
-    webpage += "</tr>";
-    index = index + 2;
-  }
-  webpage += "</table>";
-  webpage += HTML_Footer;
+void Select_File_For_Function(AsyncWebServerRequest *request, String title, String function, const char *extra) {
+  // rows of two entries
+  dirRefresh();
+  sendPage(request, [title, function, extra](ChunkedPage &page, uint32_t step) -> bool {
+    uint16_t next = (step - 1) * 2;
+    if (step == 0) {
+      page.print("<h3>Select a File to " + title + " from this device</h3>");
+      page.print("<table class='center'>");
+      page.print("<tr><th>File Name</th><th>File Size</th><th class='sp'></th><th>File Name</th><th>File Size</th></tr>");
+      if (dirEntries.empty()) page.print("</table>");
+      return true;
+    }
+    if (next < dirEntries.size()) {
+      page.print("<tr>");
+      for (int i = 0; i < 2 && next < dirEntries.size(); i++, next++) {
+        String name = dirName(next);
+        if (i) page.print("<td class='sp'></td>");
+        page.print("<td style='width:25%'><button><a href='" + function + "~/" + name + "'>" + name + "</a></button></td><td style = 'width:10%'>" + ConvBinUnits(dirEntries[next].size, 1) + "</td>");
+      }
+      page.print("</tr>");
+      if (next >= dirEntries.size()) page.print("</table>");
+      return true;
+    }
+    page.text(extra);
+    return false;
+  });
 }
 //#############################################################################################
 int GetFileSize(String filename) {
@@ -571,71 +1109,78 @@ int GetFileSize(String filename) {
   return filesize;
 }
 //#############################################################################################
-void Home() {
-  webpage = HTML_Header;
-  webpage += "<div style='text-align: center; margin: 20px;'>";
-  webpage += "<svg version='1.2' baseProfile='tiny' xmlns='http://www.w3.org/2000/svg' viewBox='0 0 541.8 155.9' width='40%' preserveAspectRatio='xMidYMid' xml:space='preserve'><g fill='#231F20'><path d='m221.3 56.3-15.6 37.2 16.8 26.1H214l-15.8-25v25H191V56.3h7.2v36.9l15.5-36.9h7.6zM246.4 98.5l13.4 21.2h-8.5l-15.1-24.2v24.2H229V56.3c2.2-.5 4.6-.7 7.2-.7 23.2 0 26.5 33.2 10.2 42.9zm-10.2-4.2c17.4 0 17.4-31.8 0-31.8v31.8zM326.8 88c0 17.8-14.5 32.4-32.4 32.4-17.8 0-32.4-14.6-32.4-32.4 0-17.9 14.6-32.4 32.4-32.4 17.9 0 32.4 14.5 32.4 32.4zm-7.3 0c0-14.1-11.2-25.5-25.1-25.5S269.3 73.9 269.3 88c0 14 11.2 25.5 25.1 25.5S319.5 102 319.5 88zM397 88c0 17.8-14.5 32.4-32.4 32.4-17.8 0-32.4-14.6-32.4-32.4 0-17.9 14.6-32.4 32.4-32.4 17.9 0 32.4 14.5 32.4 32.4zm-7.3 0c0-14.1-11.2-25.5-25.1-25.5S339.5 73.9 339.5 88c0 14 11.2 25.5 25.1 25.5S389.7 102 389.7 88zM405.1 119.7V55.3h1.4l22.1 40.3V56.3h7.2v64.4h-1.4l-22.1-40.3v39.3h-7.2zM508.8 88c0 17.8-14.5 32.4-32.4 32.4-17.8 0-32.4-14.6-32.4-32.4 0-17.9 14.6-32.4 32.4-32.4 17.9 0 32.4 14.5 32.4 32.4zm-7.3 0c0-14.1-11.2-25.5-25.1-25.5s-25 11.4-25 25.5c0 14 11.2 25.5 25.1 25.5s25-11.5 25-25.5zM535.3 56.3v7.2c-1.5-.7-3.4-1.1-5.7-1.1-10 0-12 7.5-6.9 14.2l11.8 15.1c10.1 13 2.3 28.6-13.2 28.6-2.4 0-4.7-.3-6.7-.8v-7.1c1.8.7 4.1 1.1 6.7 1.1 10 0 13.4-9.7 7.8-16.9l-11.8-15.1c-9.6-12.4-3.3-25.9 12.3-25.9 2.1 0 4 .3 5.7.7z'/></g><path fill='none' stroke='#231F20' stroke-width='2.835' stroke-miterlimit='10' d='M-.2 85.8c9.2 1.3 36.4 6.3 58.9 29.5 15 15.4 21.3 32.1 24 41.3M165.6 85.8c-9.2 1.3-36.4 6.3-58.9 29.5-15 15.4-21.3 32.1-24 41.3M82.6.3C74.9 53.7 67 80.4 58.8 80.5c-3.3 0-9.7-9.9-14.3-26.5M82.6.3c7.7 53.4 15.7 80.2 23.8 80.2 4.7 0 9.4-8.8 14.3-26.5'/><path fill='none' stroke='#231F20' stroke-width='2.835' stroke-miterlimit='10' d='M1.2 103.6c4.1-.5 17.9-2.8 29.3-14.7 13.3-13.9 14-31.3 14-34.9M163.6 103.1c-4.1-.5-17.9-2.8-29.3-14.7C121 74.5 120.7 57.6 120.7 54'/></svg>";
-  webpage += "</div>";
-  webpage += "<p align='center'>Welcome to the webserver dashboard of your LoRangeFinder-1.</p>";
-  webpage += "<p align='center'>Please use the menu to navigate to the different pages.</p>";
-  webpage += HTML_Footer;
+void Home(AsyncWebServerRequest *request) {
+  sendPage(request,
+    "<div style='text-align: center; margin: 20px;'>"
+    "<svg version='1.2' baseProfile='tiny' xmlns='http://www.w3.org/2000/svg' viewBox='0 0 541.8 155.9' width='40%' preserveAspectRatio='xMidYMid' xml:space='preserve'><g fill='#231F20'><path d='m221.3 56.3-15.6 37.2 16.8 26.1H214l-15.8-25v25H191V56.3h7.2v36.9l15.5-36.9h7.6zM246.4 98.5l13.4 21.2h-8.5l-15.1-24.2v24.2H229V56.3c2.2-.5 4.6-.7 7.2-.7 23.2 0 26.5 33.2 10.2 42.9zm-10.2-4.2c17.4 0 17.4-31.8 0-31.8v31.8zM326.8 88c0 17.8-14.5 32.4-32.4 32.4-17.8 0-32.4-14.6-32.4-32.4 0-17.9 14.6-32.4 32.4-32.4 17.9 0 32.4 14.5 32.4 32.4zm-7.3 0c0-14.1-11.2-25.5-25.1-25.5S269.3 73.9 269.3 88c0 14 11.2 25.5 25.1 25.5S319.5 102 319.5 88zM397 88c0 17.8-14.5 32.4-32.4 32.4-17.8 0-32.4-14.6-32.4-32.4 0-17.9 14.6-32.4 32.4-32.4 17.9 0 32.4 14.5 32.4 32.4zm-7.3 0c0-14.1-11.2-25.5-25.1-25.5S339.5 73.9 339.5 88c0 14 11.2 25.5 25.1 25.5S389.7 102 389.7 88zM405.1 119.7V55.3h1.4l22.1 40.3V56.3h7.2v64.4h-1.4l-22.1-40.3v39.3h-7.2zM508.8 88c0 17.8-14.5 32.4-32.4 32.4-17.8 0-32.4-14.6-32.4-32.4 0-17.9 14.6-32.4 32.4-32.4 17.9 0 32.4 14.5 32.4 32.4zm-7.3 0c0-14.1-11.2-25.5-25.1-25.5s-25 11.4-25 25.5c0 14 11.2 25.5 25.1 25.5s25-11.5 25-25.5zM535.3 56.3v7.2c-1.5-.7-3.4-1.1-5.7-1.1-10 0-12 7.5-6.9 14.2l11.8 15.1c10.1 13 2.3 28.6-13.2 28.6-2.4 0-4.7-.3-6.7-.8v-7.1c1.8.7 4.1 1.1 6.7 1.1 10 0 13.4-9.7 7.8-16.9l-11.8-15.1c-9.6-12.4-3.3-25.9 12.3-25.9 2.1 0 4 .3 5.7.7z'/></g><path fill='none' stroke='#231F20' stroke-width='2.835' stroke-miterlimit='10' d='M-.2 85.8c9.2 1.3 36.4 6.3 58.9 29.5 15 15.4 21.3 32.1 24 41.3M165.6 85.8c-9.2 1.3-36.4 6.3-58.9 29.5-15 15.4-21.3 32.1-24 41.3M82.6.3C74.9 53.7 67 80.4 58.8 80.5c-3.3 0-9.7-9.9-14.3-26.5M82.6.3c7.7 53.4 15.7 80.2 23.8 80.2 4.7 0 9.4-8.8 14.3-26.5'/><path fill='none' stroke='#231F20' stroke-width='2.835' stroke-miterlimit='10' d='M1.2 103.6c4.1-.5 17.9-2.8 29.3-14.7 13.3-13.9 14-31.3 14-34.9M163.6 103.1c-4.1-.5-17.9-2.8-29.3-14.7C121 74.5 120.7 57.6 120.7 54'/></svg>"
+    "</div>"
+    "<p align='center'>Welcome to the webserver dashboard of your LoRangeFinder-1.</p>"
+    "<p align='center'>Please use the menu to navigate to the different pages.</p>");
 }
 //#############################################################################################
-void Page_Not_Found() {
-  webpage = HTML_Header;
-  webpage += "<div class='notfound'>";
-  webpage += "<h1>Sorry</h1>";
-  webpage += "<p>Error 404 - Page Not Found</p>";
-  webpage += "</div><div class='left'>";
-  webpage += "<p>The page you were looking for was not found, it may have been moved or is currently unavailable.</p>";
-  webpage += "<p>Please check the address is spelt correctly and try again.</p>";
-  webpage += "<p>Or click <b><a href='/'>[Here]</a></b> for the home page.</p></div>";
-  webpage += HTML_Footer;
+void Page_Not_Found(AsyncWebServerRequest *request) {
+  sendPage(request,
+    "<div class='notfound'>"
+    "<h1>Sorry</h1>"
+    "<p>Error 404 - Page Not Found</p>"
+    "</div><div class='left'>"
+    "<p>The page you were looking for was not found, it may have been moved or is currently unavailable.</p>"
+    "<p>Please check the address is spelt correctly and try again.</p>"
+    "<p>Or click <b><a href='/'>[Here]</a></b> for the home page.</p></div>");
 }
 //#############################################################################################
-void Display_System_Info() {
-  esp_chip_info_t chip_info;
-  esp_chip_info(&chip_info);
-  uint32_t size_flash_chip;
-  esp_flash_get_size(NULL, &size_flash_chip);
+void Display_System_Info(AsyncWebServerRequest *request) {
   if (WiFi.scanComplete() == -2) WiFi.scanNetworks(true, false); // Scan parameters are (async, show_hidden) if async = true, don't wait for the result
-  webpage = HTML_Header;
-  webpage += "<h3>System Information</h3>";
-  webpage += "<h4>Transfer Statistics</h4>";
-  webpage += "<table class='center'>";
-  webpage += "<tr><th>Last Upload</th><th>Last Download/Stream</th><th>Units</th></tr>";
-  webpage += "<tr><td>" + ConvBinUnits(uploadsize, 1) + "</td><td>" + ConvBinUnits(downloadsize, 1) + "</td><td>File Size</td></tr> ";
-  webpage += "<tr><td>" + ConvBinUnits((float)uploadsize / uploadtime * 1024.0, 1) + "/Sec</td>";
-  webpage += "<td>" + ConvBinUnits((float)downloadsize / downloadtime * 1024.0, 1) + "/Sec</td><td>Transfer Rate</td></tr>";
-  webpage += "</table>";
-  webpage += "<h4>Filing System</h4>";
-  webpage += "<table class='center'>";
-  webpage += "<tr><th>Total Space</th><th>Used Space</th><th>Free Space</th><th>Number of Files</th></tr>";
-  webpage += "<tr><td>" + ConvBinUnits(FS.totalBytes(), 1) + "</td>";
-  webpage += "<td>" + ConvBinUnits(FS.usedBytes(), 1) + "</td>";
-  webpage += "<td>" + ConvBinUnits(FS.totalBytes() - FS.usedBytes(), 1) + "</td>";
-  webpage += "<td>" + (numfiles == 0 ? "Pending Dir or Empty" : String(numfiles)) + "</td></tr>";
-  webpage += "</table>";
-  webpage += "<h4>CPU Information</h4>";
-  webpage += "<table class='center'>";
-  webpage += "<tr><th>Parameter</th><th>Value</th></tr>";
-  webpage += "<tr><td>Number of Cores</td><td>" + String(chip_info.cores) + "</td></tr>";
-  webpage += "<tr><td>Chip revision</td><td>" + String(chip_info.revision) + "</td></tr>";
-  webpage += "<tr><td>Internal or External Flash Memory</td><td>" + String(((chip_info.features & CHIP_FEATURE_EMB_FLASH) ? "Embedded" : "External")) + "</td></tr>";
-  webpage += "<tr><td>Flash Memory Size</td><td>" + String((size_flash_chip / (1024 * 1024))) + " MB</td></tr>";
-  webpage += "<tr><td>Current Free RAM</td><td>" + ConvBinUnits(ESP.getFreeHeap(), 1) + "</td></tr>";
-  webpage += "</table>";
-  webpage += "<h4>Network Information</h4>";
-  webpage += "<table class='center'>";
-  webpage += "<tr><th>Parameter</th><th>Value</th></tr>";
-  webpage += "<tr><td>LAN IP Address</td><td>"        + String(WiFi.localIP().toString()) + "</td></tr>";
-  webpage += "<tr><td>Network Adapter MAC Address</td><td>" + String(WiFi.BSSIDstr()) + "</td></tr>";
-  webpage += "<tr><td>WiFi SSID</td><td>"           + String(WiFi.SSID()) + "</td></tr>";
-  webpage += "<tr><td>WiFi RSSI</td><td>"           + String(WiFi.RSSI()) + " dB</td></tr>";
-  webpage += "<tr><td>WiFi Channel</td><td>"        + String(WiFi.channel()) + "</td></tr>";
-  webpage += "<tr><td>WiFi Encryption Type</td><td>"    + String(EncryptionType(WiFi.encryptionType(0))) + "</td></tr>";
-  webpage += "</table> ";
-  webpage += HTML_Footer;
+  // one table per part
+  sendPage(request, [](ChunkedPage &page, uint32_t step) -> bool {
+    if (step == 0) {
+      page.print("<h3>System Information</h3>");
+      page.print("<h4>Transfer Statistics</h4>");
+      page.print("<table class='center'>");
+      page.print("<tr><th>Last Upload</th><th>Last Download/Stream</th><th>Units</th></tr>");
+      page.print("<tr><td>" + ConvBinUnits(uploadsize, 1) + "</td><td>" + ConvBinUnits(downloadsize, 1) + "</td><td>File Size</td></tr> ");
+      page.print("<tr><td>" + ConvBinUnits(uploadrate, 1) + "/Sec</td>");
+      page.print("<td>" + ConvBinUnits((float)downloadsize / downloadtime * 1024.0, 1) + "/Sec</td><td>Transfer Rate</td></tr>");
+      page.print("</table>");
+    } else if (step == 1) {
+      dirRefresh();
+      int numfiles = dirEntries.size();
+      page.print("<h4>Filing System</h4>");
+      page.print("<table class='center'>");
+      page.print("<tr><th>Total Space</th><th>Used Space</th><th>Free Space</th><th>Number of Files</th></tr>");
+      page.print("<tr><td>" + ConvBinUnits(FS.totalBytes(), 1) + "</td>");
+      page.print("<td>" + ConvBinUnits(FS.usedBytes(), 1) + "</td>");
+      page.print("<td>" + ConvBinUnits(FS.totalBytes() - FS.usedBytes(), 1) + "</td>");
+      page.print("<td>" + (numfiles == 0 ? "Empty" : String(numfiles)) + "</td></tr>");
+      page.print("</table>");
+    } else if (step == 2) {
+      esp_chip_info_t chip_info;
+      esp_chip_info(&chip_info);
+      uint32_t size_flash_chip;
+      esp_flash_get_size(NULL, &size_flash_chip);
+      page.print("<h4>CPU Information</h4>");
+      page.print("<table class='center'>");
+      page.print("<tr><th>Parameter</th><th>Value</th></tr>");
+      page.print("<tr><td>Number of Cores</td><td>" + String(chip_info.cores) + "</td></tr>");
+      page.print("<tr><td>Chip revision</td><td>" + String(chip_info.revision) + "</td></tr>");
+      page.print("<tr><td>Internal or External Flash Memory</td><td>" + String(((chip_info.features & CHIP_FEATURE_EMB_FLASH) ? "Embedded" : "External")) + "</td></tr>");
+      page.print("<tr><td>Flash Memory Size</td><td>" + String((size_flash_chip / (1024 * 1024))) + " MB</td></tr>");
+      page.print("<tr><td>Current Free RAM</td><td>" + ConvBinUnits(ESP.getFreeHeap(), 1) + "</td></tr>");
+      page.print("</table>");
+    } else if (step == 3) {
+      page.print("<h4>Network Information</h4>");
+      page.print("<table class='center'>");
+      page.print("<tr><th>Parameter</th><th>Value</th></tr>");
+      page.print("<tr><td>LAN IP Address</td><td>"        + String(WiFi.localIP().toString()) + "</td></tr>");
+      page.print("<tr><td>Network Adapter MAC Address</td><td>" + String(WiFi.BSSIDstr()) + "</td></tr>");
+      page.print("<tr><td>WiFi SSID</td><td>"           + String(WiFi.SSID()) + "</td></tr>");
+      page.print("<tr><td>WiFi RSSI</td><td>"           + String(WiFi.RSSI()) + " dB</td></tr>");
+      page.print("<tr><td>WiFi Channel</td><td>"        + String(WiFi.channel()) + "</td></tr>");
+      page.print("<tr><td>WiFi Encryption Type</td><td>"    + String(EncryptionType(WiFi.encryptionType(0))) + "</td></tr>");
+      page.print("</table> ");
+    }
+    return step < 3;
+  });
 }
 //#############################################################################################
 String ConvBinUnits(int bytes, int resolution) {
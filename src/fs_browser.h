@@ -17,6 +17,34 @@
 #include "esp_flash.h"
 #include "config.h"
 
+#include <vector>
+
+// streaming tar archive of day logs, see fs_browser.cpp
+class TarStream {
+public:
+  TarStream(const String &dir, uint32_t firstDay, uint32_t lastDay);
+
+  size_t length();
+  size_t read(uint8_t *buf, size_t maxLen);
+
+private:
+  struct TarFile {
+    uint16_t day;
+    uint32_t size;
+  };
+  enum TarPart { TAR_START, TAR_HEADER, TAR_DATA, TAR_PADDING, TAR_END };
+
+  String dir;                         // in the archive
+  std::vector<TarFile> files;
+  size_t next = 0;
+  TarPart part = TAR_START;
+  size_t remaining = 0;               // bytes of the current part
+  File file;
+  uint8_t header[512];
+
+  void makeHeader();
+};
+
 extern wifi_mode_t wifiMode;
 extern IPAddress IP;
 
@@ -28,20 +56,20 @@ void end_file_browser();
 extern String HTML_Header;
 extern String HTML_Footer;
 void Dir(AsyncWebServerRequest * request);
-void Directory();
-void UploadFileSelect();
-void Format();
+void UploadFileSelect(AsyncWebServerRequest *request);
+void Format(AsyncWebServerRequest *request);
 void handleFileUpload(AsyncWebServerRequest *request, const String& filename, size_t index, uint8_t *data, size_t len, bool final);
-void Handle_File_Delete(String filename);
-void File_Rename();
-void Handle_File_Rename();
+void Handle_File_Delete(AsyncWebServerRequest *request, String filename);
+void File_Rename(AsyncWebServerRequest *request);
+void Handle_File_Rename(AsyncWebServerRequest *request, String filename, int Args);
+int Send_File(AsyncWebServerRequest *request, String filename, String contentType);
 void notFound(AsyncWebServerRequest *request);
 String getContentType(String filenametype);
-void Select_File_For_Function(String title, String function);
+void Select_File_For_Function(AsyncWebServerRequest *request, String title, String function, const char *extra = "");
 int GetFileSize(String filename);
-void Home();
-void Page_Not_Found();
-void Display_System_Info();
+void Home(AsyncWebServerRequest *request);
+void Page_Not_Found(AsyncWebServerRequest *request);
+void Display_System_Info(AsyncWebServerRequest *request);
 String ConvBinUnits(int bytes, int resolution);
 String EncryptionType(wifi_auth_mode_t encryptionType);
 
@@ -18,7 +18,7 @@ enum GpsFixLevel {
 int gpsFixLevel = GPS_NO_FIX;
 int prevFixLevel = GPS_NO_FIX;
 
-char dateBuf[11], newDateBuf[11], timeBuf[9];
+char dateBuf[11], timeBuf[9];
 int numConsecutiveFix = 0;
 
 void setSystemTimeFromGPS() {
@@ -10,9 +10,52 @@
 #define RADIOLIB_LORAWAN_NODE_R (0)
 #endif
 
-// LoRaWAN class
+// The radio shares spiSX with the SD card, which is archived by a background task
+// (sdsync.h). Radio transactions have priority: the task hands over the bus between
+// writes as soon as the radio is waiting for it.
 SPIClass spiSX(SPI);
-SX1262 radio = new Module(8, 14, 12, 13, spiSX, RADIOLIB_DEFAULT_SPI_SETTINGS);   // NSS/CS, DIO0, RST, DIO1
+SemaphoreHandle_t spiBus = xSemaphoreCreateMutex();
+volatile uint8_t spiBusWaiting = 0;
+
+void spiBusTake() {
+  xSemaphoreTake(spiBus, portMAX_DELAY);
+}
+
+void spiBusGive() {
+  xSemaphoreGive(spiBus);
+}
+
+// called by the SD task between transfers
+void spiBusYield() {
+  if(spiBusWaiting) {
+    spiBusGive();
+    while(spiBusWaiting) {
+      vTaskDelay(1);
+    }
+    spiBusTake();
+  }
+}
+
+class SharedBusHal : public ArduinoHal {
+public:
+  SharedBusHal(SPIClass &spi, SPISettings settings) : ArduinoHal(spi, settings) {}
+
+  void spiBeginTransaction() override {
+    spiBusWaiting++;
+    spiBusTake();
+    spiBusWaiting--;
+    ArduinoHal::spiBeginTransaction();
+  }
+
+  void spiEndTransaction() override {
+    ArduinoHal::spiEndTransaction();
+    spiBusGive();
+  }
+};
+
+// LoRaWAN class
+SharedBusHal radioHal(spiSX, RADIOLIB_DEFAULT_SPI_SETTINGS);
+SX1262 radio = new Module(&radioHal, 8, 14, 12, 13);                             // NSS/CS, DIO0, RST, DIO1
 #if RADIOLIB_LORAWAN_NODE_R
 LoRaWANNodeR node(&radio, band);
 #else
@@ -27,7 +70,7 @@ RTC_DATA_ATTR uint8_t LWnoder[RADIOLIB_LORAWAN_NODER_BUF_SIZE];
 // LoRaWAN uplink/downlink parameters
 uint8_t fPort = 1;
 
-const size_t maxFrameSize = 51;
+const size_t maxFrameSize = 242;    // largest application payload of any datarate
 size_t frameUpSize = 0;
 uint8_t frameUp[maxFrameSize] = { 0 };
 
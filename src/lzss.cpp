@@ -0,0 +1,88 @@
+#include "lzss.h"
+
+size_t lzssCompress(const uint8_t *in, size_t len, uint8_t *out, size_t maxOut) {
+  if(len > LZSS_WINDOW) {
+    return(0);
+  }
+  size_t pos = 0;
+  size_t n = 0;
+  size_t flagPos = 0;
+  uint8_t bit = 8;
+
+  while(pos < len) {
+    // a new flag byte for every eight items
+    if(bit == 8) {
+      if(n >= maxOut) {
+        return(0);
+      }
+      flagPos = n++;
+      out[flagPos] = 0;
+      bit = 0;
+    }
+
+    // longest earlier match, of which the nearest wins
+    size_t bestLen = 0;
+    size_t bestOff = 0;
+    size_t maxLen = min(len - pos, (size_t)LZSS_MAX_MATCH);
+    for(size_t cand = pos; cand-- > 0 && bestLen < maxLen; ) {
+      size_t l = 0;
+      while(l < maxLen && in[cand + l] == in[pos + l]) {
+        l++;
+      }
+      if(l > bestLen) {
+        bestLen = l;
+        bestOff = pos - cand;
+      }
+    }
+
+    if(bestLen >= LZSS_MIN_MATCH) {
+      if(n + 2 > maxOut) {
+        return(0);
+      }
+      uint16_t token = (bestOff - 1) | ((bestLen - LZSS_MIN_MATCH) << 11);
+      out[n++] = token & 0xFF;
+      out[n++] = token >> 8;
+      pos += bestLen;
+    } else {
+      if(n + 1 > maxOut) {
+        return(0);
+      }
+      out[flagPos] |= 1 << bit;
+      out[n++] = in[pos++];
+    }
+    bit++;
+  }
+  return(n);
+}
+
+size_t lzssDecompress(const uint8_t *in, size_t len, uint8_t *out, size_t maxOut) {
+  size_t pos = 0;
+  size_t n = 0;
+  while(pos < len) {
+    uint8_t flags = in[pos++];
+    for(uint8_t bit = 0; bit < 8 && pos < len; bit++) {
+      if(flags & (1 << bit)) {
+        if(n >= maxOut) {
+          return(0);
+        }
+        out[n++] = in[pos++];
+      } else {
+        if(pos + 2 > len) {
+          return(0);
+        }
+        uint16_t token = in[pos] | (in[pos + 1] << 8);
+        pos += 2;
+        size_t off = (token & 0x7FF) + 1;
+        size_t l = (token >> 11) + LZSS_MIN_MATCH;
+        if(off > n || n + l > maxOut) {
+          return(0);
+        }
+        // byte by byte, as a match may overlap its own output
+        for(size_t i = 0; i < l; i++, n++) {
+          out[n] = out[n - off];
+        }
+      }
+    }
+  }
+  return(n);
+}
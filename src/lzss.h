@@ -0,0 +1,20 @@
+#ifndef _LZSS_H
+#define _LZSS_H
+
+#include <Arduino.h>
+
+// LZSS compression of small buffers (at most LZSS_WINDOW bytes), such as the blocks
+// of a packed day file. Each group of eight items is preceded by a flag byte, of
+// which a set bit is a literal byte and a cleared bit a 2-byte reference to an
+// earlier match: 11 bits offset - 1, 5 bits length - LZSS_MIN_MATCH.
+
+#define LZSS_WINDOW       2048
+#define LZSS_MIN_MATCH    3
+#define LZSS_MAX_MATCH    (LZSS_MIN_MATCH + 31)
+#define LZSS_BOUND(len)   ((len) + ((len) + 7) / 8)   // worst case: all literals
+
+// both return the number of bytes written to out, or 0 if out is too small or in is invalid
+size_t lzssCompress(const uint8_t *in, size_t len, uint8_t *out, size_t maxOut);
+size_t lzssDecompress(const uint8_t *in, size_t len, uint8_t *out, size_t maxOut);
+
+#endif
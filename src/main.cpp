@@ -4,50 +4,38 @@
 
 #include <Wire.h>
 #include <SPI.h>
+#include <memory>
 
 #include "pins.h"
 
 #include "TinyGPS++.h"
-#include <Adafruit_Sensor.h>
-#include <Adafruit_TSL2591.h>
-#include <Adafruit_AS7331.h>
-#include <Adafruit_BME280.h>
-#include <SensirionI2cScd4x.h>
-#include <SensirionI2CSen5x.h>
 
 #include <Adafruit_GFX.h>
 #include <GxEPD2_BW.h>
 
 #include "config.h"
 #include "flash.h"
+#include "datalog.h"
 #include "lorawan.h"
 #include "gnss.h"
 #include "accelerometer.h"
-#include "soundsensor.h"
-#include "measurement.h"
+#include "sensors.h"
+#include "battery.h"
 #include "fs_browser.h"
 #include "serial.h"
 #include "display.h"
+#include "sdsync.h"
+#include "publish.h"
+#include "events.h"
+#include "payload.h"
 
 #include <SD.h>
 
-Adafruit_TSL2591 tsl;
-Adafruit_BME280 bme;
-Adafruit_AS7331 uv;
-SensirionI2cScd4x scd4x;
-SensirionI2CSen5x sen5x;
-SoundSensor mic;
-
 // e-ink display: GDEY0213B74 122x250, SSD1680 (FPC-A002 20.04.08)
 GxEPD2_BW<GxEPD2_213_GDEY0213B74, GxEPD2_213_GDEY0213B74::HEIGHT> 
       epdDisplay(GxEPD2_213_GDEY0213B74(EPD_CS, TFTEPD_DC, TFTEPD_RST, EPD_BUSY));
 
-float temp, humi, pres, lumi, db_min, db_avg, db_max;
-float scd_temp, scd_hum, uva, uvb, uvc;
-float pm1_0, pm2_5, pm4_0, pm10_, hum5x, temp5x, vocIndex, noxIndex;
-uint16_t co2;
-bool key, doGNSS, sen5xNeedsReset = true;
-uint32_t tStart;
+bool key, doGNSS;
 
 enum dipIntervals {
   FAST = 5,
@@ -63,15 +51,8 @@ enum DeviceStates {
   JOIN,
   START_GNSS,
   WAIT_SATELLITE,
-  START_PM,
-  START_MIC,
-  MEAS_TPH,
-  START_CO2,
-  MEAS_LUM,
-  MEAS_UV,
-  MEAS_CO2,
-  MEAS_MIC,
-  MEAS_PM,
+  START_SENSORS,
+  MEAS_SENSORS,
   WAIT_GNSS,
   SENDRECEIVE,
   SHOW_MEAS,
@@ -93,6 +74,12 @@ bool powerIsLow = false;
 RTC_DATA_ATTR uint64_t wakePins1 = 0;
 RTC_DATA_ATTR int numStationaryUplinks = 0;
 
+// measurements held back for a batched uplink, oldest first
+RTC_DATA_ATTR uint8_t batchFrames[PAYLOAD_BATCH_MAX][PAYLOAD_MAX_SIZE];
+RTC_DATA_ATTR uint32_t batchTimes[PAYLOAD_BATCH_MAX];
+RTC_DATA_ATTR uint8_t batchPorts[PAYLOAD_BATCH_MAX];
+RTC_DATA_ATTR uint8_t batchCount = 0;
+
 bool buttonPressed = false;
 bool buttonActive = false;
 bool buttonReleased = false;
@@ -147,34 +134,59 @@ int ext1WakePinStatus() {
     return(pin);
 }
 
+// store the full-resolution readings of this cycle in the binary measurement log
 void writeUplinkToLog() {
   time_t now = time(NULL);
   struct tm *timeInfo = localtime(&now);
 
-  snprintf(newDateBuf, 11, "%04d-%02d-%02d", 
-           timeInfo->tm_year + 1900, timeInfo->tm_mon + 1, timeInfo->tm_mday);
-  snprintf(timeBuf, 9, "%02d:%02d:%02d", 
-          timeInfo->tm_hour, timeInfo->tm_min, timeInfo->tm_sec);
-
-  if (newDateBuf != dateBuf)
-    checkAvailableStorage(newDateBuf);
-  memcpy(dateBuf, newDateBuf, 11);
-
-  char line[128];
-  snprintf(&line[ 0],10, "%s,", timeBuf);
-  uint32_t dev32 = (cfg.actvn.otaa.devEUI >> 32);
-  snprintf(&line[ 9], 9, "%08X", dev32);
-  snprintf(&line[17],10, "%08X,", (uint32_t)cfg.actvn.otaa.devEUI);
-  snprintf(&line[26], 3, "% 3d,", fPort);
-  for(int i = 0; i < frameUpSize; i++) {
-    snprintf(&line[29+i*2], 3, "%02X", frameUp[i]);
+  // the fields are clamped to their width, so that both fit their buffer
+  snprintf(dateBuf, sizeof(dateBuf), "%04u-%02u-%02u",
+           (timeInfo->tm_year + 1900) % 10000u, (timeInfo->tm_mon + 1) % 100u, timeInfo->tm_mday % 100u);
+  snprintf(timeBuf, sizeof(timeBuf), "%02u:%02u:%02u",
+           timeInfo->tm_hour % 100u, timeInfo->tm_min % 100u, timeInfo->tm_sec % 100u);
+
+  storageOpenDay(dayNumber(timeInfo->tm_year + 1900, timeInfo->tm_mon + 1, timeInfo->tm_mday));
+
+  LogRecord rec;
+  rec.time = now;
+  bool fix = dipGnss && gps.location.isValid();
+  rec.lat = fix ? logI32(gps.location.lat(), 1e-7) : LOG_NA_I32;
+  rec.lon = fix ? logI32(gps.location.lng(), 1e-7) : LOG_NA_I32;
+  rec.alt = fix ? logI16(gps.altitude.meters(), 0.1) : LOG_NA_I16;
+  rec.hdop = fix ? logU8(gps.hdop.hdop(), 0.1) : LOG_NA_U8;
+  rec.sats = fix ? gps.satellites.value() : LOG_NA_U8;
+  rec.batt = battMillivolts;
+  rec.temp = logI16(readings.temp, 0.01);
+  rec.humi = logU16(readings.humi, 0.01);
+  rec.pres = logU32(readings.pres, 0.001);
+  rec.lumi = readings.lumi;
+  rec.uva = logU16(readings.uva, 0.1);
+  rec.uvb = logU16(readings.uvb, 0.1);
+  rec.co2 = readings.co2;
+  rec.scdTemp = logI16(readings.scdTemp, 0.01);
+  rec.scdHumi = logU16(readings.scdHumi, 0.01);
+  rec.pm1_0 = logU16(readings.pm1_0, 0.1);
+  rec.pm2_5 = logU16(readings.pm2_5, 0.1);
+  rec.pm4_0 = logU16(readings.pm4_0, 0.1);
+  rec.pm10 = logU16(readings.pm10, 0.1);
+  rec.temp5x = logI16(readings.temp5x, 0.005);
+  rec.humi5x = logI16(readings.humi5x, 0.01);
+  rec.vocIndex = logI16(readings.vocIndex, 0.1);
+  rec.noxIndex = logI16(readings.noxIndex, 0.1);
+  rec.dbMin = logU16(readings.dbMin, 0.01);
+  rec.dbAvg = logU16(readings.dbAvg, 0.01);
+  rec.dbMax = logU16(readings.dbMax, 0.01);
+
+  char path[16];
+  snprintf(path, sizeof(path), "/%s.bin", dateBuf);
+  Serial.printf("[%s] %s logged to %s\n", dateBuf, timeBuf, path);
+  storageAdded(logAppend(path, rec));
+
+  if(eventClients) {
+    char json[512];
+    logFormat(rec, LOG_JSON, json, sizeof(json));
+    eventPublish("record", json);
   }
-  Serial.printf("[%s] %s\n", dateBuf, line);
-  File file = LittleFS.open("/" + String(dateBuf) + ".csv", "a");
-  file.println(line);
-  file.close();
-  RADIOLIB_DEBUG_PROTOCOL_HEXDUMP((uint8_t*)line, 29);
-  RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(frameUp, frameUpSize);
 }
 
 // calculate relative humidity for T2 based on T1 and RH1
@@ -197,88 +209,39 @@ float convertRH(float RH1, float T1, float T2) {
 
 /* Prepares the payload of the frameUp */
 uint8_t prepareTxFrame() {
-  uint8_t port = 1;             // default port 1
-  if(isMotion) port |= BIT(1);  // set second bit in case of motion
+  PayloadValues v;
+  v.flags = 0;
+  if(isMotion) v.flags |= PAYLOAD_MOTION;
+  if(dipInterval == FAST) v.flags |= PAYLOAD_VOC_NOX;   // includes VOC and NOx
+  if(dipGnss) v.flags |= PAYLOAD_GNSS;
 
   Serial.printf("Battery: %d mV\n", battMillivolts);
-
-  // battery
-  frameUp[0] = max(0, min(255, int((battMillivolts - 2500) / 10)));
+  v.batt = battMillivolts;
 
   // SCD41 temperature and recalculated humidity
-  uint16_t rawTemp = (uint16_t)max(0, min(32767, int(abs(scd_temp) * 100)));
-  if (scd_temp < 0)
-    rawTemp |= (uint16_t(1) << 15);
-  memcpy(&frameUp[1], &rawTemp, 2);
-  float recalcHumi = convertRH(humi, temp, scd_temp);
-  Serial.printf("Temp: %.1f, humi: %.1f\n", scd_temp, recalcHumi);
-  frameUp[3] = max(0, min(255, int(recalcHumi * 2)));
-
-  // pressure
-  uint16_t rawPres = max(0, min(65535, int(pres * 10)));
-  memcpy(&frameUp[4], &rawPres, 2);
-
-  // luminosity
-  uint16_t rawLumi = max(0, min(65535, int(lumi)));
-  memcpy(&frameUp[6], &rawLumi, 2);
-
-  // uv(-a)
-  uint16_t rawUva = max(0, min(65535, (int)uva));
-  memcpy(&frameUp[8], &rawUva, 2);
-
-  // db: min, avg, max
-  frameUp[10] = max(0, min(255, int((db_min - 32) * 4)));
-  frameUp[11] = max(0, min(255, int((db_avg - 32) * 4)));
-  frameUp[12] = max(0, min(255, int((db_max - 32) * 4)));
-
-  // co2
-  uint16_t rawCO2 = (uint16_t)max(0, min(65535, (int)co2));
-  memcpy(&frameUp[13], &rawCO2, 2);
-
-  // pm2.5, pm10
-  uint16_t rawPM25 = max(0, min(4095, int(pm2_5 * 10)));
-  uint16_t rawPM10 = max(0, min(4095, int(pm10_ * 10)));
-  frameUp[15] = (uint8_t)rawPM25;             // pm2.5 LSB
-  frameUp[16] = (uint8_t)rawPM10;             // pm10  LSB
-  frameUp[17] = ((rawPM25 >> 8) << 4) | (rawPM10 >> 8);   // pm2.5 | pm10 MSB
-
-  frameUpSize = 18;
-
-  if(dipInterval == FAST) {  // includes VOC and NOx
-    port |= BIT(2);
-    
-    uint16_t rawVoc = vocIndex*10;
-    uint16_t rawNox = noxIndex*10;
-    memcpy(&frameUp[frameUpSize+0], &rawVoc, 2);
-    memcpy(&frameUp[frameUpSize+2], &rawNox, 2);
-    
-    frameUpSize += 4;
-  }
-  if(dipGnss) {
-    port |= BIT(3);
-    
-    uint32_t rawLat = abs(gps.location.lat()) * 10000000;
-    if (gps.location.lat() < 0)
-      rawLat |= (1ul << 31);
-    uint32_t rawLng = abs(gps.location.lng()) * 10000000;
-    if (gps.location.lng() < 0)
-      rawLng |= (1ul << 31);
-    uint16_t rawAlt = abs(gps.altitude.meters()) * 10;
-    if (gps.altitude.meters() < 0)
-      rawAlt |= (1ul << 15);
-    uint8_t rawHdop = (int)(gps.hdop.hdop() * 10);
-    uint8_t rawSats = gps.satellites.value();
-
-    memcpy(&frameUp[frameUpSize+0], &rawLat, 4);
-    memcpy(&frameUp[frameUpSize+4], &rawLng, 4);
-    memcpy(&frameUp[frameUpSize+8], &rawAlt, 2);
-    memcpy(&frameUp[frameUpSize+10], &rawHdop, 1);
-    memcpy(&frameUp[frameUpSize+11], &rawSats, 1);
-
-    frameUpSize += 12;
-  }
-
-  return port;
+  v.temp = readings.scdTemp;
+  v.humi = convertRH(readings.humi, readings.temp, readings.scdTemp);
+  Serial.printf("Temp: %.1f, humi: %.1f\n", v.temp, v.humi);
+
+  v.pres = readings.pres;
+  v.lumi = readings.lumi;
+  v.uva = readings.uva;
+  v.dbMin = readings.dbMin;
+  v.dbAvg = readings.dbAvg;
+  v.dbMax = readings.dbMax;
+  v.co2 = readings.co2;
+  v.pm2_5 = readings.pm2_5;
+  v.pm10 = readings.pm10;
+  v.voc = readings.vocIndex;
+  v.nox = readings.noxIndex;
+  v.lat = gps.location.lat();
+  v.lon = gps.location.lng();
+  v.alt = gps.altitude.meters();
+  v.hdop = gps.hdop.hdop();
+  v.sats = gps.satellites.value();
+
+  frameUpSize = payloadEncode(v, frameUp);
+  return(payloadPort(v));
 }
 
 void parseDownlink() {
@@ -328,9 +291,79 @@ void parseDownlink() {
   }
 }
 
+void batchAdd(const uint8_t *frame, uint8_t port) {
+  if(batchCount == PAYLOAD_BATCH_MAX) {
+    batchCount--;
+    memmove(batchFrames, batchFrames[1], batchCount * PAYLOAD_MAX_SIZE);
+    memmove(batchTimes, &batchTimes[1], batchCount * sizeof(uint32_t));
+    memmove(batchPorts, &batchPorts[1], batchCount);
+  }
+  memcpy(batchFrames[batchCount], frame, PAYLOAD_MAX_SIZE);
+  batchTimes[batchCount] = time(NULL);
+  batchPorts[batchCount++] = port;
+}
+
+// the number of held-back measurements from the oldest that have its layout, and
+// their fPort, with PAYLOAD_MOTION if any had motion
+uint8_t batchRun(uint8_t &port) {
+  uint8_t n = 0;
+  port = 0;
+  while(n < batchCount && !((batchPorts[n] ^ batchPorts[0]) & (PAYLOAD_VOC_NOX | PAYLOAD_GNSS))) {
+    port |= batchPorts[n++];
+  }
+  return(n);
+}
+
+// replace frameUp by the oldest held-back measurements, as many of that layout as fit;
+// the rest stay held back and go first in the next uplink. Only the measurement of this
+// cycle on its own goes as the single uplink that frameUp still is.
+void batchEncode() {
+  if(batchCount == 1) {
+    batchCount = 0;
+    return;
+  }
+  uint8_t port, used;
+  uint8_t run = batchRun(port);
+  frameUpSize = payloadBatch(port, batchFrames, batchTimes, run, time(NULL), frameUp, node.getMaxPayloadLen(), used);
+  fPort = port | PAYLOAD_BATCH;
+  batchCount -= used;
+  memmove(batchFrames, batchFrames[used], batchCount * PAYLOAD_MAX_SIZE);
+  memmove(batchTimes, &batchTimes[used], batchCount * sizeof(uint32_t));
+  memmove(batchPorts, &batchPorts[used], batchCount);
+}
+
+/* With the batch setting, hold the measurement in frameUp back until enough of them are
+   collected to fill an uplink at the current datarate, and then send them at once; motion
+   sends them right away, as does a change of layout (VOC/NOx, GNSS), which sends the older
+   ones first. Returns whether to send frameUp now, which then is the batch or this
+   measurement on its own. */
+bool batchUplink() {
+  if(cfg.interval.batch <= 1 && !batchCount) {
+    return(true);
+  }
+  batchAdd(frameUp, fPort);
+
+  uint8_t port, used;
+  uint8_t run = batchRun(port);
+  size_t maxLen = node.getMaxPayloadLen();
+  uint8_t batch[PAYLOAD_BATCH_HEADER + PAYLOAD_MAX_SIZE + (PAYLOAD_BATCH_MAX - 1) * PAYLOAD_BATCH_RECORD];
+  size_t len = payloadBatch(port, batchFrames, batchTimes, run, time(NULL), batch, maxLen, used);
+  if(!isMotion && run == batchCount && batchCount < cfg.interval.batch && used == batchCount &&
+     len + PAYLOAD_BATCH_RECORD <= maxLen) {
+    Serial.printf("Batch: %u of %u measurements, %u bytes\n", batchCount, cfg.interval.batch, (unsigned)len);
+    return(false);
+  }
+  batchEncode();
+  return(true);
+}
+
 void sendUplink() {
   fPort = prepareTxFrame();           // parse payload
   prevUplink = tNow;
+  if(!batchUplink()) {
+    writeUplinkToLog();
+    return;
+  }
   int16_t window = node.sendReceive(frameUp, frameUpSize, fPort, frameDown, &frameDownSize, 
                                     cfg.uplink.confirmed, &eventUp, &eventDown);
   
@@ -432,6 +465,12 @@ void readDip() {
 
 void turnOff() {
   memcpy(gpsBuf, &gps, sizeof(TinyGPSPlus));
+  sdSyncEnd();
+
+  // staged log records are written to flash before switching off or running empty
+  if((digitalRead(POWER) == LOW || powerIsLow) && LittleFS.begin()) {
+    storageAdded(logFlush());
+  }
 
   // handle Timer source if the device is enabled
   if(digitalRead(POWER) == HIGH && !powerIsLow) {
@@ -468,6 +507,18 @@ void turnOff() {
   }
   esp_sleep_enable_ext1_wakeup(wakePins1, wakeLevel1);
 
+  // handle ULP source (battery) if the device is enabled:
+  // wake up to go into low power mode once empty, or to resume once recharged
+  if(digitalRead(POWER) == HIGH) {
+    if(powerIsLow) {
+      ulpStart(0, BATT_RESUME_MV);
+    } else {
+      ulpStart(BATT_WAKE_EMPTY_MV, 0);
+    }
+  } else {
+    ulpStop();
+  }
+
   esp_deep_sleep_start();
 }
 
@@ -503,13 +554,43 @@ int execCommand(String &command) {
   }
   key.toLowerCase();
 
+  // +log=<from>,<to>: print the measurements in [from, to) as CSV
+  if (key == "log") {
+    int comma = value.indexOf(',');
+    uint32_t from = logParseTime(value.substring(0, comma).c_str());
+    uint32_t to = comma > 0 ? logParseTime(value.substring(comma + 1).c_str()) : 0;
+    if (!from || to <= from)
+      return valueError;
+    std::unique_ptr<LogDecoder> decoder(new LogDecoder(from, to, LOG_CSV));   // too large for the stack
+    uint8_t buf[256];
+    size_t len;
+    while ((len = decoder->read(buf, sizeof(buf))) > 0) {
+      Serial.write(buf, len);
+    }
+    if (decoder->skipped())
+      Serial.printf("%u invalid records skipped\r\n", (unsigned)decoder->skipped());
+    return noError;
+  }
+
+  // +decode=<port>,<hex>: print the values of an uplink payload
+  if (key == "decode") {
+    int comma = value.indexOf(',');
+    PayloadValues v;
+    if (comma <= 0 || !payloadDecodeHex(value.toInt(), value.substring(comma + 1).c_str(), v))
+      return valueError;
+    char buf[512];
+    payloadFormat(v, PAYLOAD_JSON, buf, sizeof(buf));
+    Serial.printf("%s\r\n", buf);
+    return noError;
+  }
+
   if (command.indexOf("=") > 0) {
     int state = doSetting(key, value);
     return state;
   }
 
   if (key == "at") {
-    Serial.print(printFullConfig(true));
+    printFullConfig(Serial, true);
     Serial.printf("\n");
   } else
   if (key == "scan") {
@@ -543,7 +624,10 @@ int execCommand(String &command) {
     loadConfig();
   } else
   if (key == "check") {
-    checkAvailableStorage("1999-99-99");
+    storageRebuild();
+    storageEnforce();
+    storageReport();
+    logReport();
   } else
   if (key == "join") {
     node.clearSession();
@@ -572,7 +656,7 @@ int execCommand(String &command) {
       deviceState = SENDRECEIVE;
     }
     else if (node.isActivated()) {
-      deviceState = START_PM;
+      deviceState = START_SENSORS;
     }
     else if(deviceState == JOIN) {
       uplinkASAP();
@@ -619,6 +703,7 @@ void wifiEnable(int val) {
   (void)val;
 
   wifiMode = WIFI_MODE_STA;
+  storageAdded(logFlush());   // make all records available in the file browser
   if (connectWiFi()) {
     start_file_browser();
     serverRunning = true;
@@ -630,10 +715,29 @@ void wifiDisable(int val) {
   if(serverRunning) {
     end_file_browser();
     serverRunning = false;
+    storageInvalidate();    // files may have been deleted or uploaded
   }
   disconnectWiFi();
 }
 
+// with WiFi on the DIP switches, the records also go to the publish endpoint; WiFi is
+// only switched on for it when there is something to send
+void publishOverWiFi() {
+  if(!dipWifi || !publishPending()) {
+    return;
+  }
+  bool wasOn = wifiMode != WIFI_MODE_NULL;
+  if(!wasOn) {
+    connectWiFi();
+  }
+  if(WiFi.isConnected()) {
+    publishRecords();
+  }
+  if(!wasOn) {
+    disconnectWiFi();
+  }
+}
+
 // check if the battery has enough juice
 // if not, flash LED a few times and go into infinite deepsleep
 // being connected to USB power is also OK
@@ -649,35 +753,6 @@ void goLowPower() {
   turnOff();
 }
 
-static float zweighting[] = Z_WEIGHTING;    // weighting lists
-static Measurement zMeasurement( zweighting);  // measurement buffers
-
-volatile bool mic_stop = false;
-volatile bool mic_stopped = false;
-
-void mic_get_db(void * params) {
-
-  mic.offset(-1.8);    // for SPH0645
-  mic.begin(BCLK, LRCLK, DIN);
-  long startMic = millis();
-  bool reset = false;
-
-  while (!mic_stop) {
-    float* energy = mic.readSamples();
-    zMeasurement.update(energy);
-    if (millis() - startMic > 3000) {
-      if (!reset) {
-        zMeasurement.reset();
-        reset = true;
-      }
-    }
-  }
-  zMeasurement.calculate();
-  mic.disable();
-  mic_stopped = true;
-  vTaskDelete(NULL);
-}
-
 // Function to extract the decimal part and return it as a String without the integer part
 String to_decimal(float value) {
   String decimalString = String(value, 1);
@@ -697,7 +772,7 @@ void display_battery() {
     // draw device name and firmware version
     epdDisplay.setTextSize(1);
     epdDisplay.setCursor(3, 228);
-    epdDisplay.printf("%s", cfg.wl2g4.name.substring(0, 11));
+    epdDisplay.printf("%.11s", cfg.wl2g4.name);
     epdDisplay.setCursor(78, 228);
     epdDisplay.printf(MJLO_VERSION);
     
@@ -781,21 +856,21 @@ void display_eink() {
 
     epdDisplay.setTextSize(3);
     epdDisplay.setCursor(1, 0);
-    epdDisplay.printf("%4.1f", temp);
+    epdDisplay.printf("%4.1f", readings.temp);
     epdDisplay.setCursor(49, 27);
-    epdDisplay.printf("%4.1f", humi);
+    epdDisplay.printf("%4.1f", readings.humi);
     epdDisplay.setCursor(1, 54);
-    epdDisplay.printf("%4.0f", pres);
+    epdDisplay.printf("%4.0f", readings.pres);
     epdDisplay.setCursor(49, 81);
-    epdDisplay.printf("%4d", co2);
+    epdDisplay.printf("%4d", readings.co2);
     epdDisplay.setCursor(1, 108);
-    epdDisplay.printf("%4.1f", db_avg);
+    epdDisplay.printf("%4.1f", readings.dbAvg);
     epdDisplay.setCursor(49, 135);
-    epdDisplay.printf("%4.1f", pm2_5);
+    epdDisplay.printf("%4.1f", readings.pm2_5);
     epdDisplay.setCursor(1, 162);
-    epdDisplay.printf("%4.0f", uva);
+    epdDisplay.printf("%4.0f", readings.uva);
     epdDisplay.setCursor(49, 189);
-    epdDisplay.printf("%4.0f", lumi);
+    epdDisplay.printf("%4.0f", readings.lumi);
 
     // draw current time
     epdDisplay.setTextSize(1);
@@ -805,7 +880,7 @@ void display_eink() {
 
     // draw device name and firmware version
     epdDisplay.setCursor(3, 228);
-    epdDisplay.printf("%s", cfg.wl2g4.name.substring(0, 11));
+    epdDisplay.printf("%.11s", cfg.wl2g4.name);
     epdDisplay.setCursor(78, 228);
     epdDisplay.printf(MJLO_VERSION);
 
@@ -823,89 +898,6 @@ void display_eink() {
   delay(50);
 }
 
-static const char *TAG = "FS_COPY";
-// -----------------------------------------------------------------------------
-// Helper: recursively copy a directory from LittleFS to SD.
-// -----------------------------------------------------------------------------
-bool copyDirRecursive(fs::FS &fsSrc, const String &srcPath, fs::FS &fsDst, const String &dstPath) {
-  // Open the source directory
-  File srcDir = fsSrc.open(srcPath.c_str());
-  if (!srcDir || !srcDir.isDirectory()) {
-    Serial.printf("  Failed to open source dir: %s\n", srcPath.c_str());
-    return false;
-  }
-
-  // Ensure destination directory exists (create recursively)
-  if (!fsDst.exists(dstPath)) {
-    if (!fsDst.mkdir(dstPath)) {
-      Serial.printf("  Failed to create destination dir: %s\n", dstPath.c_str());
-      srcDir.close();
-      return false;
-    }
-  }
-
-  // Iterate through everything inside srcDir
-  File entry = srcDir.openNextFile();
-  while (entry) {
-    String entryName = entry.name(); // e.g. "/foo.txt" or "/subdir"
-    // Build relative path from srcPath
-    String relPath = entryName.substring(srcPath.length());
-    if (relPath.startsWith("/")) {
-      relPath = relPath.substring(1);
-    }
-
-    String srcFullPath = "/" + entryName;                     // e.g. "/dir1/file.txt"
-    String dstFullPath = dstPath + "/" + relPath;       // e.g. "/backup/dir1/file.txt"
-
-    if (entry.isDirectory()) {
-      // Recursively copy sub-directory
-      Serial.printf("  Creating dir: %s\n", dstFullPath.c_str());
-      copyDirRecursive(fsSrc, srcFullPath, fsDst, dstFullPath);
-    } else {
-      // It's a file: copy its contents
-      Serial.printf("  Copying file: %s → %s\n", srcFullPath.c_str(), dstFullPath.c_str());
-      // Open source file for reading
-      File fSrc = fsSrc.open(srcFullPath, FILE_READ);
-      if (!fSrc) {
-        Serial.printf("    Failed to open source file: %s\n", srcFullPath.c_str());
-        entry.close();
-        continue;
-      }
-
-      // If destination file already exists, remove it first
-      if (fsDst.exists(dstFullPath)) {
-        fsDst.remove(dstFullPath);
-      }
-
-      // Open destination file for writing (will create it)
-      File fDst = fsDst.open(dstFullPath, FILE_WRITE);
-      if (!fDst) {
-        Serial.printf("    Failed to open destination file: %s\n", dstFullPath.c_str());
-        fSrc.close();
-        entry.close();
-        continue;
-      }
-
-      // Copy data in 4KB chunks
-      const size_t BUF_SIZE = 4096;
-      uint8_t buf[BUF_SIZE];
-      while (true) {
-        size_t bytesRead = fSrc.read(buf, BUF_SIZE);
-        if (bytesRead == 0) break;
-        fDst.write(buf, bytesRead);
-      }
-
-      fDst.close();
-      fSrc.close();
-    }
-
-    entry = srcDir.openNextFile();
-  }
-
-  srcDir.close();
-  return true;
-}
-
 void handleActionButton() {
   // if this is called when the button isn't released yet,
   // cycle to the next display style and move the button start time forward
@@ -965,7 +957,7 @@ void setup() {
 
   powerState = (digitalRead(POWER) == HIGH);
   usbState = usb_serial_jtag_is_connected();
-  battMillivolts = analogReadMilliVolts(BAT_ADC) * 4.9f;
+  battMillivolts = analogReadMilliVolts(BAT_ADC) * BATT_DIVIDER;
 
   tNow = time(NULL);
 
@@ -975,7 +967,7 @@ void setup() {
   }
 
   // next, check if battery has enough juice
-  if(battMillivolts < 2750) {
+  if(battMillivolts < BATT_EMPTY_MV) {
     goLowPower();
   }
 
@@ -1010,54 +1002,37 @@ void setup() {
     if(pin == KEY) {
       
     }
+
+  // woken by the ULP: the battery has been recharged, so start over as if just powered on
+  } else
+  if(wakeup_reason == ESP_SLEEP_WAKEUP_ULP) {
+    wakeup_reason = ESP_SLEEP_WAKEUP_UNDEFINED;
+    scheduleUplink(0, tNow);
   }
 
   if(usbState) {
     setupSerial();
   }
+
+  BatteryStats sleepBatt;
+  if(ulpBatteryStats(sleepBatt)) {
+    PRINTF("Battery during sleep: %d / %d / %d mV (min / avg / max, %d samples)\n",
+           sleepBatt.min, sleepBatt.avg, sleepBatt.max, sleepBatt.count);
+  }
   
-  loadConfig();
+  // on a wake from deep sleep, the configuration can be restored from RTC memory
+  loadConfig(wakeup_reason >= ESP_SLEEP_WAKEUP_EXT0);
 
   PRINTF("Starting filesystem...\n");
   if (!LittleFS.begin())  { PRINTF("Failed to initialize filesystem"); while(1) { delay(10); }; }
 
   // initialize SPI for radio and SD card
   spiSX.begin(SXSD_SCK, SXSD_MISO, SXSD_MOSI, SX_CS);              // SCK/CLK, MISO, MOSI, NSS/CS
-  if(SD.begin(SD_CS, spiSX)) {
-    Serial.println("SD card mounted.");
-    // check if SD card is really present & writable
-    uint64_t cardSize = SD.cardSize() / (1024ULL * 1024ULL);
-    Serial.printf("SD Card Size: %llu MB\n", cardSize);
-
-    // copy everything from root "/" to SD root "/MJLO-xxx"
-    const String LFSSource = "/";
-    const String SDestination = "/" + cfg.wl2g4.name;
-
-    Serial.printf("Starting recursive copy from '%s' to SD '%s'\n",
-                  LFSSource.c_str(), SDestination.c_str());
-
-    if (copyDirRecursive(LittleFS, LFSSource, SD, SDestination)) {
-      Serial.println("All files copied successfully.");
-    } else {
-      Serial.println("Errors occurred during copy.");
-    }
-
-    SD.end();
-
-    Serial.println("Copy complete.");
-
-    for(int i = 0; i < 10; i++) {
-      digitalWrite(LED_B, HIGH);
-      delay(50);
-      digitalWrite(LED_B, LOW);
-      delay(100);
-    }
-  } else {
-    Serial.println("No SD card.");
-  }
-
   radio.begin();                          // initialize SX1262 with default settings
 
+  // copy what is new in root "/" to SD root "/MJLO-xxx" in the background
+  sdSyncStart("/" + String(cfg.wl2g4.name));
+
   VextOn();
 
   spiST.begin(TFTEPD_SCK, TFTEPD_MISO, TFTEPD_MOSI, TFT_CS);            // SCK/CLK, MISO, MOSI, NSS/CS
@@ -1118,7 +1093,7 @@ void setup() {
     if(doGNSS) {
       deviceState = START_GNSS;
     } else {
-      deviceState = START_PM;
+      deviceState = START_SENSORS;
     }
   }
 
@@ -1157,6 +1132,13 @@ void handleSerialNmea() {
                 (hdop > 0 && hdop < 99) ? GPS_BAD_FIX : 
                                           GPS_NO_FIX;
 
+  // the receiver reports once per second
+  if(gps.time.second() != sec && gpsFixLevel != GPS_NO_FIX) {
+    eventPublishf("gnss", "\"lat\":%.7f,\"lon\":%.7f,\"alt\":%.1f,\"hdop\":%.1f,\"sats\":%u,\"good\":%s",
+                  gps.location.lat(), gps.location.lng(), gps.altitude.meters(), hdop,
+                  (unsigned)gps.satellites.value(), gpsFixLevel == GPS_GOOD_FIX ? "true" : "false");
+  }
+
 }
 
 void loop() {
@@ -1179,7 +1161,7 @@ void loop() {
     buttonReleased = false;
   }
 
-  battMillivolts = analogReadMilliVolts(BAT_ADC) * 4.9f;
+  battMillivolts = analogReadMilliVolts(BAT_ADC) * BATT_DIVIDER;
   powerState = digitalRead(POWER) == HIGH;
   usbState = usb_serial_jtag_is_connected();
 
@@ -1242,7 +1224,7 @@ void loop() {
           if(doGNSS) {
             deviceState = START_GNSS;
           } else {
-            deviceState = START_PM;
+            deviceState = START_SENSORS;
           }
         } else {
           deviceState = SLEEP;
@@ -1277,149 +1259,22 @@ void loop() {
         Serial.printf("% 8.5f, % 7.5f | HDOP % 4.1f | % 2d sats\n", gps.location.lat(), gps.location.lng(),
                         gps.hdop.hdop(), gps.satellites.value());
 
-        deviceState = START_PM;
+        deviceState = START_SENSORS;
       }
 
       break;
     }
-    case(START_PM): {
-      // start and reset only once
-      if(sen5xNeedsReset) {
-        pinMode(V5_CTRL, OUTPUT);
-        digitalWrite(V5_CTRL, HIGH);
-        delay(75);   // theoretical startup time is 50ms
-        sen5x.begin(Wire);
-        (void)sen5x.deviceReset();
-        (void)sen5x.startMeasurement();
-        sen5xNeedsReset = false;
-      }
+    case(START_SENSORS): {
+      sensorsStart(readings, { dipInterval == SLOW, isMotion });
 
-      deviceState = START_MIC;
-      break; 
-    }
-    case(START_MIC): {
-      mic_stop = false;
-      mic_stopped = false;
-
-      xTaskCreatePinnedToCore(
-        mic_get_db,   /* Task function. */
-        "Task1",       /* name of task. */
-        8192,       /* Stack size of task */
-        NULL,        /* parameter of the task */
-        1,         /* priority of the task */
-        NULL,      /* Task handle to keep track of created task */
-        0);        /* pin task to core 0 */
-
-      tStart = time(NULL);
-
-      deviceState = MEAS_TPH;
-      break;
-    }
-    // first read TPH, as the pressure will be used for CO2 calculation
-    case(MEAS_TPH): {
-      bme.begin(118, &Wire);
-      bme.setSampling(Adafruit_BME280::MODE_FORCED);
-      bme.takeForcedMeasurement();
-      delay(200);
-      bme.takeForcedMeasurement();
-      temp = bme.readTemperature();
-      humi = bme.readHumidity();
-      pres = bme.readPressure() / 100.0f;
-      bme.setSampling(Adafruit_BME280::MODE_SLEEP);
-      Serial.printf("Temp: %.2f, humi: %.2f, pres: %.2f\n", temp, humi, pres);
-      
-      deviceState = START_CO2;
-      break;
-    }
-    case(START_CO2): {
-      scd4x.begin(Wire, 0x62);
-      // scd4x.wakeUp();
-      scd4x.setAmbientPressure(pres * 100.0f);
-      // scd4x.stopPeriodicMeasurement();
-      
-      // manually call the measureSingleShot() registers as the library does a blocking call
-      uint8_t buffer_ptr[9] = { 0 };
-      SensirionI2CTxFrame txFrame =
-          SensirionI2CTxFrame::createWithUInt16Command(0x219d, buffer_ptr, 2);
-      (void)SensirionI2CCommunication::sendFrame(0x62, txFrame, Wire);
-
-      deviceState = MEAS_LUM;
-      break;
-    }
-    case(MEAS_LUM): {
-      tsl.begin(&Wire, 41);
-      tsl.enable();
-      uint32_t full = tsl.getFullLuminosity();
-      lumi = tsl.calculateLux(full & 0xFFFF, full >> 16);
-      tsl.disable();
-      Serial.printf("Lumi: %d\n", (int)lumi);
-      
-      deviceState = MEAS_UV;
-      break;
-    }
-    case(MEAS_UV): {
-      uv.begin(&Wire);
-      uv.powerDown(true);
-      uv.setGain(AS7331_GAIN_4X);
-      uv.setIntegrationTime(AS7331_TIME_64MS);
-      uv.setMeasurementMode(AS7331_MODE_CMD);
-      uv.powerDown(false);
-      uv.startMeasurement();
-      delay(5 + 1 << AS7331_TIME_64MS);
-      uv.readAllUV_uWcm2(&uva, &uvb, &uvc);
-      uv.powerDown(true);
-      Serial.printf("UV: %d uW/cm2\n", (int)uva);
-      
-      deviceState = MEAS_CO2;
+      deviceState = MEAS_SENSORS;
       break;
     }
-    case(MEAS_CO2): {
-      bool co2_ready = false;
-      scd4x.getDataReadyStatus(co2_ready);
-
-      // note: spec says this can take up to 5000ms, but I've never seen more than 4500ms 
-      if(co2_ready) {
-        scd4x.readMeasurement(co2, scd_temp, scd_hum);
-        // scd4x.powerDown();
-        Serial.printf("CO2: %d\n", co2);
-        Serial.printf("Temp: %.2f, humi: %.2f\n", scd_temp, scd_hum);
-        
-        deviceState = MEAS_MIC;
-      }
+    case(MEAS_SENSORS): {
+      // meanwhile, pack a day file that is no longer written to
+      storageCompact();
 
-      break;
-    }
-    case(MEAS_MIC): {
-      // wait for a total of 30 seconds of measurement
-      if(tNow - tStart > MEDIUM) {
-        mic_stop = true;
-        Serial.println("Stopping microphone");
-        while (!mic_stopped)
-          delay(10);
-        db_min = zMeasurement.min;
-        db_avg = zMeasurement.avg;
-        db_max = zMeasurement.max;
-        Serial.printf("dB: [%.1f | %.1f | %.1f]\n", db_min, db_avg, db_max);
-
-        deviceState = MEAS_PM;
-      }
-      
-      break;
-    }
-    case(MEAS_PM): {
-      // wait for a total of 30 seconds of measurement
-      if(tNow - tStart > MEDIUM) {
-        (void)sen5x.readMeasuredValues(pm1_0, pm2_5, pm4_0, pm10_, hum5x, temp5x, vocIndex, noxIndex);
-        Serial.printf("PM2.5: %.2f, PM10: %.2f\n", pm2_5, pm10_);
-        Serial.printf("Temp: %.2f, humi: %.2f\n", temp5x, hum5x);
-
-        // if there was motion, keep the sensor on for improved accuracy
-        // otherwise if there was no motion, power it down already to save energy
-        if(dipInterval == SLOW && !isMotion) {
-          digitalWrite(V5_CTRL, LOW);
-          sen5xNeedsReset = true;
-        }
-        
+      if(sensorsPoll(readings, { dipInterval == SLOW, isMotion })) {
         if(doGNSS) {
           deviceState = WAIT_GNSS;
         } else {
@@ -1483,6 +1338,8 @@ void loop() {
       uint32_t airtime = node.getLastToA();
 
       radio.sleep();
+
+      publishOverWiFi();
       
       wasMotion = isMotion;
       isMotion = false;
@@ -1529,7 +1386,7 @@ void loop() {
 
         // if not doing GNSS, go to PM measurement
         } else {
-          deviceState = START_PM;
+          deviceState = START_SENSORS;
         }
 
       // no motion: just go to sleep
@@ -1541,12 +1398,12 @@ void loop() {
       break;
     }
     case(SLEEP): {
-      // if something is happening, stay active
-      if(wifiMode || usbState) {
+      // if something is happening, or the next uplink is too close to sleep for, stay active
+      if(wifiMode || usbState || tNow + MEDIUM >= nextUplink) {
         if(!node.isActivated()) {
           deviceState = JOIN;
         } else if(tNow + MEDIUM >= nextUplink) {
-          deviceState = START_PM;
+          deviceState = START_SENSORS;
         }
         break;
       }
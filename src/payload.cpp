@@ -0,0 +1,418 @@
+#include <Arduino.h>
+#include <type_traits>
+#include "payload.h"
+#include "helpers.h"
+
+// (value - offset) * scale, truncated and clamped to [0, limit]; computed in the type of
+// the value, as float rounding may decide between two steps
+template<typename T>
+static uint32_t quantise(T value, T offset, T scale, uint32_t limit) {
+  T q = (value - offset) * scale;
+  if(!(q > 0)) {
+    return(0);                          // also NaN, for a sensor that did not respond
+  }
+  return(q >= limit ? limit : (uint32_t)q);
+}
+
+// sign-magnitude, with the sign in the top bit of the given width
+template<typename T>
+static uint32_t quantiseSigned(T value, T offset, T scale, uint8_t bits) {
+  value -= offset;
+  uint32_t mag = quantise<T>(value < 0 ? -value : value, 0, scale, (1ul << (bits - 1)) - 1);
+  return(value < 0 ? mag | (1ul << (bits - 1)) : mag);
+}
+
+// The field helpers are always inlined, so that the constants of a row fold into the
+// code even when optimising for size
+#define PAYLOAD_INLINE  inline __attribute__((always_inline))
+
+// a field in float, in which the sensors report, unless it is kept as a double
+template<typename M>
+static PAYLOAD_INLINE uint32_t quantiseField(M value, double scale, double offset, uint8_t bits, bool sign) {
+  typedef typename std::conditional<std::is_same<M, double>::value, double, float>::type T;
+  if(sign) {
+    return(quantiseSigned<T>(value, offset, scale, bits));
+  }
+  return(quantise<T>(value, offset, scale, bits < 32 ? (1ul << bits) - 1 : UINT32_MAX));
+}
+
+// a value a 1/64 step above the bottom of its step: the same when printed, and it
+// encodes to the same bytes again, where float rounding might end just below the step
+static double unquantise(uint32_t raw, double offset, double scale) {
+  return(offset + (raw + 1 / 64.0) / scale);
+}
+
+static PAYLOAD_INLINE double unquantiseField(uint32_t raw, double scale, double offset, uint8_t bits, bool sign) {
+  if(sign) {
+    uint32_t bit = 1ul << (bits - 1);
+    return(offset + (raw & bit ? -1 : 1) * unquantise(raw & (bit - 1), 0, scale));
+  }
+  return(unquantise(raw, offset, scale));
+}
+
+// write the n low bits of value at bit pos of buf, least significant bit first
+static PAYLOAD_INLINE void putBits(uint8_t *buf, size_t pos, uint32_t value, uint8_t n) {
+  while(n) {
+    uint8_t shift = pos % 8;
+    uint8_t take = 8 - shift < n ? 8 - shift : n;
+    uint8_t mask = ((1 << take) - 1) << shift;
+    buf[pos / 8] = (buf[pos / 8] & ~mask) | ((value << shift) & mask);
+    value >>= take;
+    pos += take;
+    n -= take;
+  }
+}
+
+static PAYLOAD_INLINE uint32_t getBits(const uint8_t *buf, size_t pos, uint8_t n) {
+  uint32_t value = 0;
+  for(uint8_t i = 0; i < n;) {
+    uint8_t shift = pos % 8;
+    uint8_t take = 8 - shift < n - i ? 8 - shift : n - i;
+    value |= (uint32_t)((buf[pos / 8] >> shift) & ((1 << take) - 1)) << i;
+    pos += take;
+    i += take;
+  }
+  return(value);
+}
+
+// ============= Layouts =============
+// One encoder and decoder per combination of the optional parts. The rows are
+// expanded inline with constant positions, so there is no table to walk at runtime.
+
+#define PAYLOAD_PRESENT(condition)  (((condition) & LAYOUT) == (condition))
+
+template<uint8_t LAYOUT>
+static constexpr size_t layoutBits() {
+  size_t total = 0;
+#define X(field, scale, offset, bits, sign, condition, lsb, n) \
+  if(PAYLOAD_PRESENT(condition)) total += n;
+  PAYLOAD_FIELDS(X)
+#undef X
+  return(total);
+}
+
+static_assert(layoutBits<0>() % 8 == 0 && layoutBits<PAYLOAD_VOC_NOX>() % 8 == 0 &&
+              layoutBits<PAYLOAD_GNSS>() % 8 == 0, "The optional parts of the payload must be whole bytes");
+static_assert(layoutBits<PAYLOAD_VOC_NOX | PAYLOAD_GNSS>() == PAYLOAD_MAX_SIZE * 8, "PAYLOAD_MAX_SIZE does not match PAYLOAD_FIELDS");
+
+template<uint8_t LAYOUT>
+static size_t encode(const PayloadValues &v, uint8_t *buf) {
+  size_t pos = 0;
+#define X(field, scale, offset, bits, sign, condition, lsb, n) \
+  if constexpr(PAYLOAD_PRESENT(condition)) { \
+    putBits(buf, pos, quantiseField(v.field, scale, offset, bits, sign) >> lsb, n); \
+    pos += n; \
+  }
+  PAYLOAD_FIELDS(X)
+#undef X
+  return(pos / 8);
+}
+
+template<uint8_t LAYOUT>
+static bool decode(const uint8_t *buf, size_t len, PayloadValues &v) {
+  if(len * 8 != layoutBits<LAYOUT>()) {
+    return(false);
+  }
+  // gather the quantised value of each field in its member, where it is exact,
+  uint32_t raw;
+  size_t pos = 0;
+#define X(field, scale, offset, bits, sign, condition, lsb, n) \
+  if constexpr(PAYLOAD_PRESENT(condition)) { \
+    raw = v.field; \
+    v.field = raw | getBits(buf, pos, n) << lsb; \
+    pos += n; \
+  }
+  PAYLOAD_FIELDS(X)
+#undef X
+  // and convert it once all parts are in
+#define X(field, scale, offset, bits, sign, condition, lsb, n) \
+  if constexpr(PAYLOAD_PRESENT(condition) && lsb == 0) { \
+    v.field = unquantiseField((uint32_t)v.field, scale, offset, bits, sign); \
+  }
+  PAYLOAD_FIELDS(X)
+#undef X
+  return(true);
+}
+
+#undef PAYLOAD_PRESENT
+
+uint8_t payloadPort(const PayloadValues &v) {
+  return(1 | (v.flags & (PAYLOAD_MOTION | PAYLOAD_VOC_NOX | PAYLOAD_GNSS)));
+}
+
+size_t payloadEncode(const PayloadValues &v, uint8_t *buf) {
+  switch(v.flags & (PAYLOAD_VOC_NOX | PAYLOAD_GNSS)) {
+    case PAYLOAD_VOC_NOX:                 return(encode<PAYLOAD_VOC_NOX>(v, buf));
+    case PAYLOAD_GNSS:                    return(encode<PAYLOAD_GNSS>(v, buf));
+    case PAYLOAD_VOC_NOX | PAYLOAD_GNSS:  return(encode<PAYLOAD_VOC_NOX | PAYLOAD_GNSS>(v, buf));
+    default:                              return(encode<0>(v, buf));
+  }
+}
+
+bool payloadDecode(uint8_t port, const uint8_t *buf, size_t len, PayloadValues &v) {
+  memset(&v, 0, sizeof(v));
+  v.flags = port & (PAYLOAD_MOTION | PAYLOAD_VOC_NOX | PAYLOAD_GNSS);
+  if(!(port & 1) || port > 15) {
+    return(false);
+  }
+  switch(v.flags & (PAYLOAD_VOC_NOX | PAYLOAD_GNSS)) {
+    case PAYLOAD_VOC_NOX:                 return(decode<PAYLOAD_VOC_NOX>(buf, len, v));
+    case PAYLOAD_GNSS:                    return(decode<PAYLOAD_GNSS>(buf, len, v));
+    case PAYLOAD_VOC_NOX | PAYLOAD_GNSS:  return(decode<PAYLOAD_VOC_NOX | PAYLOAD_GNSS>(buf, len, v));
+    default:                              return(decode<0>(buf, len, v));
+  }
+}
+
+// ============= Batches =============
+// A batch is encoded once per many measurements, so here the rows are walked at runtime.
+
+struct PayloadRow {
+  const char *field;
+  uint8_t bits;
+  bool sign;
+  uint8_t condition, lsb, n;
+};
+
+static constexpr PayloadRow rows[] = {
+#define X(field, scale, offset, bits, sign, condition, lsb, n) { #field, bits, sign, condition, lsb, n },
+  PAYLOAD_FIELDS(X)
+#undef X
+};
+
+#define PAYLOAD_ROWS  (sizeof(rows) / sizeof(rows[0]))
+
+static constexpr size_t batchRecordBits() {
+  size_t total = 2 + 16;              // time
+  for(size_t i = 0; i < PAYLOAD_ROWS; i++) {
+    total += rows[i].lsb == 0 ? 2 + rows[i].bits : 0;
+  }
+  return(total);
+}
+
+static_assert(batchRecordBits() <= PAYLOAD_BATCH_RECORD * 8, "PAYLOAD_BATCH_RECORD is too small for PAYLOAD_FIELDS");
+
+static bool present(size_t i, uint8_t port) {
+  return((rows[i].condition & port) == rows[i].condition);
+}
+
+// the row of the first part of the field of row i, which holds its quantised value
+static size_t fieldRow(size_t i) {
+  size_t j = 0;
+  while(strcmp(rows[j].field, rows[i].field)) {
+    j++;
+  }
+  return(j);
+}
+
+static size_t frameSize(uint8_t port) {
+  size_t bits = 0;
+  for(size_t i = 0; i < PAYLOAD_ROWS; i++) {
+    bits += present(i, port) ? rows[i].n : 0;
+  }
+  return(bits / 8);
+}
+
+// the quantised values of a single uplink, by fieldRow()
+static void getFields(uint8_t port, const uint8_t *frame, uint32_t *raw) {
+  memset(raw, 0, PAYLOAD_ROWS * sizeof(uint32_t));
+  size_t pos = 0;
+  for(size_t i = 0; i < PAYLOAD_ROWS; i++) {
+    if(present(i, port)) {
+      raw[fieldRow(i)] |= getBits(frame, pos, rows[i].n) << rows[i].lsb;
+      pos += rows[i].n;
+    }
+  }
+}
+
+static void putFields(uint8_t port, const uint32_t *raw, uint8_t *frame) {
+  size_t pos = 0;
+  for(size_t i = 0; i < PAYLOAD_ROWS; i++) {
+    if(present(i, port)) {
+      putBits(frame, pos, raw[fieldRow(i)] >> rows[i].lsb, rows[i].n);
+      pos += rows[i].n;
+    }
+  }
+}
+
+static int64_t toSigned(size_t i, uint32_t raw) {
+  uint32_t bit = 1ul << (rows[i].bits - 1);
+  if(rows[i].sign && (raw & bit)) {
+    return(-(int64_t)(raw & (bit - 1)));
+  }
+  return(raw);
+}
+
+static uint32_t fromSigned(size_t i, int64_t value) {
+  if(rows[i].sign && value < 0) {
+    return((uint32_t)-value | (1ul << (rows[i].bits - 1)));
+  }
+  return((uint32_t)value);
+}
+
+static uint64_t zigzag(int64_t d) {
+  return(d < 0 ? ((uint64_t)-d << 1) - 1 : (uint64_t)d << 1);
+}
+
+static int64_t unzigzag(uint64_t z) {
+  return(z & 1 ? -(int64_t)(z >> 1) - 1 : (int64_t)(z >> 1));
+}
+
+// difference d as its class and value, or else raw, the value itself
+static size_t putDelta(uint8_t *buf, size_t pos, int64_t d, uint32_t raw, uint8_t bits) {
+  uint64_t z = zigzag(d);
+  uint8_t cls = d == 0 ? 0 : z < (1ull << (bits / 4)) ? 1 : z < (1ull << (bits / 2)) ? 2 : 3;
+  uint8_t width[] = { 0, (uint8_t)(bits / 4), (uint8_t)(bits / 2), bits };
+  putBits(buf, pos, cls, 2);
+  putBits(buf, pos + 2, cls == 3 ? raw : z, width[cls]);
+  return(pos + 2 + width[cls]);
+}
+
+static bool getDelta(const uint8_t *buf, size_t len, size_t &pos, uint8_t bits, uint8_t &cls, uint32_t &value) {
+  if(pos + 2 > len * 8) {
+    return(false);
+  }
+  cls = getBits(buf, pos, 2);
+  uint8_t width[] = { 0, (uint8_t)(bits / 4), (uint8_t)(bits / 2), bits };
+  if(pos + 2 + width[cls] > len * 8) {
+    return(false);
+  }
+  value = getBits(buf, pos + 2, width[cls]);
+  pos += 2 + width[cls];
+  return(true);
+}
+
+static size_t encodeBatch(uint8_t port, const uint8_t frames[][PAYLOAD_MAX_SIZE], const uint32_t *times,
+                          uint8_t count, uint32_t now, uint8_t *buf) {
+  size_t size = frameSize(port);
+  int64_t span = times[count - 1] > times[0] ? times[count - 1] - times[0] : 0;
+  uint16_t spacing = count > 1 ? min((span + (count - 1) / 2) / (count - 1), (int64_t)UINT16_MAX) : 0;
+  uint32_t age = now > times[count - 1] ? min(now - times[count - 1], (uint32_t)0xFFFFFF) : 0;
+  buf[0] = count;
+  putBits(buf, 8, spacing, 16);
+  putBits(buf, 24, age, 24);
+  memcpy(&buf[PAYLOAD_BATCH_HEADER], frames[0], size);
+
+  uint32_t first[PAYLOAD_ROWS], raw[PAYLOAD_ROWS];
+  getFields(port, frames[0], first);
+  size_t pos = (PAYLOAD_BATCH_HEADER + size) * 8;
+  for(uint8_t r = 1; r < count; r++) {
+    int64_t dt = (int64_t)times[r] - times[0] - (int64_t)r * spacing;
+    dt = max(min(dt, (int64_t)INT16_MAX), (int64_t)INT16_MIN);
+    pos = putDelta(buf, pos, dt, zigzag(dt), 16);
+
+    getFields(port, frames[r], raw);
+    for(size_t i = 0; i < PAYLOAD_ROWS; i++) {
+      if(present(i, port) && rows[i].lsb == 0) {
+        pos = putDelta(buf, pos, toSigned(i, raw[i]) - toSigned(i, first[i]), raw[i], rows[i].bits);
+      }
+    }
+  }
+  if(pos % 8) {
+    putBits(buf, pos, 0, 8 - pos % 8);
+  }
+  return((pos + 7) / 8);
+}
+
+size_t payloadBatch(uint8_t port, const uint8_t frames[][PAYLOAD_MAX_SIZE], const uint32_t *times,
+                    uint8_t count, uint32_t now, uint8_t *buf, size_t maxLen, uint8_t &used) {
+  port &= ~PAYLOAD_BATCH;
+  uint8_t scratch[PAYLOAD_BATCH_HEADER + PAYLOAD_MAX_SIZE + (PAYLOAD_BATCH_MAX - 1) * PAYLOAD_BATCH_RECORD];
+  // the spacing and age depend on the last record, so drop records until the rest fits
+  for(used = min(count, (uint8_t)PAYLOAD_BATCH_MAX); used > 0; used--) {
+    size_t len = encodeBatch(port, frames, times, used, now, scratch);
+    if(len <= maxLen || used == 1) {
+      memcpy(buf, scratch, len);
+      return(len);
+    }
+  }
+  return(0);
+}
+
+uint8_t payloadUnbatch(uint8_t port, const uint8_t *buf, size_t len, uint8_t frames[][PAYLOAD_MAX_SIZE],
+                       uint32_t *ages) {
+  port &= ~PAYLOAD_BATCH;
+  size_t size = frameSize(port);
+  if(port > 15 || len < PAYLOAD_BATCH_HEADER + size || buf[0] < 1 || buf[0] > PAYLOAD_BATCH_MAX) {
+    return(0);
+  }
+  uint8_t count = buf[0];
+  uint16_t spacing = getBits(buf, 8, 16);
+  uint32_t age = getBits(buf, 24, 24);
+  memcpy(frames[0], &buf[PAYLOAD_BATCH_HEADER], size);
+
+  int64_t offsets[PAYLOAD_BATCH_MAX] = { 0 };
+  uint32_t first[PAYLOAD_ROWS], raw[PAYLOAD_ROWS];
+  getFields(port, frames[0], first);
+  size_t pos = (PAYLOAD_BATCH_HEADER + size) * 8;
+  uint8_t cls;
+  uint32_t value;
+  for(uint8_t r = 1; r < count; r++) {
+    if(!getDelta(buf, len, pos, 16, cls, value)) {
+      return(0);
+    }
+    offsets[r] = (int64_t)r * spacing + unzigzag(value);
+
+    memcpy(raw, first, sizeof(raw));
+    for(size_t i = 0; i < PAYLOAD_ROWS; i++) {
+      if(present(i, port) && rows[i].lsb == 0) {
+        if(!getDelta(buf, len, pos, rows[i].bits, cls, value)) {
+          return(0);
+        }
+        raw[i] = cls == 3 ? value : fromSigned(i, toSigned(i, first[i]) + unzigzag(value));
+      }
+    }
+    putFields(port, raw, frames[r]);
+  }
+  if(len * 8 - pos >= 8) {
+    return(0);                          // more than padding left
+  }
+  for(uint8_t r = 0; r < count; r++) {
+    ages[r] = age + max(offsets[count - 1] - offsets[r], (int64_t)0);
+  }
+  return(count);
+}
+
+bool payloadDecodeHex(uint8_t port, const char *hex, PayloadValues &v) {
+  size_t len = strlen(hex);
+  if(len % 2 || len > PAYLOAD_MAX_SIZE * 2 || !isHexString(hex)) {
+    return(false);
+  }
+  uint8_t buf[PAYLOAD_MAX_SIZE];
+  hexStringToByteArray(hex, buf, len);
+  return(payloadDecode(port, buf, len / 2, v));
+}
+
+size_t payloadHeader(char *buf, size_t len) {
+  return(snprintf(buf, len, "motion,batt,temp,humi,pres,lumi,uva,dbMin,dbAvg,dbMax,co2,pm2_5,pm10,"
+                            "voc,nox,lat,lon,alt,hdop,sats\r\n"));
+}
+
+size_t payloadFormat(const PayloadValues &v, PayloadFormat format, char *buf, size_t len) {
+  bool vocNox = v.flags & PAYLOAD_VOC_NOX;
+  bool gnss = v.flags & PAYLOAD_GNSS;
+  size_t n;
+  if(format == PAYLOAD_CSV) {
+    n = snprintf(buf, len, "%d,%u,%.2f,%.1f,%.1f,%.0f,%.0f,%.2f,%.2f,%.2f,%.0f,%.1f,%.1f,",
+                 (v.flags & PAYLOAD_MOTION) != 0, v.batt, v.temp, v.humi, v.pres, v.lumi, v.uva,
+                 v.dbMin, v.dbAvg, v.dbMax, v.co2, v.pm2_5, v.pm10);
+    n += vocNox ? snprintf(&buf[min(n, len)], len - min(n, len), "%.1f,%.1f,", v.voc, v.nox)
+                : snprintf(&buf[min(n, len)], len - min(n, len), ",,");
+    n += gnss ? snprintf(&buf[min(n, len)], len - min(n, len), "%.7f,%.7f,%.1f,%.1f,%u\r\n",
+                         v.lat, v.lon, v.alt, v.hdop, v.sats)
+              : snprintf(&buf[min(n, len)], len - min(n, len), ",,,,\r\n");
+  } else {
+    n = snprintf(buf, len, "{\"motion\":%s,\"batt\":%u,\"temp\":%.2f,\"humi\":%.1f,\"pres\":%.1f,\"lumi\":%.0f,"
+                 "\"uva\":%.0f,\"dbMin\":%.2f,\"dbAvg\":%.2f,\"dbMax\":%.2f,\"co2\":%.0f,\"pm2_5\":%.1f,\"pm10\":%.1f",
+                 v.flags & PAYLOAD_MOTION ? "true" : "false", v.batt, v.temp, v.humi, v.pres, v.lumi,
+                 v.uva, v.dbMin, v.dbAvg, v.dbMax, v.co2, v.pm2_5, v.pm10);
+    if(vocNox) {
+      n += snprintf(&buf[min(n, len)], len - min(n, len), ",\"voc\":%.1f,\"nox\":%.1f", v.voc, v.nox);
+    }
+    if(gnss) {
+      n += snprintf(&buf[min(n, len)], len - min(n, len), ",\"lat\":%.7f,\"lon\":%.7f,\"alt\":%.1f,\"hdop\":%.1f,\"sats\":%u",
+                    v.lat, v.lon, v.alt, v.hdop, v.sats);
+    }
+    n += snprintf(&buf[min(n, len)], len - min(n, len), "}");
+  }
+  return(min(n, len - 1));
+}
@@ -0,0 +1,112 @@
+#ifndef _PAYLOAD_H
+#define _PAYLOAD_H
+
+#include <Arduino.h>
+
+// The LoRaWAN uplink payload, declared once in PAYLOAD_FIELDS. An uplink is sent on
+// fPort 1, with bits set for the optional parts. Each row writes the next n bits of the
+// payload, least significant bit first, with bits [lsb, lsb + n) of a value that is
+// quantised as (value - offset) * scale, truncated and clamped to its bit width;
+// signed values are sign-magnitude, with the sign in the top bit. A row is only
+// present when the fPort has all bits of its condition set. A value that is split
+// over several rows (PM) is given the same scale, offset and width in each of them.
+//
+// The encoder and decoder are generated from this table at compile time, and
+// scripts/payload_decoder.py generates the JavaScript decoder for the network server
+// from it at build time. Decoding gives each value to within one step.
+
+#define PAYLOAD_MOTION    0x02        // fPort bits
+#define PAYLOAD_VOC_NOX   0x04        // FAST interval
+#define PAYLOAD_GNSS      0x08
+#define PAYLOAD_BATCH     0x10
+#define PAYLOAD_MAX_SIZE  34
+
+//  X(field,  scale, offset, bits, signed, condition,       lsb,  n)
+#define PAYLOAD_FIELDS(X) \
+  X(batt,     0.1,   2500,   8,    false,  0,                0,   8)   /* mV */ \
+  X(temp,     100,   0,      16,   true,   0,                0,  16)   /* SCD41 degC */ \
+  X(humi,     2,     0,      8,    false,  0,                0,   8)   /* %RH, at the SCD41 temperature */ \
+  X(pres,     10,    0,      16,   false,  0,                0,  16)   /* hPa */ \
+  X(lumi,     1,     0,      16,   false,  0,                0,  16)   /* lux */ \
+  X(uva,      1,     0,      16,   false,  0,                0,  16)   /* uW/cm2 */ \
+  X(dbMin,    4,     32,     8,    false,  0,                0,   8)   /* dB(A) */ \
+  X(dbAvg,    4,     32,     8,    false,  0,                0,   8) \
+  X(dbMax,    4,     32,     8,    false,  0,                0,   8) \
+  X(co2,      1,     0,      16,   false,  0,                0,  16)   /* ppm */ \
+  X(pm2_5,    10,    0,      12,   false,  0,                0,   8)   /* ug/m3 */ \
+  X(pm10,     10,    0,      12,   false,  0,                0,   8) \
+  X(pm10,     10,    0,      12,   false,  0,                8,   4) \
+  X(pm2_5,    10,    0,      12,   false,  0,                8,   4) \
+  X(voc,      10,    0,      16,   false,  PAYLOAD_VOC_NOX,  0,  16)   /* index */ \
+  X(nox,      10,    0,      16,   false,  PAYLOAD_VOC_NOX,  0,  16) \
+  X(lat,      1e7,   0,      32,   true,   PAYLOAD_GNSS,     0,  32)   /* deg */ \
+  X(lon,      1e7,   0,      32,   true,   PAYLOAD_GNSS,     0,  32) \
+  X(alt,      10,    0,      16,   true,   PAYLOAD_GNSS,     0,  16)   /* m */ \
+  X(hdop,     10,    0,      8,    false,  PAYLOAD_GNSS,     0,   8) \
+  X(sats,     1,     0,      8,    false,  PAYLOAD_GNSS,     0,   8)
+
+// A batched uplink carries one or more measurements of the same layout, on the fPort of
+// that layout with PAYLOAD_BATCH set; PAYLOAD_MOTION is set if any of them had motion.
+//
+//   byte 0      number of records
+//   byte 1- 2   spacing: seconds from the first to the last record / (number - 1)
+//   byte 3- 5   age: seconds from the last record to the uplink
+//   byte 6-     the first record, as a single uplink
+//   then, least significant bit first, for every further record its time as the seconds
+//   from first + i * spacing (16 bits, signed), and the quantised value of each field
+//   as the difference with that of the first record. Each is a 2-bit class and a value:
+//     0   the same, no value
+//     1   zigzag difference in bits / 4 bits (16 / 4 for the time)
+//     2   zigzag difference in bits / 2 bits
+//     3   the quantised value itself; for the time, the zigzag difference in 16 bits
+//
+// A single uplink is measured just before it is sent; a measurement that was held back
+// goes in a batch, even on its own, so that its time can be told from the uplink.
+
+#define PAYLOAD_BATCH_MAX     16      // records in a batch
+#define PAYLOAD_BATCH_HEADER  6       // bytes before the first record
+#define PAYLOAD_BATCH_RECORD  42      // bytes that a further record takes at most
+
+struct PayloadValues {
+  uint8_t  flags;                     // PAYLOAD_*
+  uint16_t batt;                      // mV
+  float    temp, humi, pres;          // degC, %RH, hPa
+  float    lumi, uva;                 // lux, uW/cm2
+  float    dbMin, dbAvg, dbMax;       // dB(A)
+  float    co2;                       // ppm
+  float    pm2_5, pm10;               // ug/m3
+  float    voc, nox;                  // index
+  double   lat, lon;                  // deg
+  float    alt, hdop;                 // m
+  uint8_t  sats;
+};
+
+enum PayloadFormat {
+  PAYLOAD_CSV,
+  PAYLOAD_JSON
+};
+
+// the fPort and the bytes of an uplink; returns the length
+uint8_t payloadPort(const PayloadValues &v);
+size_t payloadEncode(const PayloadValues &v, uint8_t *buf);
+
+// the values of an uplink, false if its length does not match the fPort
+bool payloadDecode(uint8_t port, const uint8_t *buf, size_t len, PayloadValues &v);
+bool payloadDecodeHex(uint8_t port, const char *hex, PayloadValues &v);
+
+// Combine count single uplinks on the same fPort, measured at times (s), into a batched
+// uplink sent at now, of at most maxLen bytes. Returns its length, and in used how many of
+// the frames, from the first, it holds; that is at least one, even if it does not fit.
+size_t payloadBatch(uint8_t port, const uint8_t frames[][PAYLOAD_MAX_SIZE], const uint32_t *times,
+                    uint8_t count, uint32_t now, uint8_t *buf, size_t maxLen, uint8_t &used);
+
+// Split a batched uplink into its single uplinks, on fPort port & ~PAYLOAD_BATCH, and the
+// seconds each was measured before the uplink. Returns their number, 0 if it is invalid.
+uint8_t payloadUnbatch(uint8_t port, const uint8_t *buf, size_t len, uint8_t frames[][PAYLOAD_MAX_SIZE],
+                       uint32_t *ages);
+
+// decoded values as a line of CSV (see payloadHeader() for the columns) or a JSON object
+size_t payloadHeader(char *buf, size_t len);
+size_t payloadFormat(const PayloadValues &v, PayloadFormat format, char *buf, size_t len);
+
+#endif
@@ -0,0 +1,375 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <time.h>
+#include "config.h"
+#include "datalog.h"
+#include "publish.h"
+
+// The position of the last record that the endpoint acknowledged: its day and the number
+// of records of that day up to and including it, in the order of the day file. Times are
+// not unique, and may go back when the clock is set.
+RTC_DATA_ATTR uint16_t publishedDay = 0;           // 0 if nothing was published yet
+RTC_DATA_ATTR uint32_t publishedCount = 0;
+RTC_DATA_ATTR uint32_t publishedTime = 0;          // identify that record
+RTC_DATA_ATTR uint16_t publishedCrc = 0;
+
+// ============= Endpoint =============
+
+bool publishParseEndpoint(const char *url, PublishEndpoint &ep) {
+  memset(&ep, 0, sizeof(ep));
+  if(!strncmp(url, "http://", 7)) {
+    ep.port = 80;
+  } else if(!strncmp(url, "mqtt://", 7)) {
+    ep.mqtt = true;
+    ep.port = 1883;
+  } else {
+    return(false);
+  }
+  url += 7;
+
+  const char *slash = strchr(url, '/');
+  const char *end = slash ? slash : url + strlen(url);
+  const char *at = (const char *)memchr(url, '@', end - url);
+  if(at) {
+    const char *colon = (const char *)memchr(url, ':', at - url);
+    const char *userEnd = colon ? colon : at;
+    if(userEnd - url >= (int)sizeof(ep.user) || (colon && at - colon > (int)sizeof(ep.pass))) {
+      return(false);
+    }
+    if(colon && userEnd == url) {
+      return(false);                  // MQTT does not allow a password without a user name
+    }
+    snprintf(ep.user, sizeof(ep.user), "%.*s", (int)(userEnd - url), url);
+    if(colon) {
+      snprintf(ep.pass, sizeof(ep.pass), "%.*s", (int)(at - colon - 1), colon + 1);
+    }
+    url = at + 1;
+  }
+
+  const char *colon = (const char *)memchr(url, ':', end - url);
+  const char *hostEnd = colon ? colon : end;
+  if(hostEnd == url || hostEnd - url >= (int)sizeof(ep.host)) {
+    return(false);
+  }
+  snprintf(ep.host, sizeof(ep.host), "%.*s", (int)(hostEnd - url), url);
+  if(colon) {
+    ep.port = atoi(colon + 1);
+    if(ep.port == 0) {
+      return(false);
+    }
+  }
+
+  // an HTTP path keeps its leading slash, an MQTT topic does not have one
+  const char *path = slash ? slash + ep.mqtt : (ep.mqtt ? "" : "/");
+  if(strlen(path) >= sizeof(ep.path)) {
+    return(false);
+  }
+  strlcpy(ep.path, path, sizeof(ep.path));
+  return(ep.path[0] != '\0');
+}
+
+// ============= Connection =============
+
+static int readByte(WiFiClient &client, uint32_t deadline) {
+  while(!client.available()) {
+    if(!client.connected() || (int32_t)(millis() - deadline) >= 0) {
+      return(-1);
+    }
+    delay(1);
+  }
+  return(client.read());
+}
+
+// a line without its CR LF, truncated to the buffer
+static bool readLine(WiFiClient &client, char *buf, size_t len, uint32_t deadline) {
+  size_t n = 0;
+  for(int c; (c = readByte(client, deadline)) >= 0; ) {
+    if(c == '\n') {
+      if(n && buf[n - 1] == '\r') {
+        n--;
+      }
+      buf[n] = '\0';
+      return(true);
+    }
+    if(n < len - 1) {
+      buf[n++] = c;
+    }
+  }
+  return(false);
+}
+
+static bool writeAll(WiFiClient &client, const void *buf, size_t len) {
+  return(client.write((const uint8_t *)buf, len) == len);
+}
+
+// POST a batch; keepAlive is cleared when the server will close the connection
+static bool httpPost(WiFiClient &client, const PublishEndpoint &ep, const char *body, size_t len, bool &keepAlive) {
+  char head[256];
+  int n = snprintf(head, sizeof(head),
+                   "POST %s HTTP/1.1\r\nHost: %s:%u\r\nContent-Type: application/json\r\n"
+                   "Content-Length: %u\r\nConnection: keep-alive\r\n\r\n",
+                   ep.path, ep.host, ep.port, (unsigned)len);
+  if(n >= (int)sizeof(head) || !writeAll(client, head, n) || !writeAll(client, body, len)) {
+    return(false);
+  }
+
+  uint32_t deadline = millis() + PUBLISH_TIMEOUT;
+  char line[128];
+  int status = 0;
+  if(!readLine(client, line, sizeof(line), deadline) || sscanf(line, "HTTP/%*d.%*d %d", &status) != 1) {
+    return(false);
+  }
+  keepAlive = strncmp(line, "HTTP/1.0", 8) != 0;
+
+  // headers are case-insensitive; only the length of the body is needed to skip it
+  long length = 0;
+  while(true) {
+    if(!readLine(client, line, sizeof(line), deadline)) {
+      return(false);
+    }
+    if(line[0] == '\0') {
+      break;
+    }
+    for(char *c = line; *c; c++) {
+      *c = tolower(*c);
+    }
+    if(!strncmp(line, "content-length:", 15)) {
+      length = atol(&line[15]);
+    } else if(!strncmp(line, "connection:", 11) && strstr(&line[11], "close")) {
+      keepAlive = false;
+    } else if(!strncmp(line, "transfer-encoding:", 18)) {
+      keepAlive = false;    // the body is not parsed, so the connection cannot be reused
+    }
+  }
+  while(length-- > 0 && readByte(client, deadline) >= 0);
+
+  if(status < 200 || status >= 300) {
+    Serial.printf("[Publish] HTTP status %d\r\n", status);
+    return(false);
+  }
+  return(true);
+}
+
+static size_t mqttLength(uint8_t *buf, size_t len) {
+  size_t n = 0;
+  do {
+    buf[n] = len & 0x7F;
+    len >>= 7;
+    buf[n++] |= len ? 0x80 : 0;
+  } while(len);
+  return(n);
+}
+
+static size_t mqttString(uint8_t *buf, const char *str) {
+  size_t len = strlen(str);
+  buf[0] = len >> 8;
+  buf[1] = len & 0xFF;
+  memcpy(&buf[2], str, len);
+  return(len + 2);
+}
+
+// the type of the next packet, of which up to len bytes are copied into buf
+static int mqttRead(WiFiClient &client, uint8_t *buf, size_t len, uint32_t deadline) {
+  int type = readByte(client, deadline);
+  if(type < 0) {
+    return(-1);
+  }
+  size_t remaining = 0;
+  for(int shift = 0, c = 0x80; c & 0x80; shift += 7) {
+    if(shift > 21 || (c = readByte(client, deadline)) < 0) {
+      return(-1);
+    }
+    remaining |= (size_t)(c & 0x7F) << shift;
+  }
+  for(size_t i = 0; i < remaining; i++) {
+    int c = readByte(client, deadline);
+    if(c < 0) {
+      return(-1);
+    }
+    if(i < len) {
+      buf[i] = c;
+    }
+  }
+  return(type);
+}
+
+static bool mqttConnect(WiFiClient &client, const PublishEndpoint &ep) {
+  char id[24];
+  snprintf(id, sizeof(id), "mjlo-%08X%08X", (uint32_t)(cfg.actvn.otaa.devEUI >> 32), (uint32_t)cfg.actvn.otaa.devEUI);
+
+  uint8_t pkt[128];
+  size_t n = 2;
+  n += mqttString(&pkt[n], "MQTT");
+  pkt[n++] = 4;                                     // protocol level 3.1.1
+  pkt[n++] = 0x02 | (ep.user[0] ? 0x80 : 0) | (ep.pass[0] ? 0x40 : 0);   // clean session
+  pkt[n++] = 0;
+  pkt[n++] = 60;                                    // keep-alive in s
+  n += mqttString(&pkt[n], id);
+  if(ep.user[0]) {
+    n += mqttString(&pkt[n], ep.user);
+  }
+  if(ep.pass[0]) {
+    n += mqttString(&pkt[n], ep.pass);
+  }
+  pkt[0] = 0x10;
+  pkt[1] = n - 2;
+  if(!writeAll(client, pkt, n)) {
+    return(false);
+  }
+
+  uint8_t ack[2];
+  if(mqttRead(client, ack, sizeof(ack), millis() + PUBLISH_TIMEOUT) != 0x20 || ack[1] != 0) {
+    Serial.printf("[Publish] MQTT connection refused\r\n");
+    return(false);
+  }
+  return(true);
+}
+
+// publish a batch with QoS 1, which the broker acknowledges once it has taken it over
+static bool mqttPublish(WiFiClient &client, const PublishEndpoint &ep, const char *body, size_t len, uint16_t id) {
+  uint8_t head[8 + sizeof(ep.path)];
+  size_t topicLen = strlen(ep.path);
+  size_t n = 1;
+  head[0] = 0x32;
+  n += mqttLength(&head[n], 2 + topicLen + 2 + len);
+  n += mqttString(&head[n], ep.path);
+  head[n++] = id >> 8;
+  head[n++] = id & 0xFF;
+  if(!writeAll(client, head, n) || !writeAll(client, body, len)) {
+    return(false);
+  }
+
+  uint32_t deadline = millis() + PUBLISH_TIMEOUT;
+  uint8_t ack[2];
+  int type;
+  while((type = mqttRead(client, ack, sizeof(ack), deadline)) >= 0) {
+    if((type & 0xF0) == 0x40 && (ack[0] << 8 | ack[1]) == id) {
+      return(true);
+    }
+  }
+  return(false);
+}
+
+static bool publishConnect(WiFiClient &client, const PublishEndpoint &ep) {
+  if(!client.connect(ep.host, ep.port, PUBLISH_TIMEOUT)) {
+    Serial.printf("[Publish] Cannot connect to %s:%u\r\n", ep.host, ep.port);
+    return(false);
+  }
+  client.setNoDelay(true);
+  return(!ep.mqtt || mqttConnect(client, ep));
+}
+
+// ============= Publishing =============
+
+bool publishPending() {
+  LogRecord rec;
+  return(cfg.wl2g4.publish[0] && logLatest(rec) && (rec.time != publishedTime || rec.crc != publishedCrc));
+}
+
+int32_t publishRecords() {
+  PublishEndpoint ep;
+  if(!publishParseEndpoint(cfg.wl2g4.publish, ep)) {
+    return(-1);
+  }
+  char *body = (char *)malloc(PUBLISH_BUFFER);
+  if(!body) {
+    return(-1);
+  }
+
+  uint32_t started = millis();
+  uint32_t now = time(NULL);
+  uint32_t since = 0;                 // records before this time are not sent
+  LogRecord rec;
+  if(!publishedDay) {
+    since = now > PUBLISH_BACKLOG ? now - PUBLISH_BACKLOG : 1;
+  } else if(logLatest(rec) && rec.time / 86400 < publishedDay) {
+    // the clock was set back to an earlier day: send that day again rather than nothing
+    publishedDay = rec.time / 86400;
+    publishedCount = 0;
+  }
+
+  // the query starts at the beginning of a day, so that the records can be counted
+  LogQuery query(publishedDay ? publishedDay * 86400 : since - since % 86400, UINT32_MAX);
+  LogHeader header;
+  uint16_t day = 0;
+  uint32_t count = 0;                 // records of day up to and including rec
+  auto advance = [&]() -> bool {
+    while(query.next(rec)) {
+      count = rec.time / 86400 == day ? count + 1 : 1;
+      day = rec.time / 86400;
+      if(rec.time >= since && (day != publishedDay || count > publishedCount)) {
+        return(true);
+      }
+    }
+    return(false);
+  };
+  bool more = query.begin(header) && advance();
+
+  size_t prefix = snprintf(body, PUBLISH_BUFFER, "{\"devEUI\":\"%08X%08X\",\"firmware\":\"%s\",\"records\":[",
+                           (uint32_t)(cfg.actvn.otaa.devEUI >> 32), (uint32_t)cfg.actvn.otaa.devEUI, MJLO_VERSION);
+  WiFiClient client;
+  bool keepAlive = false;
+  bool failed = false;
+  uint16_t packetId = 0;
+  int32_t sent = 0;
+  uint32_t requests = 0;
+
+  while(more) {
+    // as many records as fit into one request
+    size_t n = prefix;
+    uint32_t records = 0;
+    uint16_t lastDay = 0;
+    uint32_t lastCount = 0;
+    LogRecord last;
+    while(more) {
+      char json[512];
+      size_t len = logFormat(rec, LOG_JSON, json, sizeof(json));
+      if(records && n + 1 + len + 2 >= PUBLISH_BUFFER) {
+        break;                        // the first of the next batch
+      }
+      if(records) {
+        body[n++] = ',';
+      }
+      memcpy(&body[n], json, len);
+      n += len;
+      records++;
+      lastDay = day;
+      lastCount = count;
+      last = rec;
+      more = advance();
+    }
+    n += snprintf(&body[n], PUBLISH_BUFFER - n, "]}");
+
+    if(!keepAlive) {
+      client.stop();
+      keepAlive = publishConnect(client, ep);
+      if(!keepAlive) {
+        failed = true;
+        break;
+      }
+    }
+    packetId = packetId % 0xFFFF + 1;   // MQTT packet identifiers are non-zero
+    bool ok = ep.mqtt ? mqttPublish(client, ep, body, n, packetId) : httpPost(client, ep, body, n, keepAlive);
+    if(!ok) {
+      failed = true;
+      break;
+    }
+    publishedDay = lastDay;
+    publishedCount = lastCount;
+    publishedTime = last.time;
+    publishedCrc = last.crc;
+    sent += records;
+    requests++;
+  }
+
+  if(client.connected() && ep.mqtt) {
+    const uint8_t disconnect[2] = { 0xE0, 0x00 };
+    writeAll(client, disconnect, sizeof(disconnect));
+  }
+  client.stop();
+  free(body);
+
+  Serial.printf("[Publish] %d records in %u requests to %s in %u ms%s\r\n", (int)sent, (unsigned)requests,
+                ep.host, (unsigned)(millis() - started), failed ? ", failed" : "");
+  return(failed && !sent ? -1 : sent);
+}
@@ -0,0 +1,39 @@
+#ifndef _PUBLISH_H
+#define _PUBLISH_H
+
+#include <Arduino.h>
+
+// Publishing of the logged measurements over WiFi, next to the LoRaWAN uplinks. The
+// endpoint is the "publish" setting:
+//   http://host[:port]/path            each batch is POSTed to path
+//   mqtt://[user:pass@]host[:port]/topic   each batch is published to topic with QoS 1
+// Records are read back from the day logs, starting after the last record that the
+// endpoint acknowledged (by its position in its day file, see publish.cpp), so that
+// nothing is lost while there is no network. Batches
+// are sent over one connection (HTTP keep-alive, or one MQTT session) in the format
+// of the JSON export: {"devEUI":..,"firmware":..,"records":[..]}.
+
+#define PUBLISH_BUFFER    4096        // bytes in one request
+#define PUBLISH_BACKLOG   86400       // s of records sent when nothing was published yet
+#define PUBLISH_TIMEOUT   5000        // ms to wait for the endpoint
+
+struct PublishEndpoint {
+  bool     mqtt;
+  char     host[64];
+  uint16_t port;
+  char     path[64];                  // HTTP path or MQTT topic
+  char     user[32];                  // MQTT only
+  char     pass[32];
+};
+
+// split the "publish" setting, false if it is not a valid endpoint
+bool publishParseEndpoint(const char *url, PublishEndpoint &ep);
+
+// whether there are records that the endpoint has not acknowledged yet
+bool publishPending();
+
+// Send all pending records; WiFi must be connected. Returns the number of records
+// acknowledged, or -1 if the endpoint is not configured or could not be reached.
+int32_t publishRecords();
+
+#endif
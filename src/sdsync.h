@@ -0,0 +1,262 @@
+#ifndef _SDSYNC_H
+#define _SDSYNC_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <SD.h>
+#include <vector>
+#include "pins.h"
+#include "lorawan.h"
+
+// Incremental copy of the filesystem to the SD card. A manifest on the card records
+// per file the size of the source and how many bytes of it are on the card, so that
+// only new files and the appended tail of a day file are copied. A file that shrank,
+// or of which the copy on the card does not have the expected size (e.g. the copy
+// was interrupted, or the file was edited on a PC), is copied again as a whole.
+//
+// The copy runs in a low-priority task, so that it does not delay the measurements.
+// It shares spiSX with the radio and hands over the bus after every SD_SYNC_WRITE
+// bytes. Before deep sleep, the task is stopped with its progress in the manifest;
+// the next wake with the card inserted continues where it left off.
+
+#define SD_SPI_HZ       20000000
+#define SD_SYNC_BUF     (16 * 1024)     // a multiple of the sector size
+#define SD_SYNC_WRITE   4096            // bytes written per turn on the bus, about 2 ms
+#define SD_SECTOR       512
+#define SD_MANIFEST     "/manifest.txt"
+
+struct SyncEntry {
+  String path;                          // relative to the root of the filesystem
+  uint32_t size;                        // size of the source at the last sync
+  uint32_t synced;                      // bytes of the source that are on the card
+  bool seen;
+};
+
+volatile bool sdSyncStop = false;
+volatile bool sdSyncRunning = false;
+static String sdSyncDst;
+
+struct SyncStats {
+  uint32_t files;
+  uint32_t bytes;
+  bool failed;
+  bool dirty;                           // the manifest changed
+};
+
+// one line per file: <path>\t<size>\t<synced>
+static void syncLoadManifest(const String &dst, std::vector<SyncEntry> &entries) {
+  File file = SD.open(dst + SD_MANIFEST, FILE_READ);
+  if(!file) {
+    return;
+  }
+  while(file.available()) {
+    String line = file.readStringUntil('\n');
+    int tab1 = line.indexOf('\t');
+    int tab2 = line.indexOf('\t', tab1 + 1);
+    if(tab1 <= 0 || tab2 <= tab1) {
+      continue;
+    }
+    entries.push_back({ line.substring(0, tab1), (uint32_t)line.substring(tab1 + 1, tab2).toInt(),
+                        (uint32_t)line.substring(tab2 + 1).toInt(), false });
+  }
+  file.close();
+}
+
+// files that no longer exist in flash (i.e. evicted days) are dropped from the manifest
+static bool syncSaveManifest(const String &dst, std::vector<SyncEntry> &entries) {
+  File file = SD.open(dst + SD_MANIFEST, FILE_WRITE);
+  if(!file) {
+    return(false);
+  }
+  for(auto &entry : entries) {
+    if(entry.seen) {
+      file.printf("%s\t%u\t%u\n", entry.path.c_str(), (unsigned)entry.size, (unsigned)entry.synced);
+    }
+  }
+  file.close();
+  return(true);
+}
+
+static SyncEntry &syncEntry(std::vector<SyncEntry> &entries, const String &path, SyncStats &stats) {
+  for(auto &entry : entries) {
+    if(entry.path == path) {
+      entry.seen = true;
+      return(entry);
+    }
+  }
+  stats.dirty = true;
+  entries.push_back({ path, 0, 0, true });
+  return(entries.back());
+}
+
+static void syncFile(const String &path, const String &dstPath, SyncEntry &entry, uint8_t *buf, SyncStats &stats) {
+  spiBusGive();                         // the source is in internal flash
+  File src = LittleFS.open(path, FILE_READ);
+  spiBusTake();
+  if(!src) {
+    Serial.printf("  Failed to open source file: %s\r\n", path.c_str());
+    stats.failed = true;
+    return;
+  }
+  uint32_t size = src.size();
+  if(size == entry.synced && size == entry.size) {
+    return;                             // nothing new
+  }
+
+  // continue a copy of which the progress was not recorded, unless the source was replaced
+  uint32_t from = 0;
+  if(size >= entry.size) {
+    File dst = SD.open(dstPath, FILE_READ);
+    uint32_t copied = dst ? dst.size() : 0;
+    if(copied >= entry.synced && copied <= size) {
+      from = copied;
+    }
+  }
+  stats.dirty |= entry.size != size || entry.synced != from;
+  entry.size = size;
+  entry.synced = from;
+  if(from == size) {
+    return;
+  }
+
+  File dst = SD.open(dstPath, from ? FILE_APPEND : FILE_WRITE);
+  if(!dst || !src.seek(from)) {
+    Serial.printf("  Failed to open destination file: %s\r\n", dstPath.c_str());
+    stats.failed = true;
+    return;
+  }
+  Serial.printf("  Copying %s from %u to %u\r\n", path.c_str(), (unsigned)from, (unsigned)size);
+
+  // all writes but the first start at a sector boundary of the copy
+  size_t chunk = SD_SYNC_BUF - from % SD_SECTOR;
+  while(entry.synced < size && !sdSyncStop) {
+    spiBusGive();
+    size_t len = src.read(buf, min(chunk, (size_t)(size - entry.synced)));
+    spiBusTake();
+    for(size_t done = 0; done < len; ) {
+      size_t n = min(len - done, (size_t)(SD_SYNC_WRITE - entry.synced % SD_SECTOR));
+      if(dst.write(buf + done, n) != n) {
+        len = 0;
+        break;
+      }
+      done += n;
+      entry.synced += n;
+      stats.bytes += n;
+      spiBusYield();
+    }
+    if(len == 0) {
+      Serial.printf("  Failed to copy %s\r\n", path.c_str());
+      stats.failed = true;
+      break;
+    }
+    chunk = SD_SYNC_BUF;
+  }
+  stats.files++;
+  stats.dirty = true;
+  dst.close();
+  src.close();
+}
+
+static void syncDir(const String &path, const String &dst, std::vector<SyncEntry> &entries, uint8_t *buf, SyncStats &stats) {
+  if(!SD.exists(dst) && !SD.mkdir(dst)) {
+    Serial.printf("  Failed to create destination dir: %s\r\n", dst.c_str());
+    stats.failed = true;
+    return;
+  }
+  File dir = LittleFS.open(path);
+  if(!dir || !dir.isDirectory()) {
+    Serial.printf("  Failed to open source dir: %s\r\n", path.c_str());
+    stats.failed = true;
+    return;
+  }
+  String prefix = path == "/" ? "" : path;
+  File entry = dir.openNextFile();
+  while(entry && !sdSyncStop) {
+    String name = String("/") + entry.name();
+    bool isDir = entry.isDirectory();
+    entry.close();
+    if(isDir) {
+      syncDir(prefix + name, dst + name, entries, buf, stats);
+    } else {
+      syncFile(prefix + name, dst + name, syncEntry(entries, prefix + name, stats), buf, stats);
+    }
+    entry = dir.openNextFile();
+  }
+  dir.close();
+}
+
+// copy what changed in the filesystem since the last sync to the directory dst on the card,
+// returns the number of files copied or -1 when not all could be copied; the caller holds the bus
+int syncToSD(const String &dst) {
+  std::vector<SyncEntry> entries;
+  SyncStats stats = { 0 };
+  uint8_t *buf = (uint8_t *)malloc(SD_SYNC_BUF);
+  if(!buf) {
+    Serial.printf("SD sync: out of memory\r\n");
+    return(-1);
+  }
+
+  uint32_t start = micros();
+  syncLoadManifest(dst, entries);
+  syncDir("/", dst, entries, buf, stats);
+
+  // files that were not visited are dropped, unless the copy was stopped before it got there
+  for(auto &entry : entries) {
+    if(!entry.seen) {
+      entry.seen = sdSyncStop;
+      stats.dirty |= !sdSyncStop;
+    }
+  }
+  if(stats.dirty && !syncSaveManifest(dst, entries)) {
+    Serial.printf("  Failed to write manifest\r\n");
+    stats.failed = true;
+  }
+  uint32_t us = micros() - start;
+  free(buf);
+
+  Serial.printf("SD sync%s: %u files, %u bytes in %u ms (%.2f MB/s)\r\n", sdSyncStop ? " interrupted" : "",
+                (unsigned)stats.files, (unsigned)stats.bytes, (unsigned)(us / 1000), us ? (float)stats.bytes / us : 0.0f);
+  return(stats.failed ? -1 : stats.files);
+}
+
+static void sdSyncTask(void *params) {
+  (void)params;
+  spiBusTake();
+  if(SD.begin(SD_CS, spiSX, SD_SPI_HZ)) {
+    Serial.printf("SD card mounted, %llu MB\r\n", SD.cardSize() / (1024ULL * 1024ULL));
+    int copied = syncToSD(sdSyncDst);
+    SD.end();
+    spiBusGive();
+
+    // signal that the card is up to date, unless there was nothing to do
+    for(int i = 0; copied > 0 && i < 10 && !sdSyncStop; i++) {
+      digitalWrite(LED_B, HIGH);
+      delay(50);
+      digitalWrite(LED_B, LOW);
+      delay(100);
+    }
+  } else {
+    spiBusGive();
+    Serial.println("No SD card.");
+  }
+  sdSyncRunning = false;
+  vTaskDelete(NULL);
+}
+
+// start copying to the directory dst on the card, if one is inserted
+void sdSyncStart(const String &dst) {
+  sdSyncDst = dst;
+  sdSyncStop = false;
+  sdSyncRunning = true;
+  xTaskCreatePinnedToCore(sdSyncTask, "sdsync", 8192, NULL, tskIDLE_PRIORITY + 1, NULL, 0);
+}
+
+// wait for the copy to stop at the next write; it continues on the next start
+void sdSyncEnd() {
+  sdSyncStop = true;
+  while(sdSyncRunning) {
+    delay(10);
+  }
+}
+
+#endif
@@ -0,0 +1,370 @@
+#ifndef _SENSORS_H
+#define _SENSORS_H
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include <Adafruit_Sensor.h>
+#include <Adafruit_TSL2591.h>
+#include <Adafruit_AS7331.h>
+#include <Adafruit_BME280.h>
+#include <SensirionI2cScd4x.h>
+#include <SensirionI2CSen5x.h>
+
+#include "pins.h"
+#include "soundsensor.h"
+#include "measurement.h"
+#include "events.h"
+
+Adafruit_TSL2591 tsl;
+Adafruit_BME280 bme;
+Adafruit_AS7331 uv;
+SensirionI2cScd4x scd4x;
+SensirionI2CSen5x sen5x;
+SoundSensor mic;
+
+// all values collected during one measurement cycle
+struct Readings {
+  float temp, humi, pres;             // BME280: degC, %RH, hPa
+  float lumi;                         // TSL2591: lux
+  float uva, uvb, uvc;                // AS7331: uW/cm2
+  uint16_t co2;                       // SCD41: ppm
+  float scdTemp, scdHumi;             // SCD41: degC, %RH
+  float pm1_0, pm2_5, pm4_0, pm10;    // SEN5x: ug/m3
+  float temp5x, humi5x;               // SEN5x: degC, %RH
+  float vocIndex, noxIndex;           // SEN5x: index
+  float dbMin, dbAvg, dbMax;          // microphone: dB(A)
+};
+
+Readings readings = { 0 };
+
+// the circumstances of a measurement, for sensors that adapt to them
+struct SensorContext {
+  bool slow;                          // on the SLOW interval
+  bool motion;
+};
+
+// Generic sensor driver, used by the state machine through the registry below.
+// A measurement consists of begin() and trigger(), after which the result is
+// read() once ready() - by default when conversionMs has passed - and the
+// sensor is put to sleep(), which may depend on the context.
+class Sensor {
+public:
+  const char* name;
+  uint32_t conversionMs;    // time from trigger() until the result is available
+  bool enabled = true;
+  uint32_t tTrigger = 0;
+
+  Sensor(const char* name, uint32_t conversionMs) : name(name), conversionMs(conversionMs) {}
+
+  virtual bool begin() { return(true); }
+  virtual void trigger(const Readings &rd) = 0;
+  virtual bool ready() { return(millis() - tTrigger >= conversionMs); }
+  virtual void read(Readings &rd) = 0;
+  virtual void sleep(const SensorContext &ctx) { (void)ctx; }
+};
+
+class TphSensor : public Sensor {
+public:
+  TphSensor() : Sensor("BME280", 0) {}
+
+  bool begin() override {
+    return(bme.begin(118, &Wire));
+  }
+
+  // the first forced measurement after waking up is discarded
+  void trigger(const Readings &rd) override {
+    (void)rd;
+    bme.setSampling(Adafruit_BME280::MODE_FORCED);
+    bme.takeForcedMeasurement();
+    delay(200);
+    bme.takeForcedMeasurement();
+  }
+
+  void read(Readings &rd) override {
+    rd.temp = bme.readTemperature();
+    rd.humi = bme.readHumidity();
+    rd.pres = bme.readPressure() / 100.0f;
+    Serial.printf("Temp: %.2f, humi: %.2f, pres: %.2f\n", rd.temp, rd.humi, rd.pres);
+  }
+
+  void sleep(const SensorContext &ctx) override {
+    (void)ctx;
+    bme.setSampling(Adafruit_BME280::MODE_SLEEP);
+  }
+};
+
+class Co2Sensor : public Sensor {
+public:
+  Co2Sensor() : Sensor("SCD41", 5000) {}
+
+  bool begin() override {
+    scd4x.begin(Wire, 0x62);
+    return(true);
+  }
+
+  void trigger(const Readings &rd) override {
+    scd4x.setAmbientPressure(rd.pres * 100.0f);
+
+    // manually call the measureSingleShot() registers as the library does a blocking call
+    uint8_t buffer_ptr[9] = { 0 };
+    SensirionI2CTxFrame txFrame =
+        SensirionI2CTxFrame::createWithUInt16Command(0x219d, buffer_ptr, 2);
+    (void)SensirionI2CCommunication::sendFrame(0x62, txFrame, Wire);
+  }
+
+  // note: spec says this can take up to 5000ms, but I've never seen more than 4500ms
+  bool ready() override {
+    bool co2_ready = false;
+    scd4x.getDataReadyStatus(co2_ready);
+    return(co2_ready);
+  }
+
+  void read(Readings &rd) override {
+    scd4x.readMeasurement(rd.co2, rd.scdTemp, rd.scdHumi);
+    Serial.printf("CO2: %d\n", rd.co2);
+    Serial.printf("Temp: %.2f, humi: %.2f\n", rd.scdTemp, rd.scdHumi);
+  }
+};
+
+class LumSensor : public Sensor {
+public:
+  LumSensor() : Sensor("TSL2591", 0) {}
+
+  bool begin() override {
+    return(tsl.begin(&Wire, 41));
+  }
+
+  void trigger(const Readings &rd) override {
+    (void)rd;
+    tsl.enable();
+  }
+
+  void read(Readings &rd) override {
+    uint32_t full = tsl.getFullLuminosity();
+    rd.lumi = tsl.calculateLux(full & 0xFFFF, full >> 16);
+    Serial.printf("Lumi: %d\n", (int)rd.lumi);
+  }
+
+  void sleep(const SensorContext &ctx) override {
+    (void)ctx;
+    tsl.disable();
+  }
+};
+
+class UvSensor : public Sensor {
+public:
+  UvSensor() : Sensor("AS7331", 5 + (1 << AS7331_TIME_64MS)) {}
+
+  bool begin() override {
+    if(!uv.begin(&Wire)) {
+      return(false);
+    }
+    uv.powerDown(true);
+    uv.setGain(AS7331_GAIN_4X);
+    uv.setIntegrationTime(AS7331_TIME_64MS);
+    uv.setMeasurementMode(AS7331_MODE_CMD);
+    return(true);
+  }
+
+  void trigger(const Readings &rd) override {
+    (void)rd;
+    uv.powerDown(false);
+    uv.startMeasurement();
+  }
+
+  void read(Readings &rd) override {
+    uv.readAllUV_uWcm2(&rd.uva, &rd.uvb, &rd.uvc);
+    Serial.printf("UV: %d uW/cm2\n", (int)rd.uva);
+  }
+
+  void sleep(const SensorContext &ctx) override {
+    (void)ctx;
+    uv.powerDown(true);
+  }
+};
+
+static float zweighting[] = Z_WEIGHTING;    // weighting lists
+static Measurement zMeasurement( zweighting);  // measurement buffers
+
+volatile bool mic_stop = false;
+volatile bool mic_stopped = false;
+
+void mic_get_db(void * params) {
+
+  mic.offset(-1.8);    // for SPH0645
+  mic.begin(BCLK, LRCLK, DIN);
+  long startMic = millis();
+  bool reset = false;
+  long startSecond = startMic;
+  float secondEnergy = 0;
+  int secondBlocks = 0;
+
+  while (!mic_stop) {
+    float* energy = mic.readSamples();
+    zMeasurement.update(energy);
+
+    // the level of every second for the live stream, computed as in Measurement::calculate()
+    for (int i = 0; i < OCTAVES; i++) {
+      secondEnergy += energy[i] * zweighting[i];
+    }
+    secondBlocks++;
+    if (millis() - startSecond >= 1000) {
+      eventPublishf("mic", "\"db\":%.1f", zMeasurement.decibel(secondEnergy / secondBlocks));
+      startSecond = millis();
+      secondEnergy = 0;
+      secondBlocks = 0;
+    }
+    if (millis() - startMic > 3000) {
+      if (!reset) {
+        zMeasurement.reset();
+        reset = true;
+      }
+    }
+  }
+  zMeasurement.calculate();
+  mic.disable();
+  mic_stopped = true;
+  vTaskDelete(NULL);
+}
+
+// the microphone samples in its own task for a total of 30 seconds
+class MicSensor : public Sensor {
+public:
+  MicSensor() : Sensor("SPH0645", 30000) {}
+
+  void trigger(const Readings &rd) override {
+    (void)rd;
+    mic_stop = false;
+    mic_stopped = false;
+
+    xTaskCreatePinnedToCore(
+      mic_get_db,   /* Task function. */
+      "Task1",       /* name of task. */
+      8192,       /* Stack size of task */
+      NULL,        /* parameter of the task */
+      1,         /* priority of the task */
+      NULL,      /* Task handle to keep track of created task */
+      0);        /* pin task to core 0 */
+  }
+
+  void read(Readings &rd) override {
+    mic_stop = true;
+    Serial.println("Stopping microphone");
+    while (!mic_stopped)
+      delay(10);
+    rd.dbMin = zMeasurement.min;
+    rd.dbAvg = zMeasurement.avg;
+    rd.dbMax = zMeasurement.max;
+    Serial.printf("dB: [%.1f | %.1f | %.1f]\n", rd.dbMin, rd.dbAvg, rd.dbMax);
+  }
+};
+
+// the SEN5x fan and laser need 30 seconds to settle after power-up
+class PmSensor : public Sensor {
+public:
+  bool needsReset = true;
+
+  PmSensor() : Sensor("SEN5x", 30000) {}
+
+  // start and reset only once
+  bool begin() override {
+    if(needsReset) {
+      pinMode(V5_CTRL, OUTPUT);
+      digitalWrite(V5_CTRL, HIGH);
+      delay(75);   // theoretical startup time is 50ms
+      sen5x.begin(Wire);
+      (void)sen5x.deviceReset();
+      (void)sen5x.startMeasurement();
+      needsReset = false;
+    }
+    return(true);
+  }
+
+  void trigger(const Readings &rd) override {
+    (void)rd;
+  }
+
+  void read(Readings &rd) override {
+    (void)sen5x.readMeasuredValues(rd.pm1_0, rd.pm2_5, rd.pm4_0, rd.pm10, rd.humi5x, rd.temp5x,
+                                   rd.vocIndex, rd.noxIndex);
+    Serial.printf("PM2.5: %.2f, PM10: %.2f\n", rd.pm2_5, rd.pm10);
+    Serial.printf("Temp: %.2f, humi: %.2f\n", rd.temp5x, rd.humi5x);
+  }
+
+  // with motion or a faster interval, keep running between measurements for improved
+  // accuracy; otherwise power down already to save energy
+  void sleep(const SensorContext &ctx) override {
+    if(ctx.slow && !ctx.motion) {
+      digitalWrite(V5_CTRL, LOW);
+      needsReset = true;
+    }
+  }
+};
+
+TphSensor tphSensor;
+Co2Sensor co2Sensor;
+LumSensor lumSensor;
+UvSensor uvSensor;
+MicSensor micSensor;
+PmSensor pmSensor;
+
+// sensors are started in this order: long conversions first, and the BME280 before
+// the SCD41 as the pressure is used for CO2 compensation
+Sensor* sensors[] = {
+  &pmSensor,
+  &micSensor,
+  &tphSensor,
+  &co2Sensor,
+  &lumSensor,
+  &uvSensor,
+};
+
+#define NUM_SENSORS (sizeof(sensors) / sizeof(sensors[0]))
+
+bool sensorPending[NUM_SENSORS] = { false };
+
+void sensorFinish(size_t i, Readings &rd, const SensorContext &ctx) {
+  sensors[i]->read(rd);
+  sensors[i]->sleep(ctx);
+  sensorPending[i] = false;
+}
+
+// start all enabled sensors; sensors without conversion time are read right away,
+// so that sensors further down the list can use their result
+void sensorsStart(Readings &rd, const SensorContext &ctx) {
+  for(size_t i = 0; i < NUM_SENSORS; i++) {
+    sensorPending[i] = false;
+    if(!sensors[i]->enabled) {
+      continue;
+    }
+    if(!sensors[i]->begin()) {
+      Serial.printf("[Sensor] %s not found\n", sensors[i]->name);
+      continue;
+    }
+    sensors[i]->tTrigger = millis();
+    sensors[i]->trigger(rd);
+    sensorPending[i] = true;
+    if(sensors[i]->conversionMs == 0) {
+      sensorFinish(i, rd, ctx);
+    }
+  }
+}
+
+// read all sensors that have finished their conversion, returns true once all are done
+bool sensorsPoll(Readings &rd, const SensorContext &ctx) {
+  bool done = true;
+  for(size_t i = 0; i < NUM_SENSORS; i++) {
+    if(!sensorPending[i]) {
+      continue;
+    }
+    if(sensors[i]->ready()) {
+      sensorFinish(i, rd, ctx);
+    } else {
+      done = false;
+    }
+  }
+  return(done);
+}
+
+#endif